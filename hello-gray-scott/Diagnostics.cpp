@@ -0,0 +1,106 @@
+#include "Diagnostics.h"
+
+#include <algorithm>
+
+#include <fmt/core.h>
+
+Diagnostics::Diagnostics(int width, int height, int interval)
+	: mCells(width * height), mInterval(interval), mNumGroups(0),
+	  mFence(0), mStep(0), mNextSample(0), mPendingStep(0), mDiverged(false)
+{
+}
+
+bool Diagnostics::init()
+{
+	if (!mProgram.loadComputeShader("shader/diagnostics.cs"))
+		return false;
+
+	mNumGroups = std::min(MAX_GROUPS, (mCells + GROUP_SIZE - 1) / GROUP_SIZE);
+
+	mPartial.create("diagnostics", mNumGroups * sizeof(GrayScottTotals), NULL, GL_DYNAMIC_COPY);
+	mResult.create("diagnostics", sizeof(GrayScottTotals), NULL, GL_DYNAMIC_READ);
+
+	return true;
+}
+
+void Diagnostics::destroy()
+{
+	if (mFence != 0)
+		glDeleteSync(mFence);
+	mFence = 0;
+
+	mPartial.destroy();
+	mResult.destroy();
+
+	mProgram.destroy();
+}
+
+void Diagnostics::update(GLuint bufA, GLuint bufB, int steps)
+{
+	if (mInterval <= 0 || mResult == 0)
+		return;
+
+	mStep += steps;
+
+	collect();
+
+	// A sample still in flight just pushes this one back
+	if (mStep < mNextSample || mFence != 0)
+		return;
+
+	// The step that produced the fields only synchronized its image writes
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, bufA);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, bufB);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, mPartial);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, mResult);
+
+	mProgram.use();
+	mProgram.setUniform("N", mCells);
+	mProgram.setUniform("numPartials", mNumGroups);
+
+	mProgram.setUniform("pass", 0);
+	glDispatchCompute(mNumGroups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	mProgram.setUniform("pass", 1);
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	glUseProgram(0);
+
+	mFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	mPendingStep = mStep;
+	mNextSample = mStep + mInterval;
+}
+
+//-----------------------------------------------------------------------------
+// Reads the totals back once the reduction has finished, never blocks
+//-----------------------------------------------------------------------------
+void Diagnostics::collect()
+{
+	if (mFence == 0)
+		return;
+
+	GLenum status = glClientWaitSync(mFence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		return;
+
+	glDeleteSync(mFence);
+	mFence = 0;
+
+	GrayScottTotals totals;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mResult);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GrayScottTotals), &totals);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	fmt::println("Gray Scott step {}: total A {:.2f} (mean {:.5f}), total B {:.2f} (mean {:.5f}), max B {:.4f}",
+		mPendingStep, totals.sumA, totals.sumA / mCells, totals.sumB, totals.sumB / mCells, totals.maxB);
+
+	if (totals.nanCells > 0.0f && !mDiverged)
+	{
+		fmt::println("Gray Scott step {}: {} cells are NaN/Inf, the solution has diverged", mPendingStep, (long long)totals.nanCells);
+		mDiverged = true;
+	}
+}
@@ -0,0 +1,48 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <glad/glad.h>
+
+#include "GpuMemory.h"
+#include "ShaderProgram.h"
+
+// Same order as the Q_* slots in shader/diagnostics.cs
+struct GrayScottTotals
+{
+	float sumA, sumB;
+	float maxB;
+	float nanCells;
+};
+
+// Total A and B every `interval` steps, reduced on the GPU by shader/diagnostics.cs and
+// read back through a fence once done, so the simulation never waits on them. The totals
+// are not conserved (feed and kill exchange mass with a reservoir) but their time series
+// shows when a pattern has settled, and NaN/Inf cells are reported as soon as they appear.
+class Diagnostics
+{
+public:
+	Diagnostics(int width, int height, int interval);
+
+	// Needs a current context
+	bool init();
+	void destroy();
+
+	// Call after advancing `steps` steps with the newest fields in bufA and bufB
+	void update(GLuint bufA, GLuint bufB, int steps);
+
+private:
+	static const int GROUP_SIZE = 256;
+	static const int MAX_GROUPS = 256;
+
+	void collect();
+
+	int mCells, mInterval, mNumGroups;
+	ShaderProgram mProgram;
+	GpuBuffer mPartial, mResult;
+
+	GLsync mFence;
+	long long mStep, mNextSample, mPendingStep;
+	bool mDiverged;
+};
+
+#endif // DIAGNOSTICS_H
@@ -0,0 +1,263 @@
+#include "FFT.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const double TWO_PI = 6.283185307179586;
+
+FFT::FFT(int n)
+	: mN(n)
+{
+	// Radix 4 first (cheapest butterfly), then 2, 3, 5 and whatever prime is left
+	std::vector<int> radices;
+	int rest = n;
+	while (rest % 4 == 0) { radices.push_back(4); rest /= 4; }
+	while (rest % 2 == 0) { radices.push_back(2); rest /= 2; }
+	for (int p = 3; rest > 1; p += 2)
+	{
+		while (rest % p == 0) { radices.push_back(p); rest /= p; }
+	}
+
+	int len = n;
+	int s = 1;
+	for (int r : radices)
+	{
+		Stage st;
+		st.radix = r;
+		st.m = len / r;
+		st.s = s;
+		st.twRe.resize(st.m * r);
+		st.twIm.resize(st.m * r);
+
+		for (int p = 0; p < st.m; p++)
+		{
+			for (int k = 0; k < r; k++)
+			{
+				double theta = TWO_PI * double(p) * double(k) / double(len);
+				st.twRe[p * r + k] = (float)std::cos(theta);
+				st.twIm[p * r + k] = (float)std::sin(theta);
+			}
+		}
+
+		mStages.push_back(st);
+		len = st.m;
+		s *= r;
+	}
+}
+
+void FFT::forward(float* re, float* im, int lanes)
+{
+	transform(re, im, lanes, -1.0f);
+}
+
+void FFT::inverse(float* re, float* im, int lanes)
+{
+	transform(re, im, lanes, 1.0f);
+}
+
+//-----------------------------------------------------------------------------
+// Runs the stages ping-ponging between the data and the scratch arrays
+//-----------------------------------------------------------------------------
+void FFT::transform(float* re, float* im, int lanes, float sign)
+{
+	if (mStages.empty())
+		return;
+
+	size_t count = size_t(mN) * lanes;
+	if (mScratchRe.size() < count)
+	{
+		mScratchRe.resize(count);
+		mScratchIm.resize(count);
+	}
+
+	float* xr = re;
+	float* xi = im;
+	float* yr = mScratchRe.data();
+	float* yi = mScratchIm.data();
+
+	for (const Stage& st : mStages)
+	{
+		if (st.radix == 4)
+			radix4(st, xr, xi, yr, yi, lanes, sign);
+		else if (st.radix == 2)
+			radix2(st, xr, xi, yr, yi, lanes, sign);
+		else
+			radixN(st, xr, xi, yr, yi, lanes, sign);
+
+		std::swap(xr, yr);
+		std::swap(xi, yi);
+	}
+
+	if (xr != re)
+	{
+		std::memcpy(re, xr, count * sizeof(float));
+		std::memcpy(im, xi, count * sizeof(float));
+	}
+}
+
+void FFT::radix2(const Stage& st, const float* xr, const float* xi, float* yr, float* yi, int lanes, float sign)
+{
+	const int m = st.m;
+	const size_t len = size_t(st.s) * lanes;
+
+	for (int p = 0; p < m; p++)
+	{
+		const float wr = st.twRe[p * 2 + 1];
+		const float wi = sign * st.twIm[p * 2 + 1];
+
+		const float* __restrict ar = xr + len * p;
+		const float* __restrict ai = xi + len * p;
+		const float* __restrict br = xr + len * (p + m);
+		const float* __restrict bi = xi + len * (p + m);
+		float* __restrict y0r = yr + len * (2 * p);
+		float* __restrict y0i = yi + len * (2 * p);
+		float* __restrict y1r = yr + len * (2 * p + 1);
+		float* __restrict y1i = yi + len * (2 * p + 1);
+
+		for (size_t t = 0; t < len; t++)
+		{
+			float dr = ar[t] - br[t];
+			float di = ai[t] - bi[t];
+			y0r[t] = ar[t] + br[t];
+			y0i[t] = ai[t] + bi[t];
+			y1r[t] = dr * wr - di * wi;
+			y1i[t] = dr * wi + di * wr;
+		}
+	}
+}
+
+void FFT::radix4(const Stage& st, const float* xr, const float* xi, float* yr, float* yi, int lanes, float sign)
+{
+	const int m = st.m;
+	const size_t len = size_t(st.s) * lanes;
+
+	for (int p = 0; p < m; p++)
+	{
+		const float w1r = st.twRe[p * 4 + 1], w1i = sign * st.twIm[p * 4 + 1];
+		const float w2r = st.twRe[p * 4 + 2], w2i = sign * st.twIm[p * 4 + 2];
+		const float w3r = st.twRe[p * 4 + 3], w3i = sign * st.twIm[p * 4 + 3];
+
+		const float* __restrict a0r = xr + len * p;
+		const float* __restrict a0i = xi + len * p;
+		const float* __restrict a1r = xr + len * (p + m);
+		const float* __restrict a1i = xi + len * (p + m);
+		const float* __restrict a2r = xr + len * (p + 2 * m);
+		const float* __restrict a2i = xi + len * (p + 2 * m);
+		const float* __restrict a3r = xr + len * (p + 3 * m);
+		const float* __restrict a3i = xi + len * (p + 3 * m);
+		float* __restrict y0r = yr + len * (4 * p);
+		float* __restrict y0i = yi + len * (4 * p);
+		float* __restrict y1r = yr + len * (4 * p + 1);
+		float* __restrict y1i = yi + len * (4 * p + 1);
+		float* __restrict y2r = yr + len * (4 * p + 2);
+		float* __restrict y2i = yi + len * (4 * p + 2);
+		float* __restrict y3r = yr + len * (4 * p + 3);
+		float* __restrict y3i = yi + len * (4 * p + 3);
+
+		for (size_t t = 0; t < len; t++)
+		{
+			float s02r = a0r[t] + a2r[t], s02i = a0i[t] + a2i[t];
+			float d02r = a0r[t] - a2r[t], d02i = a0i[t] - a2i[t];
+			float s13r = a1r[t] + a3r[t], s13i = a1i[t] + a3i[t];
+			float d13r = a1r[t] - a3r[t], d13i = a1i[t] - a3i[t];
+
+			// sign * i * (a1 - a3)
+			float jr = -sign * d13i;
+			float ji = sign * d13r;
+
+			float b1r = d02r + jr, b1i = d02i + ji;
+			float b2r = s02r - s13r, b2i = s02i - s13i;
+			float b3r = d02r - jr, b3i = d02i - ji;
+
+			y0r[t] = s02r + s13r;
+			y0i[t] = s02i + s13i;
+			y1r[t] = b1r * w1r - b1i * w1i;
+			y1i[t] = b1r * w1i + b1i * w1r;
+			y2r[t] = b2r * w2r - b2i * w2i;
+			y2i[t] = b2r * w2i + b2i * w2r;
+			y3r[t] = b3r * w3r - b3i * w3i;
+			y3i[t] = b3r * w3i + b3i * w3r;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Plain DFT butterfly for the odd radices, O(radix^2) per point
+//-----------------------------------------------------------------------------
+void FFT::radixN(const Stage& st, const float* xr, const float* xi, float* yr, float* yi, int lanes, float sign)
+{
+	const int r = st.radix;
+	const int m = st.m;
+	const size_t len = size_t(st.s) * lanes;
+
+	std::vector<float> rootRe(r), rootIm(r);
+	for (int j = 0; j < r; j++)
+	{
+		rootRe[j] = (float)std::cos(TWO_PI * j / r);
+		rootIm[j] = sign * (float)std::sin(TWO_PI * j / r);
+	}
+
+	for (int p = 0; p < m; p++)
+	{
+		for (int k = 0; k < r; k++)
+		{
+			float* __restrict ykr = yr + len * (r * p + k);
+			float* __restrict yki = yi + len * (r * p + k);
+
+			const float* __restrict a0r = xr + len * p;
+			const float* __restrict a0i = xi + len * p;
+			for (size_t t = 0; t < len; t++)
+			{
+				ykr[t] = a0r[t];
+				yki[t] = a0i[t];
+			}
+
+			for (int j = 1; j < r; j++)
+			{
+				const float cr = rootRe[(j * k) % r];
+				const float ci = rootIm[(j * k) % r];
+				const float* __restrict ajr = xr + len * (p + j * m);
+				const float* __restrict aji = xi + len * (p + j * m);
+
+				for (size_t t = 0; t < len; t++)
+				{
+					ykr[t] += ajr[t] * cr - aji[t] * ci;
+					yki[t] += ajr[t] * ci + aji[t] * cr;
+				}
+			}
+
+			if (k > 0 && p > 0)
+			{
+				const float wr = st.twRe[p * r + k];
+				const float wi = sign * st.twIm[p * r + k];
+
+				for (size_t t = 0; t < len; t++)
+				{
+					float vr = ykr[t];
+					float vi = yki[t];
+					ykr[t] = vr * wr - vi * wi;
+					yki[t] = vr * wi + vi * wr;
+				}
+			}
+		}
+	}
+}
+
+void transpose(const float* src, float* dst, int rows, int cols)
+{
+	const int B = 32;
+
+	for (int r0 = 0; r0 < rows; r0 += B)
+	{
+		for (int c0 = 0; c0 < cols; c0 += B)
+		{
+			int r1 = std::min(r0 + B, rows);
+			int c1 = std::min(c0 + B, cols);
+
+			for (int r = r0; r < r1; r++)
+				for (int c = c0; c < c1; c++)
+					dst[size_t(c) * rows + r] = src[size_t(r) * cols + c];
+		}
+	}
+}
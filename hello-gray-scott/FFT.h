@@ -0,0 +1,46 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <vector>
+
+// Mixed radix (4, 2, 3, 5, any prime) Stockham FFT of length n.
+//
+// The transform runs on `lanes` independent sequences at once, stored in split
+// real/imaginary arrays with element e of lane l at [e * lanes + l]. Every inner
+// loop walks contiguous lanes, so the compiler can turn it into SIMD code; a 2D
+// transform is a pass over the columns of a row major grid, a transpose and a
+// second pass.
+class FFT
+{
+public:
+	FFT(int n = 1);
+
+	int size() const { return mN; }
+
+	void forward(float* re, float* im, int lanes);
+	// Unnormalized, the caller scales by 1/n
+	void inverse(float* re, float* im, int lanes);
+
+private:
+	struct Stage
+	{
+		int radix;
+		int m;		// n / radix of this stage
+		int s;		// stride (product of the radices before it)
+		std::vector<float> twRe, twIm;	// w_n^(p*k) for p < m, k < radix
+	};
+
+	void transform(float* re, float* im, int lanes, float sign);
+	void radix2(const Stage& st, const float* xr, const float* xi, float* yr, float* yi, int lanes, float sign);
+	void radix4(const Stage& st, const float* xr, const float* xi, float* yr, float* yi, int lanes, float sign);
+	void radixN(const Stage& st, const float* xr, const float* xi, float* yr, float* yi, int lanes, float sign);
+
+	int mN;
+	std::vector<Stage> mStages;
+	std::vector<float> mScratchRe, mScratchIm;
+};
+
+// Out of place transpose of a rows x cols grid
+void transpose(const float* src, float* dst, int rows, int cols);
+
+#endif // FFT_H
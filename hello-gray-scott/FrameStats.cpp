@@ -0,0 +1,195 @@
+#include "FrameStats.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <GLFW/glfw3.h>
+
+static double msSince(std::chrono::steady_clock::time_point t0, std::chrono::steady_clock::time_point t1)
+{
+	return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+// Nearest rank percentile of a sorted vector
+static float percentile(const std::vector<float>& sorted, double p)
+{
+	if (sorted.empty())
+		return 0.0f;
+	size_t i = std::min(sorted.size() - 1, size_t(p * sorted.size()));
+	return sorted[i];
+}
+
+FrameStats::FrameStats(const char* name, double interval)
+	: mName(name), mInterval(interval), mWindow(NULL), mFile(NULL),
+	  mWrite(0), mRead(0), mQueryHead(0), mQueryPending(0), mQueriesCreated(false),
+	  mStarted(false)
+{
+	mFrameStart = mLastReport = std::chrono::steady_clock::now();
+}
+
+FrameStats::~FrameStats()
+{
+	// The queries die with the context, which may already be gone here
+	if (mFile != NULL)
+		std::fclose(mFile);
+}
+
+void FrameStats::setOutput(const char* path)
+{
+	if (mFile != NULL)
+		std::fclose(mFile);
+	mFile = NULL;
+
+	if (path == NULL)
+		return;
+
+	mFile = std::fopen(path, "w");
+	if (mFile == NULL)
+	{
+		fmt::println("Unable to open {}, frame stats go to stdout", path);
+		return;
+	}
+
+	std::fprintf(mFile, "frames,seconds,fps,steps_per_s,cpu_p50,cpu_p95,cpu_p99,cpu_max,gpu_p50,gpu_p95,gpu_p99,gpu_max\n");
+}
+
+void FrameStats::beginFrame()
+{
+	if (!mQueriesCreated)
+	{
+		glGenQueries(NUM_QUERIES * 2, &mQueries[0][0]);
+		mQueriesCreated = true;
+	}
+
+	if (!mStarted)
+	{
+		mLastReport = std::chrono::steady_clock::now();
+		mStarted = true;
+	}
+
+	mFrameStart = std::chrono::steady_clock::now();
+
+	resolveQueries();
+
+	// With every query in flight this frame goes without GPU time rather than waiting
+	if (mQueryPending < NUM_QUERIES)
+		glQueryCounter(mQueries[mQueryHead][0], GL_TIMESTAMP);
+}
+
+void FrameStats::endFrame(int steps)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	FrameSample sample;
+	sample.cpuMs = (float)msSince(mFrameStart, now);
+	sample.gpuMs = -1.0f;
+	sample.steps = steps;
+
+	if (mQueryPending < NUM_QUERIES)
+	{
+		glQueryCounter(mQueries[mQueryHead][1], GL_TIMESTAMP);
+		mPendingSample[mQueryHead] = sample;
+		mQueryHead = (mQueryHead + 1) % NUM_QUERIES;
+		mQueryPending++;
+	}
+	else
+		push(sample);
+
+	if (msSince(mLastReport, now) >= mInterval * 1000.0)
+	{
+		// Frames whose timestamps are still in flight go into the next report
+		resolveQueries();
+		report();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Pushes the frames whose timestamps have landed, oldest first; never waits
+//-----------------------------------------------------------------------------
+void FrameStats::resolveQueries()
+{
+	while (mQueryPending > 0)
+	{
+		int oldest = (mQueryHead - mQueryPending + NUM_QUERIES) % NUM_QUERIES;
+
+		GLint available = 0;
+		glGetQueryObjectiv(mQueries[oldest][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			break;
+
+		GLuint64 t0 = 0, t1 = 0;
+		glGetQueryObjectui64v(mQueries[oldest][0], GL_QUERY_RESULT, &t0);
+		glGetQueryObjectui64v(mQueries[oldest][1], GL_QUERY_RESULT, &t1);
+
+		FrameSample sample = mPendingSample[oldest];
+		sample.gpuMs = float(double(t1 - t0) * 1e-6);
+		push(sample);
+
+		mQueryPending--;
+	}
+}
+
+void FrameStats::push(const FrameSample& sample)
+{
+	unsigned w = mWrite.load(std::memory_order_relaxed);
+	mRing[w % RING_SIZE] = sample;
+	mWrite.store(w + 1, std::memory_order_release);
+}
+
+void FrameStats::report()
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double seconds = msSince(mLastReport, now) * 1e-3;
+	mLastReport = now;
+
+	unsigned w = mWrite.load(std::memory_order_acquire);
+	// Older samples were overwritten
+	if (w - mRead > RING_SIZE)
+		mRead = w - RING_SIZE;
+
+	std::vector<float> cpu, gpu;
+	long long steps = 0;
+	for (unsigned i = mRead; i != w; i++)
+	{
+		const FrameSample& s = mRing[i % RING_SIZE];
+		cpu.push_back(s.cpuMs);
+		if (s.gpuMs >= 0.0f)
+			gpu.push_back(s.gpuMs);
+		steps += s.steps;
+	}
+	mRead = w;
+
+	if (cpu.empty() || seconds <= 0.0)
+		return;
+
+	std::sort(cpu.begin(), cpu.end());
+	std::sort(gpu.begin(), gpu.end());
+
+	double fps = cpu.size() / seconds;
+	double stepsPerSecond = steps / seconds;
+
+	if (mFile != NULL)
+	{
+		std::fprintf(mFile, "%zu,%.3f,%.2f,%.1f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+			cpu.size(), seconds, fps, stepsPerSecond,
+			percentile(cpu, 0.50), percentile(cpu, 0.95), percentile(cpu, 0.99), cpu.back(),
+			percentile(gpu, 0.50), percentile(gpu, 0.95), percentile(gpu, 0.99), gpu.empty() ? 0.0f : gpu.back());
+		std::fflush(mFile);
+	}
+	else
+	{
+		fmt::println("{}: {:.1f} fps, {:.0f} steps/s | cpu ms p50 {:.2f} p95 {:.2f} p99 {:.2f} max {:.2f} | gpu ms p50 {:.2f} p95 {:.2f} p99 {:.2f} max {:.2f}",
+			mName, fps, stepsPerSecond,
+			percentile(cpu, 0.50), percentile(cpu, 0.95), percentile(cpu, 0.99), cpu.back(),
+			percentile(gpu, 0.50), percentile(gpu, 0.95), percentile(gpu, 0.99), gpu.empty() ? 0.0f : gpu.back());
+	}
+
+	if (mWindow != NULL)
+	{
+		char title[128];
+		std::snprintf(title, sizeof(title), "%s @ fps: %.2f, ms/frame p50: %.2f p99: %.2f", mName.c_str(), fps, percentile(cpu, 0.50), percentile(cpu, 0.99));
+		glfwSetWindowTitle(mWindow, title);
+	}
+}
@@ -0,0 +1,71 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include <glad/glad.h>
+
+struct GLFWwindow;
+
+// One finished frame
+struct FrameSample
+{
+	float cpuMs;	// wall time between beginFrame and endFrame
+	float gpuMs;	// GPU time between beginFrame and endFrame, < 0 if it was not available
+	int steps;		// simulation steps done in the frame
+};
+
+// Frame time statistics, replaces the 0.25 s average that showFPS() put in the title.
+//
+// Samples go into a single producer / single consumer ring without locks, so
+// push() may be called from another thread than report(). GPU time is measured
+// with a pair of timestamp queries per frame that are read back a few frames
+// later, never stalling the pipeline. Every `interval` seconds p50/p95/p99/max
+// of CPU and GPU frame time plus steps/second are printed to stdout or appended
+// as CSV to a file, and shown in the window title when there is one.
+class FrameStats
+{
+public:
+	FrameStats(const char* name, double interval = 1.0);
+	~FrameStats();
+
+	// CSV output instead of stdout; NULL goes back to stdout
+	void setOutput(const char* path);
+	void setWindow(GLFWwindow* window) { mWindow = window; }
+
+	// Bracket the GL work of a frame; needs a current context
+	void beginFrame();
+	void endFrame(int steps);
+
+	void push(const FrameSample& sample);
+	void report();
+
+private:
+	static const int RING_SIZE = 1024;
+	static const int NUM_QUERIES = 8;
+
+	void resolveQueries();
+
+	std::string mName;
+	double mInterval;
+	GLFWwindow* mWindow;
+	FILE* mFile;
+
+	FrameSample mRing[RING_SIZE];
+	std::atomic<unsigned> mWrite;
+	unsigned mRead;
+
+	// Timestamp queries of frames whose GPU time is not known yet
+	GLuint mQueries[NUM_QUERIES][2];
+	FrameSample mPendingSample[NUM_QUERIES];
+	int mQueryHead, mQueryPending;
+	bool mQueriesCreated;
+
+	std::chrono::steady_clock::time_point mFrameStart, mLastReport;
+	bool mStarted;
+};
+
+#endif // FRAME_STATS_H
@@ -0,0 +1,227 @@
+#include "GpuMemory.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <fmt/core.h>
+
+namespace
+{
+	struct Usage
+	{
+		size_t bytes = 0, peak = 0;
+		int objects = 0;
+	};
+
+	struct Registry
+	{
+		std::mutex mutex;
+		std::map<std::string, Usage> subsystems;
+		size_t budget = 0;
+		size_t bytes = 0, peak = 0;
+		int objects = 0;
+	};
+
+	// Never freed, wrappers in other globals may still release into it on exit
+	Registry& registry()
+	{
+		static Registry* r = new Registry;
+		return *r;
+	}
+
+	double megabytes(size_t bytes)
+	{
+		return bytes / (1024.0 * 1024.0);
+	}
+
+	size_t bytesPerTexel(GLenum internalFormat)
+	{
+		switch (internalFormat)
+		{
+		case GL_R8: return 1;
+		case GL_RG8: case GL_R16F: return 2;
+		case GL_RGBA8: case GL_R32F: case GL_RG16F: case GL_R32I: case GL_R32UI: return 4;
+		case GL_RGBA16F: case GL_RG32F: return 8;
+		case GL_RGBA32F: return 16;
+		}
+		fmt::println("GpuMemory: unknown texture format {:#x}, counted as 4 bytes per texel", internalFormat);
+		return 4;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// GpuMemory
+//-----------------------------------------------------------------------------
+void GpuMemory::setBudget(size_t bytes)
+{
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	r.budget = bytes;
+}
+
+void GpuMemory::allocate(const char* subsystem, size_t bytes, int objects)
+{
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+
+	if (r.budget > 0 && r.bytes + bytes > r.budget)
+	{
+		fmt::println("GpuMemory: {} allocating {:.1f} MB takes {:.1f} MB over the budget of {:.1f} MB",
+			subsystem, megabytes(bytes), megabytes(r.bytes + bytes - r.budget), megabytes(r.budget));
+	}
+
+	Usage& usage = r.subsystems[subsystem];
+	usage.bytes += bytes;
+	usage.objects += objects;
+	usage.peak = std::max(usage.peak, usage.bytes);
+
+	r.bytes += bytes;
+	r.objects += objects;
+	r.peak = std::max(r.peak, r.bytes);
+}
+
+void GpuMemory::release(const char* subsystem, size_t bytes, int objects)
+{
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+
+	Usage& usage = r.subsystems[subsystem];
+	usage.bytes -= bytes;
+	usage.objects -= objects;
+	r.bytes -= bytes;
+	r.objects -= objects;
+}
+
+size_t GpuMemory::liveBytes()
+{
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	return r.bytes;
+}
+
+int GpuMemory::liveObjects()
+{
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	return r.objects;
+}
+
+void GpuMemory::report(const char* title)
+{
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+
+	fmt::print("{}: {:.1f} MB in {} objects, peak {:.1f} MB", title, megabytes(r.bytes), r.objects, megabytes(r.peak));
+	if (r.budget > 0)
+		fmt::print(", budget {:.1f} MB", megabytes(r.budget));
+	fmt::println("");
+
+	for (const auto& entry : r.subsystems)
+	{
+		const Usage& usage = entry.second;
+		fmt::println("  {:<14} {:9.2f} MB {:4} objects   peak {:9.2f} MB",
+			entry.first, megabytes(usage.bytes), usage.objects, megabytes(usage.peak));
+	}
+}
+
+//-----------------------------------------------------------------------------
+// GpuBuffer
+//-----------------------------------------------------------------------------
+GpuBuffer::GpuBuffer()
+	: mHandle(0), mBytes(0), mSubsystem(NULL)
+{
+}
+
+GpuBuffer::~GpuBuffer()
+{
+	if (mHandle != 0)
+		fmt::println("GpuMemory: {} buffer of {} bytes was never destroyed", mSubsystem, mBytes);
+}
+
+void GpuBuffer::account(const char* subsystem, size_t bytes)
+{
+	if (mHandle == 0)
+	{
+		GpuMemory::allocate(subsystem, bytes, 1);
+		glGenBuffers(1, &mHandle);
+	}
+	else
+	{
+		// Re-specified, the new store replaces the old one
+		GpuMemory::release(mSubsystem, mBytes, 0);
+		GpuMemory::allocate(subsystem, bytes, 0);
+	}
+	mSubsystem = subsystem;
+	mBytes = bytes;
+}
+
+void GpuBuffer::create(const char* subsystem, size_t bytes, const void* data, GLenum usage)
+{
+	account(subsystem, bytes);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mHandle);
+	glBufferData(GL_COPY_WRITE_BUFFER, bytes, data, usage);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GpuBuffer::createStorage(const char* subsystem, size_t bytes, const void* data, GLbitfield flags)
+{
+	if (mHandle != 0)
+		destroy();
+
+	account(subsystem, bytes);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mHandle);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, bytes, data, flags);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void GpuBuffer::destroy()
+{
+	if (mHandle == 0)
+		return;
+
+	glDeleteBuffers(1, &mHandle);
+	GpuMemory::release(mSubsystem, mBytes, 1);
+	mHandle = 0;
+	mBytes = 0;
+}
+
+//-----------------------------------------------------------------------------
+// GpuTexture
+//-----------------------------------------------------------------------------
+GpuTexture::GpuTexture()
+	: mHandle(0), mBytes(0), mSubsystem(NULL)
+{
+}
+
+GpuTexture::~GpuTexture()
+{
+	if (mHandle != 0)
+		fmt::println("GpuMemory: {} texture of {} bytes was never destroyed", mSubsystem, mBytes);
+}
+
+void GpuTexture::create2D(const char* subsystem, GLenum internalFormat, int width, int height)
+{
+	// Immutable, a new size needs a new texture
+	destroy();
+
+	mSubsystem = subsystem;
+	mBytes = size_t(width) * height * bytesPerTexel(internalFormat);
+	GpuMemory::allocate(subsystem, mBytes, 1);
+
+	glGenTextures(1, &mHandle);
+	glBindTexture(GL_TEXTURE_2D, mHandle);
+	glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+}
+
+void GpuTexture::destroy()
+{
+	if (mHandle == 0)
+		return;
+
+	glDeleteTextures(1, &mHandle);
+	GpuMemory::release(mSubsystem, mBytes, 1);
+	mHandle = 0;
+	mBytes = 0;
+}
@@ -0,0 +1,161 @@
+#include "GrayScottApi.h"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <fmt/core.h>
+
+#include "GrayScottEngine.h"
+
+struct gs_sim
+{
+	GrayScottEngine engine;
+	GLFWwindow* window;		// hidden, only when gs_create() made the context
+};
+
+gs_config gs_default_config(void)
+{
+	gs_config config;
+	config.width = 256;
+	config.height = 256;
+	config.f = 0.019f;
+	config.k = 0.047f;
+	config.da = 1.0f;
+	config.db = 0.4f;
+	config.shader_dir = NULL;
+	return config;
+}
+
+// Hidden windows made by createContext(), and whether it initialized GLFW; then
+// the last destroyContext() terminates it again
+static int sWindows = 0;
+static bool sInitialized = false;
+
+//-----------------------------------------------------------------------------
+// A context of our own when the caller has none
+//-----------------------------------------------------------------------------
+static GLFWwindow* createContext()
+{
+	// A caller that uses GLFW without a current context keeps its GLFW
+	glfwGetError(NULL);
+	glfwGetCurrentContext();
+	bool initialize = glfwGetError(NULL) == GLFW_NOT_INITIALIZED;
+
+	if (!glfwInit())
+	{
+		fmt::println("GLFW initialization failed");
+		return NULL;
+	}
+
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	GLFWwindow* window = glfwCreateWindow(1, 1, "gray-scott-engine", NULL, NULL);
+	if (window == NULL)
+	{
+		fmt::println("Failed to create GLFW window");
+		if (initialize)
+			glfwTerminate();
+		return NULL;
+	}
+
+	sInitialized = sInitialized || initialize;
+	sWindows++;
+	glfwMakeContextCurrent(window);
+	return window;
+}
+
+static void destroyContext(GLFWwindow* window)
+{
+	glfwDestroyWindow(window);
+	if (--sWindows == 0 && sInitialized)
+	{
+		glfwTerminate();
+		sInitialized = false;
+	}
+}
+
+gs_sim* gs_create(const gs_config* config)
+{
+	gs_config c = config != NULL ? *config : gs_default_config();
+
+	GLFWwindow* window = NULL;
+	if (glfwGetCurrentContext() == NULL)
+	{
+		window = createContext();
+		if (window == NULL)
+			return NULL;
+	}
+	if (!gladLoadGL())
+	{
+		fmt::println("Failed to load OpenGL");
+		if (window != NULL)
+			destroyContext(window);
+		return NULL;
+	}
+
+	if (c.shader_dir != NULL)
+		ShaderProgram::setDirectory(c.shader_dir);
+
+	gs_sim* sim = new gs_sim;
+	sim->window = window;
+	if (!sim->engine.init(c.width, c.height))
+	{
+		gs_destroy(sim);
+		return NULL;
+	}
+
+	gs_set_params(sim, c.f, c.k, c.da, c.db);
+	return sim;
+}
+
+void gs_destroy(gs_sim* sim)
+{
+	if (sim == NULL)
+		return;
+
+	sim->engine.destroy();
+	if (sim->window != NULL)
+		destroyContext(sim->window);
+	delete sim;
+}
+
+void gs_step(gs_sim* sim, int steps)
+{
+	if (steps > 0)
+		sim->engine.step(steps);
+}
+
+long long gs_steps(const gs_sim* sim)
+{
+	return sim->engine.steps();
+}
+
+void gs_set_params(gs_sim* sim, float f, float k, float da, float db)
+{
+	SweepParams params = { f, k, da, db };
+	sim->engine.setParams(params);
+}
+
+void gs_set_state(gs_sim* sim, const float* a, const float* b)
+{
+	sim->engine.setState(a, b);
+}
+
+int gs_get_field(gs_sim* sim, int field, gs_field* out)
+{
+	if (field < GS_A || field > GS_B || out == NULL)
+		return -1;
+
+	GrayScottEngine::FieldView view = sim->engine.field(field == GS_A ? GrayScottEngine::FIELD_A : GrayScottEngine::FIELD_B);
+	out->data = view.data;
+	out->ndim = 2;
+	out->shape[0] = view.rows;
+	out->shape[1] = view.cols;
+	out->strides[0] = view.rowStride;
+	out->strides[1] = view.colStride;
+	out->mapped = view.mapped ? 1 : 0;
+	return 0;
+}
@@ -0,0 +1,77 @@
+#ifndef GRAY_SCOTT_API_H
+#define GRAY_SCOTT_API_H
+
+/*
+ * C API of the Gray Scott solver, built as the gray-scott-engine shared library.
+ *
+ * gs_create() uses the OpenGL context current on the calling thread, or makes
+ * a hidden window with a 4.3 context of its own when there is none. Every call
+ * on a simulation has to come from the thread it was created on.
+ *
+ * gs_get_field() fills a gs_field with a pointer to A or B and its shape and
+ * byte strides, row-major (height, width). The pointer stays valid until the
+ * next gs_step(), gs_set_state() or gs_destroy().
+ */
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#  if defined(GS_API_EXPORTS)
+#    define GS_API __declspec(dllexport)
+#  else
+#    define GS_API __declspec(dllimport)
+#  endif
+#else
+#  define GS_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct gs_sim gs_sim;
+
+enum gs_field_id
+{
+    GS_A,
+    GS_B
+};
+
+typedef struct gs_config
+{
+    int width, height;
+    float f, k;
+    float da, db;
+    const char* shader_dir; /* where shader/gray-scott-sweep.cs is, NULL for the working directory */
+} gs_config;
+
+typedef struct gs_field
+{
+    const float* data;
+    int ndim;               /* always 2 */
+    size_t shape[2];        /* height, width */
+    size_t strides[2];      /* in bytes */
+    int mapped;             /* data points into GPU-written mapped memory */
+} gs_field;
+
+GS_API gs_config gs_default_config(void);
+
+/* NULL on failure, the reason is printed */
+GS_API gs_sim* gs_create(const gs_config* config);
+GS_API void gs_destroy(gs_sim* sim);
+
+GS_API void gs_step(gs_sim* sim, int steps);
+GS_API long long gs_steps(const gs_sim* sim);
+
+GS_API void gs_set_params(gs_sim* sim, float f, float k, float da, float db);
+/* width * height values each */
+GS_API void gs_set_state(gs_sim* sim, const float* a, const float* b);
+
+/* 0 on success */
+GS_API int gs_get_field(gs_sim* sim, int field, gs_field* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GRAY_SCOTT_API_H */
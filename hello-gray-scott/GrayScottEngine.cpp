@@ -0,0 +1,159 @@
+#include "GrayScottEngine.h"
+
+#include <cstdlib>
+
+#include <fmt/core.h>
+
+GrayScottEngine::GrayScottEngine()
+	: mWidth(0), mHeight(0), mCurrent(0), mSteps(0), mMapped(NULL)
+{
+}
+
+bool GrayScottEngine::init(int width, int height)
+{
+	if (width <= 0 || height <= 0)
+	{
+		fmt::println("GrayScottEngine: bad grid size {} x {}", width, height);
+		return false;
+	}
+
+	if (!mProgram.loadComputeShader("shader/gray-scott-sweep.cs"))
+		return false;
+
+	mWidth = width;
+	mHeight = height;
+	mCurrent = 0;
+	mSteps = 0;
+
+	size_t cells = size_t(width) * height;
+	std::vector<float> a(cells, 1.0f), b(cells);
+	for (size_t i = 0; i < cells; i++)
+		b[i] = (rand() / float(RAND_MAX) < 0.0021) ? 1.0f : 0.0f;
+
+	mA[0].create("state", cells * sizeof(float), a.data(), GL_DYNAMIC_COPY);
+	mA[1].create("state", cells * sizeof(float), a.data(), GL_DYNAMIC_COPY);
+	mB[0].create("state", cells * sizeof(float), b.data(), GL_DYNAMIC_COPY);
+	mB[1].create("state", cells * sizeof(float), b.data(), GL_DYNAMIC_COPY);
+
+	// Same (f, k) as the middle of the gradient in gray-scott.cs
+	SweepParams params = { 0.019f, 0.047f, 1.0f, 0.4f };
+	mParams.create("params", sizeof(SweepParams), &params, GL_DYNAMIC_COPY);
+	mUploads.init(2 * cells * sizeof(float));
+
+	size_t readbackBytes = 2 * cells * sizeof(float);
+	if (GLAD_GL_VERSION_4_4)
+	{
+		GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		mReadback.createStorage("readback", readbackBytes, NULL, flags | GL_CLIENT_STORAGE_BIT);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mReadback);
+		mMapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, readbackBytes, flags);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	else
+	{
+		mReadback.create("readback", readbackBytes, NULL, GL_STREAM_READ);
+		mHost.resize(2 * cells);
+	}
+
+	return true;
+}
+
+void GrayScottEngine::destroy()
+{
+	if (mReadback != 0 && mMapped != NULL)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mReadback);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	for (int i = 0; i < 2; i++)
+	{
+		mA[i].destroy();
+		mB[i].destroy();
+	}
+	mParams.destroy();
+	mUploads.destroy();
+	mReadback.destroy();
+	mMapped = NULL;
+	mHost.clear();
+
+	mProgram.destroy();
+}
+
+void GrayScottEngine::setParams(const SweepParams& params)
+{
+	mUploads.upload(mParams, 0, &params, sizeof(SweepParams));
+}
+
+void GrayScottEngine::setState(const float* a, const float* b)
+{
+	size_t bytes = size_t(mWidth) * mHeight * sizeof(float);
+	mUploads.upload(mA[mCurrent], 0, a, bytes);
+	mUploads.upload(mB[mCurrent], 0, b, bytes);
+}
+
+void GrayScottEngine::step(int steps)
+{
+	mProgram.use();
+	mProgram.setUniform("W", mWidth);
+	mProgram.setUniform("H", mHeight);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, mParams);
+
+	for (int i = 0; i < steps; i++)
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mA[mCurrent]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, mA[1 - mCurrent]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mB[mCurrent]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, mB[1 - mCurrent]);
+		mCurrent = 1 - mCurrent;
+
+		glDispatchCompute((mWidth + 15) / 16, (mHeight + 15) / 16, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	glUseProgram(0);
+	mSteps += steps;
+}
+
+//-----------------------------------------------------------------------------
+// Copies A or B into its half of the readback buffer
+//-----------------------------------------------------------------------------
+GrayScottEngine::FieldView GrayScottEngine::field(Field f)
+{
+	size_t cells = size_t(mWidth) * mHeight;
+	size_t offset = f == FIELD_A ? 0 : cells * sizeof(float);
+
+	// The steps wrote it from a shader, the copy is a buffer update command
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	glBindBuffer(GL_COPY_READ_BUFFER, f == FIELD_A ? mA[mCurrent] : mB[mCurrent]);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mReadback);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset, cells * sizeof(float));
+
+	const char* base;
+	if (mMapped != NULL)
+	{
+		// Coherent, the fence is all it takes for the copy to be visible
+		GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(fence);
+		base = (const char*)mMapped;
+	}
+	else
+	{
+		glGetBufferSubData(GL_COPY_WRITE_BUFFER, offset, cells * sizeof(float), (char*)mHost.data() + offset);
+		base = (const char*)mHost.data();
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	FieldView view;
+	view.data = (const float*)(base + offset);
+	view.rows = mHeight;
+	view.cols = mWidth;
+	view.rowStride = mWidth * sizeof(float);
+	view.colStride = sizeof(float);
+	view.mapped = mMapped != NULL;
+	return view;
+}
@@ -0,0 +1,76 @@
+#ifndef GRAY_SCOTT_ENGINE_H
+#define GRAY_SCOTT_ENGINE_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "GpuMemory.h"
+#include "ShaderProgram.h"
+#include "Sweep.h"
+#include "UploadRing.h"
+
+// One Gray Scott simulation without the window, for driving it from other
+// programs (see GrayScottApi.h for the C API around it).
+//
+// Steps with shader/gray-scott-sweep.cs as a single layer, so any grid size
+// works and (f, k, DA, DB) are set per simulation instead of the gradient of
+// gray-scott.cs. Nothing is drawn.
+//
+// field() copies A or B into a readback buffer and returns a view of it with its
+// shape and strides. The readback buffer is persistently mapped where
+// glBufferStorage exists (GL 4.4), so the view points straight at memory the GPU
+// wrote, otherwise it is a host copy. A view stays valid until the next step()
+// or setState().
+class GrayScottEngine
+{
+public:
+	enum Field
+	{
+		FIELD_A,
+		FIELD_B,
+		NUM_FIELDS
+	};
+
+	struct FieldView
+	{
+		const float* data;
+		size_t rows, cols;				// height, width
+		size_t rowStride, colStride;	// in bytes
+		bool mapped;					// points into the persistently mapped buffer
+	};
+
+	GrayScottEngine();
+
+	// Needs a current context. Starts at A = 1 with B seeded at random, like main.cpp.
+	bool init(int width, int height);
+	void destroy();
+
+	void setParams(const SweepParams& params);
+	// width * height values each
+	void setState(const float* a, const float* b);
+
+	void step(int steps);
+	FieldView field(Field f);
+
+	int width() const { return mWidth; }
+	int height() const { return mHeight; }
+	long long steps() const { return mSteps; }
+
+private:
+	int mWidth, mHeight;
+
+	ShaderProgram mProgram;
+	GpuBuffer mA[2], mB[2];	// mA[mCurrent], mB[mCurrent] are the newest
+	GpuBuffer mParams;
+	UploadRing mUploads;		// setState() and setParams()
+	int mCurrent;
+	long long mSteps;
+
+	GpuBuffer mReadback;		// A then B
+	void* mMapped;				// NULL without glBufferStorage
+	std::vector<float> mHost;	// the readback without a mapping
+};
+
+#endif // GRAY_SCOTT_ENGINE_H
@@ -0,0 +1,54 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// A file mapped read/write into memory, for state that does not fit in RAM.
+//
+// The pages are the page cache's: they are read in when touched and written
+// back by the OS, so a mapping can be much larger than the memory there is.
+// prefetch() asks for a range to be read ahead, writeBack() starts writing a
+// range without waiting for it and release() tells the OS a range will not be
+// needed for a while, so its pages are the first to go. All three are hints,
+// ranges are widened to whole pages.
+//
+// mmap / madvise / sync_file_range on Linux (msync elsewhere), MapViewOfFile /
+// PrefetchVirtualMemory / FlushViewOfFile on Windows.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Creates the file or resizes an existing one to `bytes`, new bytes are zero
+	bool open(const std::string& filename, size_t bytes);
+	// Writes everything back and waits for it
+	void close();
+
+	char* data() const { return mData; }
+	size_t size() const { return mSize; }
+
+	void prefetch(size_t offset, size_t bytes);
+	void writeBack(size_t offset, size_t bytes);
+	void release(size_t offset, size_t bytes);
+
+private:
+	// The whole pages around [offset, offset + bytes), false when empty
+	bool pages(size_t& offset, size_t& bytes) const;
+
+	char* mData;
+	size_t mSize;
+	size_t mPageSize;
+#ifdef _WIN32
+	void* mFile;
+	void* mMapping;
+#else
+	int mFile;
+#endif
+};
+
+#endif // MAPPED_FILE_H
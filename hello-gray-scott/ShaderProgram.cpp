@@ -6,6 +6,8 @@
 
 #include <fmt/core.h>
 
+string ShaderProgram::sDirectory;
+
 ShaderProgram::ShaderProgram()
 	: mHandle(0)
 {
@@ -67,6 +69,57 @@ bool ShaderProgram::loadShaders(const char* vsFilename, const char* fsFilename)
 	return true;
 }
 
+//-----------------------------------------------------------------------------
+// Loads a compute shader into its own program
+//-----------------------------------------------------------------------------
+bool ShaderProgram::loadComputeShader(const char* csFilename)
+{
+	string csString = fileToString(csFilename);
+	if (csString.empty())
+	{
+		fmt::println("Unable to read compute shader {}", csFilename);
+		return false;
+	}
+
+	const GLchar* csSourcePtr = csString.c_str();
+
+	GLuint cs = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(cs, 1, &csSourcePtr, NULL);
+
+	glCompileShader(cs);
+	if (!checkCompileErrors(cs, COMPUTE))
+	{
+		glDeleteShader(cs);
+		return false;
+	}
+
+	mHandle = glCreateProgram();
+	if (mHandle == 0)
+	{
+		glDeleteShader(cs);
+		fmt::println("Unable to create shader program!");
+		return false;
+	}
+
+	glAttachShader(mHandle, cs);
+
+	glLinkProgram(mHandle);
+	bool linked = checkCompileErrors(mHandle, PROGRAM);
+
+	glDeleteShader(cs);
+
+	mUniformLocations.clear();
+
+	if (!linked)
+	{
+		glDeleteProgram(mHandle);
+		mHandle = 0;
+		return false;
+	}
+
+	return true;
+}
+
 void ShaderProgram::use()
 {
 	if (mHandle > 0)
@@ -82,9 +135,12 @@ string ShaderProgram::fileToString(const string& filename)
 	std::stringstream ss;
 	std::ifstream file;
 
+	bool absolute = !filename.empty() && (filename[0] == '/' || filename[0] == '\\' || (filename.size() > 1 && filename[1] == ':'));
+	string path = sDirectory.empty() || absolute ? filename : sDirectory + "/" + filename;
+
 	try
 	{
-		file.open(filename, std::ios::in);
+		file.open(path, std::ios::in);
 
 		if (!file.fail())
 		{
@@ -113,7 +169,7 @@ const GLuint ShaderProgram::getProgram()
 //-----------------------------------------------------------------------------
 // Checks for shader compiler errors
 //-----------------------------------------------------------------------------
-void  ShaderProgram::checkCompileErrors(GLuint shader, ShaderType type)
+bool  ShaderProgram::checkCompileErrors(GLuint shader, ShaderType type)
 {
 	int status = 0;
 
@@ -148,6 +204,7 @@ void  ShaderProgram::checkCompileErrors(GLuint shader, ShaderType type)
 		}
 	}
 
+	return status != GL_FALSE;
 }
 
 //-----------------------------------------------------------------------------
@@ -186,6 +243,15 @@ void ShaderProgram::setUniform(const GLchar* name, const GLint v)
 	glUniform1i(loc, v);
 }
 
+//-----------------------------------------------------------------------------
+// Sets a GLfloat shader uniform
+//-----------------------------------------------------------------------------
+void ShaderProgram::setUniform(const GLchar* name, const GLfloat v)
+{
+	GLint loc = getUniformLocation(name);
+	glUniform1f(loc, v);
+}
+
 //-----------------------------------------------------------------------------
 // Returns the uniform identifier given it's string name.
 // NOTE: Shader must be currently active first.
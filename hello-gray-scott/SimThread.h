@@ -0,0 +1,76 @@
+#ifndef SIM_THREAD_H
+#define SIM_THREAD_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <glad/glad.h>
+
+struct GLFWwindow;
+
+// Runs the simulation on its own thread so that vsync, input and drawing no
+// longer throttle it.
+//
+// The thread owns a hidden 1x1 window whose context shares objects with the
+// render window. Each batch the step function advances the simulation and
+// copies whatever the renderer needs into one of NUM_SLOTS snapshot slots. A
+// fence after the copies marks the slot finished and it becomes the newest one.
+// The render thread acquires the newest slot (a GPU-side wait on that fence, the
+// CPU does not block), draws from it and releases it with a fence of its own.
+// The simulation waits on that fence on the GPU before it writes into the slot
+// again. Neither the slot being drawn nor the newest one is ever written, so a
+// batch always has a free slot and the renderer always has a finished one;
+// with only two the newest would be overwritten before it was picked up.
+//
+// A batch is only queued once the one before it has finished, so the GPU queue
+// stays short for the renderer. With a rate > 0 batches are also paced to
+// that many per second, otherwise the simulation runs as fast as the GPU allows.
+// Buffer bindings and other context state do not carry over from the render
+// context, the step function sets up what it uses.
+class SimThread
+{
+public:
+	static const int NUM_SLOTS = 3;
+
+	// Advances the simulation and writes the snapshot `slot`, returns the steps done
+	typedef std::function<int(int slot)> StepFunc;
+
+	SimThread();
+	~SimThread();
+
+	// Call on the thread that created `share`, returns once the first snapshot is ready
+	bool start(GLFWwindow* share, StepFunc step, double rate = 0.0);
+	void stop();
+
+	// Render thread: newest finished slot, then release() after the draws that read it
+	int acquire();
+	void release();
+
+	// Simulation steps finished since the last call
+	int takeSteps() { return (int)mSteps.exchange(0); }
+
+	bool isRunning() const { return mWindow != NULL; }
+
+private:
+	void run();
+
+	GLFWwindow* mWindow;
+	StepFunc mStep;
+	double mRate;
+
+	std::thread mThread;
+	std::atomic<bool> mQuit;
+	std::atomic<long long> mSteps;
+
+	std::mutex mMutex;
+	std::condition_variable mFirst;
+	GLsync mWritten[NUM_SLOTS];	// signaled when the snapshot in the slot is complete
+	GLsync mRead[NUM_SLOTS];	// signaled when the renderer is done with the slot
+	int mReady;				// newest finished slot not yet acquired, -1 for none
+	int mReading;			// slot the renderer draws from, -1 before the first
+};
+
+#endif // SIM_THREAD_H
@@ -0,0 +1,180 @@
+#include "SpectralGrayScott.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const double TWO_PI = 6.283185307179586;
+
+//-----------------------------------------------------------------------------
+// phi1(z) = (e^z - 1) / z and phi2(z) = (e^z - 1 - z) / z^2, with series near 0
+//-----------------------------------------------------------------------------
+static double phi1(double z)
+{
+	if (std::fabs(z) < 1e-4)
+		return 1.0 + z / 2.0 + z * z / 6.0;
+	return std::expm1(z) / z;
+}
+
+static double phi2(double z)
+{
+	if (std::fabs(z) < 1e-4)
+		return 0.5 + z / 6.0 + z * z / 24.0;
+	return (std::expm1(z) - z) / (z * z);
+}
+
+SpectralGrayScott::SpectralGrayScott(int width, int height, float DA, float DB, float dt, float sigma)
+	: mWidth(width), mHeight(height), mDt(dt), mSigma(sigma), mFFTx(width), mFFTy(height)
+{
+	const size_t n = size_t(width) * height;
+
+	mF.assign(width, 0.04f);
+	mK.assign(width, 0.065f);
+	mA.assign(n, 1.0f);
+	mB.assign(n, 0.0f);
+
+	for (std::vector<float>* v : { &mPE, &mQE, &mP1, &mQ1, &mP2, &mQ2, &mUr, &mUi, &mNr, &mNi, &mSr, &mSi, &mWr, &mWi, &mTr, &mTi })
+		v->resize(n);
+	mNeg.resize(n);
+
+	// Spectrum layout is [kx][ky]
+	for (int kx = 0; kx < width; kx++)
+	{
+		for (int ky = 0; ky < height; ky++)
+		{
+			size_t idx = ky + size_t(kx) * height;
+			mNeg[idx] = (height - ky) % height + ((width - kx) % width) * height;
+
+			// Symbol of the 9-point stencil: -1 centre, 0.2 edges, 0.05 corners
+			double cx = std::cos(TWO_PI * kx / width);
+			double cy = std::cos(TWO_PI * ky / height);
+			double lambda = -1.0 + 0.4 * cx + 0.4 * cy + 0.2 * cx * cy;
+
+			double zA = (DA * lambda - sigma) * dt;
+			double zB = (DB * lambda - sigma) * dt;
+
+			double eA = std::exp(zA), eB = std::exp(zB);
+			double p1A = dt * phi1(zA), p1B = dt * phi1(zB);
+			double p2A = dt * phi2(zA), p2B = dt * phi2(zB);
+
+			mPE[idx] = float(0.5 * (eA + eB));
+			mQE[idx] = float(0.5 * (eA - eB));
+			mP1[idx] = float(0.5 * (p1A + p1B));
+			mQ1[idx] = float(0.5 * (p1A - p1B));
+			mP2[idx] = float(0.5 * (p2A + p2B));
+			mQ2[idx] = float(0.5 * (p2A - p2B));
+		}
+	}
+}
+
+void SpectralGrayScott::setReaction(const std::vector<float>& f, const std::vector<float>& k)
+{
+	mF = f;
+	mK = k;
+	mF.resize(mWidth, mF.empty() ? 0.04f : mF.back());
+	mK.resize(mWidth, mK.empty() ? 0.065f : mK.back());
+}
+
+void SpectralGrayScott::setState(const float* A, const float* B)
+{
+	const size_t n = mA.size();
+
+	std::copy(A, A + n, mA.begin());
+	std::copy(B, B + n, mB.begin());
+
+	std::copy(A, A + n, mTr.begin());
+	std::copy(B, B + n, mTi.begin());
+	forward2D(mTr.data(), mTi.data(), mUr.data(), mUi.data());
+}
+
+void SpectralGrayScott::reaction(const float* A, const float* B, float* NA, float* NB) const
+{
+	for (int y = 0; y < mHeight; y++)
+	{
+		const size_t row = size_t(y) * mWidth;
+
+		for (int x = 0; x < mWidth; x++)
+		{
+			float a = A[row + x];
+			float b = B[row + x];
+			float abb = a * b * b;
+			NA[row + x] = -abb + mF[x] * (1.0f - a) + mSigma * a;
+			NB[row + x] = abb - (mK[x] + mF[x]) * b + mSigma * b;
+		}
+	}
+}
+
+void SpectralGrayScott::forward2D(float* inRe, float* inIm, float* outRe, float* outIm)
+{
+	mFFTy.forward(inRe, inIm, mWidth);
+	transpose(inRe, outRe, mHeight, mWidth);
+	transpose(inIm, outIm, mHeight, mWidth);
+	mFFTx.forward(outRe, outIm, mHeight);
+}
+
+void SpectralGrayScott::inverse2D(float* inRe, float* inIm, float* outRe, float* outIm)
+{
+	mFFTx.inverse(inRe, inIm, mHeight);
+	transpose(inRe, outRe, mWidth, mHeight);
+	transpose(inIm, outIm, mWidth, mHeight);
+	mFFTy.inverse(outRe, outIm, mWidth);
+
+	const size_t n = mA.size();
+	const float scale = 1.0f / float(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		outRe[i] *= scale;
+		outIm[i] *= scale;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// ETDRK2:
+//   a       = e^(Lh) u + h phi1(Lh) N(u)
+//   u_(n+1) = a + h phi2(Lh) (N(a) - N(u))
+// The spectrum of u is carried between steps, A and B are refreshed from it.
+//-----------------------------------------------------------------------------
+void SpectralGrayScott::step(int n)
+{
+	const size_t count = mA.size();
+	const int* neg = mNeg.data();
+
+	for (int s = 0; s < n; s++)
+	{
+		// N(u_n)
+		reaction(mA.data(), mB.data(), mTr.data(), mTi.data());
+		forward2D(mTr.data(), mTi.data(), mNr.data(), mNi.data());
+
+		// Predictor a
+		for (size_t i = 0; i < count; i++)
+		{
+			int j = neg[i];
+			mSr[i] = mPE[i] * mUr[i] + mQE[i] * mUr[j] + mP1[i] * mNr[i] + mQ1[i] * mNr[j];
+			mSi[i] = mPE[i] * mUi[i] - mQE[i] * mUi[j] + mP1[i] * mNi[i] - mQ1[i] * mNi[j];
+		}
+
+		std::copy(mSr.begin(), mSr.end(), mTr.begin());
+		std::copy(mSi.begin(), mSi.end(), mTi.begin());
+		inverse2D(mTr.data(), mTi.data(), mA.data(), mB.data());
+
+		// N(a) - N(u_n)
+		reaction(mA.data(), mB.data(), mTr.data(), mTi.data());
+		forward2D(mTr.data(), mTi.data(), mWr.data(), mWi.data());
+		for (size_t i = 0; i < count; i++)
+		{
+			mWr[i] -= mNr[i];
+			mWi[i] -= mNi[i];
+		}
+
+		// Corrector
+		for (size_t i = 0; i < count; i++)
+		{
+			int j = neg[i];
+			mUr[i] = mSr[i] + mP2[i] * mWr[i] + mQ2[i] * mWr[j];
+			mUi[i] = mSi[i] + mP2[i] * mWi[i] - mQ2[i] * mWi[j];
+		}
+
+		std::copy(mUr.begin(), mUr.end(), mTr.begin());
+		std::copy(mUi.begin(), mUi.end(), mTi.begin());
+		inverse2D(mTr.data(), mTi.data(), mA.data(), mB.data());
+	}
+}
@@ -0,0 +1,213 @@
+#include "StreamingGrayScott.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+#include <fmt/core.h>
+
+StreamingGrayScott::StreamingGrayScott()
+	: mWidth(0), mHeight(0), mBandRows(0), mFusedSteps(0), mSteps(0), mBytesMoved(0.0), mCurrent(0)
+{
+	mParams = { 0.019f, 0.047f, 1.0f, 0.4f };
+}
+
+bool StreamingGrayScott::init(const std::string& directory, int width, int height, int bandRows, int fusedSteps)
+{
+	if (width < 3 || height < 3 || bandRows <= 0 || fusedSteps <= 0)
+	{
+		fmt::println("StreamingGrayScott: bad grid {} x {} or bands of {} rows and {} steps", width, height, bandRows, fusedSteps);
+		return false;
+	}
+
+	destroy();
+
+	std::error_code ec;
+	std::filesystem::create_directories(directory, ec);
+
+	size_t bytes = size_t(width) * height * 2 * sizeof(float);
+	for (int i = 0; i < 2; i++)
+	{
+		if (!mFiles[i].open(fmt::format("{}/state{}.bin", directory, i), bytes))
+		{
+			destroy();
+			return false;
+		}
+	}
+
+	mWidth = width;
+	mHeight = height;
+	mBandRows = std::min(bandRows, height);
+	mFusedSteps = fusedSteps;
+	mSteps = 0;
+	mCurrent = 0;
+
+	size_t windowCells = size_t(mBandRows + 2 * fusedSteps) * width;
+	mWindow[0].resize(2 * windowCells);
+	mWindow[1].resize(2 * windowCells);
+
+	// A band at a time, so start up does not need the whole grid either
+	std::vector<float> a(size_t(mBandRows) * width, 1.0f), b(a.size());
+	for (int y0 = 0; y0 < height; y0 += mBandRows)
+	{
+		int rows = std::min(mBandRows, height - y0);
+		for (size_t i = 0; i < size_t(rows) * width; i++)
+			b[i] = (rand() / float(RAND_MAX) < 0.0021) ? 1.0f : 0.0f;
+		writeRows(y0, rows, a.data(), b.data());
+	}
+
+	return true;
+}
+
+void StreamingGrayScott::destroy()
+{
+	mFiles[0].close();
+	mFiles[1].close();
+	mWindow[0].clear();
+	mWindow[1].clear();
+	mWidth = mHeight = 0;
+}
+
+void StreamingGrayScott::readRows(int y0, int rows, float* a, float* b) const
+{
+	const float* src = (const float*)(mFiles[mCurrent].data() + y0 * rowBytes());
+	for (size_t i = 0; i < size_t(rows) * mWidth; i++)
+	{
+		a[i] = src[2 * i];
+		b[i] = src[2 * i + 1];
+	}
+}
+
+void StreamingGrayScott::writeRows(int y0, int rows, const float* a, const float* b)
+{
+	float* dst = (float*)(mFiles[mCurrent].data() + y0 * rowBytes());
+	for (size_t i = 0; i < size_t(rows) * mWidth; i++)
+	{
+		dst[2 * i] = a[i];
+		dst[2 * i + 1] = b[i];
+	}
+	mFiles[mCurrent].writeBack(y0 * rowBytes(), rows * rowBytes());
+}
+
+//-----------------------------------------------------------------------------
+// One step of window rows first .. last - 1, as gray-scott-sweep.cs
+//-----------------------------------------------------------------------------
+void StreamingGrayScott::stepRows(const float* src, float* dst, int first, int last) const
+{
+	const float DA = mParams.DA, DB = mParams.DB, f = mParams.f, k = mParams.k;
+	const float dt = 1.0f;
+	int W = mWidth;
+
+	for (int j = first; j < last; j++)
+	{
+		const float* rm = src + 2 * size_t(j - 1) * W;
+		const float* r0 = src + 2 * size_t(j) * W;
+		const float* rp = src + 2 * size_t(j + 1) * W;
+		float* out = dst + 2 * size_t(j) * W;
+
+		for (int i = 0; i < W; i++)
+		{
+			int ip = i + 1 == W ? 0 : i + 1;
+			int im = i == 0 ? W - 1 : i - 1;
+
+			// Same neighbour order as gray-scott-sweep.cs
+			float laplA = -1.0f * r0[2 * i] + 0.2f * (r0[2 * im] + r0[2 * ip] + rm[2 * i] + rp[2 * i])
+				+ 0.05f * (rp[2 * ip] + rm[2 * ip] + rm[2 * im] + rp[2 * im]);
+			float laplB = -1.0f * r0[2 * i + 1] + 0.2f * (r0[2 * im + 1] + r0[2 * ip + 1] + rm[2 * i + 1] + rp[2 * i + 1])
+				+ 0.05f * (rp[2 * ip + 1] + rm[2 * ip + 1] + rm[2 * im + 1] + rp[2 * im + 1]);
+
+			float A = r0[2 * i], B = r0[2 * i + 1];
+			out[2 * i] = A + (DA * laplA - A * B * B + f * (1 - A)) * dt;
+			out[2 * i + 1] = B + (DB * laplB + A * B * B - (k + f) * B) * dt;
+		}
+	}
+}
+
+void StreamingGrayScott::sweepBand(int b0, int b1, int steps)
+{
+	const MappedFile& in = mFiles[mCurrent];
+	MappedFile& out = mFiles[1 - mCurrent];
+	size_t row = rowBytes();
+
+	// Rows b0 - steps .. b1 + steps - 1, periodic
+	int rows = b1 - b0 + 2 * steps;
+	for (int i = 0; i < rows; i++)
+	{
+		int y = ((b0 - steps + i) % mHeight + mHeight) % mHeight;
+		std::memcpy(mWindow[0].data() + i * row / sizeof(float), in.data() + y * row, row);
+	}
+
+	// Each step the rows next to the stale ones go stale too
+	int current = 0;
+	for (int s = 0; s < steps; s++)
+	{
+		stepRows(mWindow[current].data(), mWindow[1 - current].data(), s + 1, rows - s - 1);
+		current = 1 - current;
+	}
+
+	std::memcpy(out.data() + b0 * row, mWindow[current].data() + steps * row / sizeof(float), (b1 - b0) * row);
+	mBytesMoved += double(rows + b1 - b0) * row;
+}
+
+void StreamingGrayScott::step(int steps)
+{
+	mBytesMoved = 0.0;
+	size_t row = rowBytes();
+
+	while (steps > 0)
+	{
+		int fused = std::min(steps, mFusedSteps);
+		for (int b0 = 0; b0 < mHeight; b0 += mBandRows)
+		{
+			int b1 = std::min(b0 + mBandRows, mHeight);
+
+			// The next band is read while this one is computed
+			if (b1 < mHeight)
+				mFiles[mCurrent].prefetch(size_t(b1 + fused) * row, size_t(mBandRows) * row);
+
+			sweepBand(b0, b1, fused);
+
+			// Its rows are written while the next band is computed, and what no band
+			// reads again leaves memory (the last band wraps round to the first rows)
+			mFiles[1 - mCurrent].writeBack(b0 * row, (b1 - b0) * row);
+			mFiles[1 - mCurrent].release(b0 * row, (b1 - b0) * row);
+			int lo = std::max(fused, b0 - fused), hi = b1 - fused;
+			if (hi > lo)
+				mFiles[mCurrent].release(size_t(lo) * row, size_t(hi - lo) * row);
+		}
+
+		mCurrent = 1 - mCurrent;
+		mSteps += fused;
+		steps -= fused;
+	}
+}
+
+bool runStreamingGrayScott(const StreamingGrayScottRun& cfg)
+{
+	StreamingGrayScott gs;
+	if (!gs.init(cfg.directory, cfg.width, cfg.height, cfg.bandRows, cfg.fusedSteps))
+		return false;
+	gs.setParams(cfg.params);
+
+	double gigabytes = 2.0 * cfg.width * cfg.height * 2 * sizeof(float) / 1e9;
+	fmt::println("Out of core Gray Scott {}x{}, {:.1f} GB in {}, bands of {} rows, {} steps per pass",
+		cfg.width, cfg.height, gigabytes, cfg.directory, cfg.bandRows, cfg.fusedSteps);
+
+	auto start = std::chrono::steady_clock::now();
+	double moved = 0.0;
+	for (int done = 0; done < cfg.steps; done += cfg.fusedSteps)
+	{
+		gs.step(std::min(cfg.fusedSteps, cfg.steps - done));
+		moved += gs.bytesMoved();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	double updates = double(cfg.width) * cfg.height * gs.steps();
+	fmt::println("{} steps in {:.1f} s: {:.1f} Mcells/s, {:.1f} MB/s through the files",
+		gs.steps(), seconds, updates / seconds * 1e-6, moved / seconds * 1e-6);
+
+	gs.destroy();
+	return true;
+}
@@ -0,0 +1,83 @@
+#ifndef STREAMING_GRAY_SCOTT_H
+#define STREAMING_GRAY_SCOTT_H
+
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "Sweep.h"
+
+// Gray Scott on the CPU for grids larger than memory, with the state in files.
+//
+// A and B live interleaved in two memory-mapped files, one the state the step
+// reads and one it writes. The grid is swept in bands of rows: a band is copied
+// in with `fusedSteps` extra rows above and below, stepped that many times in
+// memory (every step leaves one more row at each edge stale) and its own rows
+// are written to the other file. So one pass over the files does fusedSteps
+// steps, at the cost of redoing 2 * fusedSteps rows per band. While a band is
+// computed the next one is prefetched, its output is queued for writeback as
+// soon as it is written and the rows no band needs any more are released, so
+// the disk works while the CPU does and the resident set stays at a few bands.
+//
+// The step is the one of shader/gray-scott-sweep.cs (9-point Laplacian, dt = 1,
+// periodic), in the same order of operations.
+class StreamingGrayScott
+{
+public:
+	StreamingGrayScott();
+
+	// Creates state0.bin and state1.bin in directory, width * height * 2 floats each.
+	// Starts at A = 1 with B seeded at random, like GrayScottEngine.
+	bool init(const std::string& directory, int width, int height, int bandRows = 256, int fusedSteps = 8);
+	void destroy();
+
+	void setParams(const SweepParams& params) { mParams = params; }
+
+	void step(int steps);
+
+	// Rows y0 .. y0 + rows - 1 of the newest state, width * rows values each
+	void readRows(int y0, int rows, float* a, float* b) const;
+	void writeRows(int y0, int rows, const float* a, const float* b);
+
+	int width() const { return mWidth; }
+	int height() const { return mHeight; }
+	long long steps() const { return mSteps; }
+	// Bytes copied from and to the files by the last step()
+	double bytesMoved() const { return mBytesMoved; }
+
+private:
+	// Copies window rows of a band in, steps them and writes its own rows out
+	void sweepBand(int b0, int b1, int steps);
+	void stepRows(const float* src, float* dst, int first, int last) const;
+
+	size_t rowBytes() const { return size_t(mWidth) * 2 * sizeof(float); }
+
+	int mWidth, mHeight;
+	int mBandRows, mFusedSteps;
+	SweepParams mParams;
+	long long mSteps;
+	double mBytesMoved;
+
+	MappedFile mFiles[2];			// mFiles[mCurrent] is the newest
+	int mCurrent;
+
+	std::vector<float> mWindow[2];	// a band and its halo rows, ping-pong
+};
+
+struct StreamingGrayScottRun
+{
+	std::string directory = "out-of-core";
+	int width = 16384;			// 2 GB per file
+	int height = 16384;
+	int bandRows = 256;
+	int fusedSteps = 8;
+
+	int steps = 64;
+	SweepParams params = { 0.019f, 0.047f, 1.0f, 0.4f };
+};
+
+// Steps a grid of the size given through the files and prints the cell updates
+// and the file traffic per second. Needs no GL context.
+bool runStreamingGrayScott(const StreamingGrayScottRun& cfg);
+
+#endif // STREAMING_GRAY_SCOTT_H
@@ -0,0 +1,229 @@
+#include "Sweep.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+
+#include <fmt/core.h>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "FrameStats.h"
+#include "GpuMemory.h"
+#include "ShaderProgram.h"
+
+//-----------------------------------------------------------------------------
+// Same palette as color() in shader/gray-scott.cs
+//-----------------------------------------------------------------------------
+static void paletteColor(float t, unsigned char rgb[3])
+{
+	const float coltab[] = { 0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 0.5f, 1.0f, 0.7f, 0.4f, 0.00f, 0.15f, 0.20f };
+
+	for (int c = 0; c < 3; c++)
+	{
+		float v = coltab[c] + coltab[c + 3] * std::cos(2 * 3.1416f * (coltab[c + 6] * t + coltab[c + 9]));
+		v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+		rgb[c] = (unsigned char)(v * 255.0f + 0.5f);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Writes one instance as a binary PPM, colored like the interactive demo
+//-----------------------------------------------------------------------------
+static bool writeSnapshot(const std::string& filename, const float* A, const float* B, int width, int height)
+{
+	FILE* fp = std::fopen(filename.c_str(), "wb");
+	if (fp == NULL)
+	{
+		fmt::println("Unable to write {}", filename);
+		return false;
+	}
+
+	std::fprintf(fp, "P6\n%d %d\n255\n", width, height);
+
+	std::vector<unsigned char> row(width * 3);
+	// PPM rows go top to bottom, the simulation grid bottom to top
+	for (int y = height - 1; y >= 0; y--)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			int idx = x + y * width;
+			paletteColor(1.51f * A[idx] + 1.062f * B[idx], &row[x * 3]);
+		}
+		std::fwrite(row.data(), 1, row.size(), fp);
+	}
+
+	std::fclose(fp);
+	return true;
+}
+
+std::vector<SweepParams> makeSweepGrid(const SweepConfig& cfg)
+{
+	std::vector<SweepParams> params;
+	params.reserve(cfg.numF * cfg.numK);
+
+	for (int ik = 0; ik < cfg.numK; ik++)
+	{
+		for (int jf = 0; jf < cfg.numF; jf++)
+		{
+			float tf = cfg.numF > 1 ? jf / float(cfg.numF - 1) : 0.0f;
+			float tk = cfg.numK > 1 ? ik / float(cfg.numK - 1) : 0.0f;
+
+			SweepParams p;
+			p.f = cfg.fMin + tf * (cfg.fMax - cfg.fMin);
+			p.k = cfg.kMin + tk * (cfg.kMax - cfg.kMin);
+			p.DA = cfg.DA;
+			p.DB = cfg.DB;
+			params.push_back(p);
+		}
+	}
+
+	return params;
+}
+
+bool runSweep(const SweepConfig& cfg, const std::vector<SweepParams>& params)
+{
+	const int numInstances = (int)params.size();
+	const size_t layer = size_t(cfg.width) * cfg.height;
+	const size_t total = layer * numInstances;
+
+	if (numInstances == 0)
+	{
+		fmt::println("Sweep has no instances");
+		return false;
+	}
+
+	// Every field of every instance lives in one SSBO, so it has to fit in a single block
+	GLint64 maxBlockSize = 0;
+	glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maxBlockSize);
+	if (GLint64(total * sizeof(float)) > maxBlockSize)
+	{
+		fmt::println("Sweep needs {} bytes per field but GL_MAX_SHADER_STORAGE_BLOCK_SIZE is {}, reduce the instance count or grid size",
+			total * sizeof(float), maxBlockSize);
+		return false;
+	}
+
+	GLint maxGroupsZ = 0;
+	glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 2, &maxGroupsZ);
+	if (numInstances > maxGroupsZ)
+	{
+		fmt::println("Sweep has {} instances but only {} work groups are allowed in z", numInstances, maxGroupsZ);
+		return false;
+	}
+
+	ShaderProgram sweepShader;
+	if (!sweepShader.loadComputeShader("shader/gray-scott-sweep.cs"))
+		return false;
+
+	// All instances start from the same seed so only the parameters differ
+	std::vector<float> seedB(layer);
+	for (size_t i = 0; i < layer; i++)
+		seedB[i] = (rand() / float(RAND_MAX) < 0.0021) ? 1.0f : 0.0f;
+
+	std::vector<float> hostA(total, 1.0f);
+	std::vector<float> hostB(total);
+	for (int n = 0; n < numInstances; n++)
+		std::copy(seedB.begin(), seedB.end(), hostB.begin() + n * layer);
+
+	// Buffer object IDs
+	GpuBuffer A1, A2, B1, B2, P;
+
+	A1.create("sweep", sizeof(float) * total, hostA.data(), GL_STATIC_DRAW);
+	A2.create("sweep", sizeof(float) * total, hostA.data(), GL_STATIC_DRAW);
+	B1.create("sweep", sizeof(float) * total, hostB.data(), GL_STATIC_DRAW);
+	B2.create("sweep", sizeof(float) * total, NULL, GL_STATIC_DRAW);
+	P.create("sweep", sizeof(SweepParams) * numInstances, params.data(), GL_STATIC_DRAW);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, P);
+	GpuMemory::report();
+
+	fmt::println("Sweep: {} instances of {}x{} for {} steps", numInstances, cfg.width, cfg.height, cfg.steps);
+
+	sweepShader.use();
+	sweepShader.setUniform("W", cfg.width);
+	sweepShader.setUniform("H", cfg.height);
+
+	const GLuint groupsX = (cfg.width + 15) / 16;
+	const GLuint groupsY = (cfg.height + 15) / 16;
+
+	double start = glfwGetTime();
+
+	// Each dispatch advances every instance by one step
+	FrameStats stats("Sweep");
+
+	int c = 1;
+	for (int step = 0; step < cfg.steps; step++)
+	{
+		stats.beginFrame();
+
+		c = 1 - c;
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0 + c, A1);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0 + 1 - c, A2);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2 + c, B1);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2 + 1 - c, B2);
+
+		glDispatchCompute(groupsX, groupsY, numInstances);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		stats.endFrame(1);
+
+		if ((step + 1) % 1000 == 0)
+		{
+			glFinish();
+			fmt::println("Sweep: step {}/{}", step + 1, cfg.steps);
+		}
+	}
+
+	glFinish();
+	double seconds = glfwGetTime() - start;
+	fmt::println("Sweep: {:.2f} s, {:.1f} Mcell updates/s", seconds, double(total) * cfg.steps / seconds * 1e-6);
+
+	glUseProgram(0);
+
+	// The last step wrote to whatever is bound at 1 and 3
+	GLuint lastA = (c == 0) ? A2 : A1;
+	GLuint lastB = (c == 0) ? B2 : B1;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, lastA);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float) * total, hostA.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, lastB);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float) * total, hostB.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	A1.destroy();
+	A2.destroy();
+	B1.destroy();
+	B2.destroy();
+	P.destroy();
+
+	sweepShader.destroy();
+
+	// Snapshots and an index of which parameters produced them
+	std::error_code ec;
+	std::filesystem::create_directories(cfg.outputDir, ec);
+
+	std::string indexName = cfg.outputDir + "/params.csv";
+	FILE* index = std::fopen(indexName.c_str(), "w");
+	if (index == NULL)
+	{
+		fmt::println("Unable to write {}", indexName);
+		return false;
+	}
+	std::fprintf(index, "instance,f,k,DA,DB,file\n");
+
+	bool ok = true;
+	for (int n = 0; n < numInstances; n++)
+	{
+		std::string name = fmt::format("instance_{:04d}.ppm", n);
+		ok &= writeSnapshot(cfg.outputDir + "/" + name, &hostA[n * layer], &hostB[n * layer], cfg.width, cfg.height);
+		std::fprintf(index, "%d,%f,%f,%f,%f,%s\n", n, params[n].f, params[n].k, params[n].DA, params[n].DB, name.c_str());
+	}
+
+	std::fclose(index);
+
+	fmt::println("Sweep: wrote {} snapshots to {}", numInstances, cfg.outputDir);
+	return ok;
+}
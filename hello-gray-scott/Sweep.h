@@ -0,0 +1,42 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <string>
+#include <vector>
+
+// Parameters of one Gray Scott instance (must match struct Params in shader/gray-scott-sweep.cs)
+struct SweepParams
+{
+	float f;
+	float k;
+	float DA;
+	float DB;
+};
+
+struct SweepConfig
+{
+	// Grid of a single instance
+	int width = 256;
+	int height = 256;
+
+	int steps = 10000;
+
+	// The (f, k) plane is sampled on a numF x numK grid
+	int numF = 16;
+	int numK = 16;
+	float fMin = 0.010f, fMax = 0.060f;
+	float kMin = 0.045f, kMax = 0.070f;
+	float DA = 1.0f;
+	float DB = 0.4f;
+
+	std::string outputDir = "sweep";
+};
+
+// Builds the numF x numK (f, k) grid with the diffusion constants from the config
+std::vector<SweepParams> makeSweepGrid(const SweepConfig& cfg);
+
+// Runs every instance as one layer of a single 3D dispatch and writes a snapshot
+// per instance plus params.csv into cfg.outputDir. Needs a current GL 4.3+ context.
+bool runSweep(const SweepConfig& cfg, const std::vector<SweepParams>& params);
+
+#endif // SWEEP_H
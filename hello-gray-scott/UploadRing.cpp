@@ -0,0 +1,152 @@
+#include "UploadRing.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <fmt/core.h>
+
+// Pieces start on this boundary, which suits any copy
+static const size_t ALIGNMENT = 256;
+
+UploadRing::UploadRing()
+	: mMapped(NULL), mSize(0), mHead(0), mOffset(0), mBytes(0), mWaits(0)
+{
+}
+
+bool UploadRing::init(size_t bytes)
+{
+	mSize = (std::max(bytes, ALIGNMENT) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+	mHead = mOffset = mBytes = 0;
+
+	if (!GLAD_GL_VERSION_4_4)
+	{
+		mHost.resize(mSize);
+		return true;
+	}
+
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	mBuffer.createStorage("upload", mSize, NULL, flags);
+	glBindBuffer(GL_COPY_READ_BUFFER, mBuffer);
+	mMapped = (char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, mSize, flags);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	if (mMapped == NULL)
+	{
+		fmt::println("UploadRing: unable to map {} bytes", mSize);
+		destroy();
+		return false;
+	}
+	return true;
+}
+
+void UploadRing::destroy()
+{
+	for (const Piece& piece : mPending)
+		glDeleteSync(piece.fence);
+	mPending.clear();
+
+	if (mMapped != NULL)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, mBuffer);
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+	mBuffer.destroy();
+	mMapped = NULL;
+	mHost.clear();
+	mSize = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Forgets the copies that are done, or waits for all of them
+//-----------------------------------------------------------------------------
+void UploadRing::retire(bool all)
+{
+	while (!mPending.empty())
+	{
+		GLsync fence = mPending.front().fence;
+		GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, all ? GL_TIMEOUT_IGNORED : 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			return;
+
+		glDeleteSync(fence);
+		mPending.pop_front();
+	}
+}
+
+void* UploadRing::map(size_t bytes)
+{
+	size_t size = (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+	if (mMapped != NULL && size > mSize)
+	{
+		// Rare and only at start up, the old buffer may still be read
+		retire(true);
+		fmt::println("UploadRing: growing from {} to {} bytes", mSize, size);
+		destroy();
+		// Failing leaves mMapped NULL, the host memory below takes over
+		init(size);
+	}
+
+	if (mMapped == NULL)
+	{
+		mBytes = bytes;
+		if (mHost.size() < bytes)
+			mHost.resize(bytes);
+		mOffset = 0;
+		return mHost.data();
+	}
+
+	if (mHead + size > mSize)
+		mHead = 0;
+
+	// Fences signal in order, waiting for the newest overlapping copy covers the older ones
+	retire(false);
+	for (size_t i = mPending.size(); i-- > 0;)
+	{
+		const Piece& piece = mPending[i];
+		if (piece.begin < mHead + size && mHead < piece.end)
+		{
+			glClientWaitSync(piece.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			for (size_t j = 0; j <= i; j++)
+				glDeleteSync(mPending[j].fence);
+			mPending.erase(mPending.begin(), mPending.begin() + i + 1);
+			mWaits++;
+			break;
+		}
+	}
+
+	mOffset = mHead;
+	mBytes = bytes;
+	mHead += size;
+	return mMapped + mOffset;
+}
+
+void UploadRing::copy(GLuint dst, size_t dstOffset)
+{
+	// Shader writes to dst are incoherent, they have to land before the copy does
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	if (mMapped == NULL)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, dstOffset, mBytes, mHost.data());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return;
+	}
+
+	// Coherent, the writes are visible to the copy without a flush
+	glBindBuffer(GL_COPY_READ_BUFFER, mBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, mOffset, dstOffset, mBytes);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	Piece piece = { mOffset, mHead, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) };
+	mPending.push_back(piece);
+}
+
+void UploadRing::upload(GLuint dst, size_t dstOffset, const void* data, size_t bytes)
+{
+	std::memcpy(map(bytes), data, bytes);
+	copy(dst, dstOffset);
+}
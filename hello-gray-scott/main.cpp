@@ -7,7 +7,15 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include "Diagnostics.h"
+#include "FrameStats.h"
+#include "GpuMemory.h"
 #include "ShaderProgram.h"
+#include "SimThread.h"
+#include "SpectralGrayScott.h"
+#include "StreamingGrayScott.h"
+#include "Sweep.h"
+#include "UploadRing.h"
 
 // Set to true to use test data for the texture
 bool USE_TEST_DATA = false;
@@ -15,6 +23,36 @@ bool USE_TEST_DATA = false;
 // Set to true to enable fullscreen
 bool FULLSCREEN = false;
 
+// Set to true to run a headless (f, k) parameter sweep instead of the demo (see Sweep.h)
+bool BATCH_SWEEP = false;
+
+// Set to true to integrate on the CPU with the spectral ETD scheme (see SpectralGrayScott.h)
+// instead of the explicit step in gray-scott.cs, which is limited to dt = 1
+bool USE_ETD = false;
+float ETD_DT = 20.0f;
+
+// Set to true to step a grid larger than memory through files on disk instead of the demo
+// (see StreamingGrayScott.h); runs without a GPU
+bool OUT_OF_CORE = false;
+
+// Set to true to step on a thread of its own and draw the newest finished image (see SimThread.h),
+// SIM_STEPS steps per batch and at most SIM_RATE batches per second, 0 is as fast as it goes
+bool SIM_THREAD = false;
+int SIM_STEPS = 10;
+double SIM_RATE = 0.0;
+
+// Frame time percentiles and steps/s are printed every STATS_INTERVAL seconds,
+// or written as CSV to STATS_FILE when it is set
+const char* STATS_FILE = NULL;
+double STATS_INTERVAL = 1.0;
+
+// Total A and B are reduced on the GPU and printed every DIAG_INTERVAL steps, 0 turns them off
+int DIAG_INTERVAL = 1000;
+
+// Live GPU memory per subsystem is printed after start up, on G and on exit. With GPU_BUDGET_MB > 0
+// an allocation that would take the total over it is warned about before it is made.
+double GPU_BUDGET_MB = 0.0;
+
 // Gray Scott Reaction Diffusion Frid
 const int WIDTH = 1280, HEIGHT = 720;
 
@@ -34,7 +72,6 @@ bool gWireframe = false;
 // Function prototypes
 void glfw_onKey(GLFWwindow* window, int key, int scancode, int action, int mode);
 void glfw_onFramebufferSize(GLFWwindow* window, int width, int height);
-void showFPS(GLFWwindow* window);
 bool initOpenGL();
 
 // Read a compute shader to string
@@ -51,7 +88,22 @@ GLuint testData[WIDTH * HEIGHT * 4];
 
 int main(int argc, char **argv)
 {
-	initOpenGL();
+	GpuMemory::setBudget(size_t(GPU_BUDGET_MB * 1024 * 1024));
+
+	if (OUT_OF_CORE)
+		return runStreamingGrayScott(StreamingGrayScottRun()) ? 0 : -1;
+
+	if (!initOpenGL())
+		return -1;
+
+	if (BATCH_SWEEP)
+	{
+		SweepConfig cfg;
+		bool ok = runSweep(cfg, makeSweepGrid(cfg));
+
+		glfwTerminate();
+		return ok ? 0 : -1;
+	}
 
 	// Load the compute shader
 	std::string csString = fileToString("shader/gray-scott.cs");
@@ -111,12 +163,8 @@ int main(int argc, char **argv)
 	glBindVertexArray(0);
 
 	// Create a texture to write to
-	GLuint tex_output;
-
-	glGenTextures(1, &tex_output);
-	glBindTexture(GL_TEXTURE_2D, tex_output);
-
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, WIDTH, HEIGHT, 0, GL_RGBA, GL_UNSIGNED_INT, NULL);
+	GpuTexture tex_output;
+	tex_output.create2D("image", GL_RGBA8, WIDTH, HEIGHT);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -204,42 +252,72 @@ int main(int argc, char **argv)
 	}
 
 	// Buffer object IDs
-	GLuint A1, B1, A2, B2;
-
-	// Generate buffer objects
-    glGenBuffers(1, &A1);
-    glGenBuffers(1, &B1);
-    glGenBuffers(1, &A2);
-    glGenBuffers(1, &B2);
-
-	// Bind the buffer to a specific binding point
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, A1);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * gWindowWidth * gWindowHeight, A1cpu, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, A2);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * gWindowWidth * gWindowHeight, A2cpu, GL_STATIC_DRAW);
+	GpuBuffer A1, B1, A2, B2;
 
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, B1);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * gWindowWidth * gWindowHeight, B1cpu, GL_STATIC_DRAW);
-
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, B2);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * gWindowWidth * gWindowHeight, B2cpu, GL_STATIC_DRAW);
+	// Create and fill the buffer objects
+	A1.create("state", sizeof(float) * gWindowWidth * gWindowHeight, A1cpu, GL_STATIC_DRAW);
+	A2.create("state", sizeof(float) * gWindowWidth * gWindowHeight, A2cpu, GL_STATIC_DRAW);
+	B1.create("state", sizeof(float) * gWindowWidth * gWindowHeight, B1cpu, GL_STATIC_DRAW);
+	B2.create("state", sizeof(float) * gWindowWidth * gWindowHeight, B2cpu, GL_STATIC_DRAW);
 
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, A1);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, A2);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, B1);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, B2);
 
-    // Unbind the buffer (optional)
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	// Same constants and f, k gradient as gray-scott.cs
+	SpectralGrayScott* etd = NULL;
+	UploadRing uploads;		// the ETD state, two grids per step
+	if (USE_ETD)
+	{
+		std::vector<float> f(WIDTH), k(WIDTH);
+		for (int i = 0; i < WIDTH; i++)
+		{
+			float h = 0.5f * i / float(WIDTH);
+			f[i] = 0.02f * h + (1 - h) * 0.018f;
+			k[i] = 0.035f * h + (1 - h) * 0.051f;
+		}
 
+		etd = new SpectralGrayScott(WIDTH, HEIGHT, 1.0f, 0.4f, ETD_DT);
+		etd->setReaction(f, k);
+		etd->setState(A1cpu, B1cpu);
+		uploads.init(2 * sizeof(float) * WIDTH * HEIGHT);
+	}
+
+	Diagnostics diagnostics(WIDTH, HEIGHT, DIAG_INTERVAL);
+	if (DIAG_INTERVAL > 0)
+		diagnostics.init();
+
+	FrameStats stats("Gray Scott", STATS_INTERVAL);
+	stats.setWindow(gWindow);
+	stats.setOutput(STATS_FILE);
+
+	// One step that writes its colors to `target`; every binding is set here as the
+	// simulation thread has a context of its own
 	int c = 1;
-	while (glfwWindowShouldClose(gWindow) == 0) {
-		// Vsync - comment this out if you want to disable vertical sync
-		//glfwSwapInterval(0);
+	auto step = [&](GLuint target)
+	{
+		if (USE_ETD)
+		{
+			// The state is stepped on the CPU, the shader only colors it
+			etd->step();
+
+			uploads.upload(A1, 0, etd->A(), sizeof(float) * WIDTH * HEIGHT);
+			uploads.upload(B1, 0, etd->B(), sizeof(float) * WIDTH * HEIGHT);
 
-		showFPS(gWindow);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, A1);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, B1);
 
+			glUseProgram(compute_program);
+
+			glUniform1i(glGetUniformLocation(compute_program, "W"), WIDTH);
+			glUniform1i(glGetUniformLocation(compute_program, "H"), HEIGHT);
+			glUniform1i(glGetUniformLocation(compute_program, "colorOnly"), 1);
+
+			glBindImageTexture(4, target, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+			glDispatchCompute(WIDTH / 20, HEIGHT / 20, 1);
+		}
+		else
 		{
 			c = 1 - c;
 			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0 + c, A1);
@@ -253,13 +331,56 @@ int main(int argc, char **argv)
 			glUniform1i(glGetUniformLocation(compute_program, "W"), WIDTH);
 			glUniform1i(glGetUniformLocation(compute_program, "H"), HEIGHT);
 
-			glBindImageTexture(4, tex_output, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+			glBindImageTexture(4, target, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
 			glDispatchCompute(WIDTH / 20, HEIGHT / 20, 1);
 		}
 		
 		// make sure writing to image has finished before read
 		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 
+		// The step wrote to whatever is bound at 1 and 3, ETD uploads into A1/B1
+		if (USE_ETD)
+			diagnostics.update(A1, B1, 1);
+		else
+			diagnostics.update(c == 1 ? A1 : A2, c == 1 ? B1 : B2, 1);
+	};
+
+	// The simulation thread colors one of these per batch, the newest finished one is drawn
+	SimThread simThread;
+	GpuTexture tex_snapshot[SimThread::NUM_SLOTS];
+	if (SIM_THREAD)
+	{
+		for (int i = 0; i < SimThread::NUM_SLOTS; i++)
+		{
+			tex_snapshot[i].create2D("snapshots", GL_RGBA8, WIDTH, HEIGHT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		simThread.start(gWindow, [&](int slot)
+		{
+			for (int i = 0; i < SIM_STEPS; i++)
+				step(tex_snapshot[slot]);
+			return SIM_STEPS;
+		}, SIM_RATE);
+	}
+	GpuMemory::report();
+
+	while (glfwWindowShouldClose(gWindow) == 0) {
+		// Vsync - comment this out if you want to disable vertical sync
+		//glfwSwapInterval(0);
+
+		stats.beginFrame();
+
+		GLuint shown = tex_output;
+		if (simThread.isRunning())
+			shown = tex_snapshot[simThread.acquire()];
+		else
+			step(tex_output);
+
 		{ 
 			// normal drawing pass
 			glClear(GL_COLOR_BUFFER_BIT);
@@ -270,7 +391,7 @@ int main(int argc, char **argv)
 			if (USE_TEST_DATA)
 				glBindTexture(GL_TEXTURE_2D, test_texture);
 			else
-				glBindTexture(GL_TEXTURE_2D, tex_output);
+				glBindTexture(GL_TEXTURE_2D, shown);
 
 			glUniform1i(glGetUniformLocation(shader.getProgram(), "screenTexture"), 0);
 
@@ -280,19 +401,35 @@ int main(int argc, char **argv)
 			glBindVertexArray(0);
 		}
 
+		if (simThread.isRunning())
+			simThread.release();
+
 		glfwSwapBuffers(gWindow);
 		glfwPollEvents();
+
+		stats.endFrame(simThread.isRunning() ? simThread.takeSteps() : 1);
 	}
 
+	// Before anything it uses goes away
+	simThread.stop();
+	GpuMemory::report("GPU memory on exit");
+	for (int i = 0; i < SimThread::NUM_SLOTS; i++)
+		tex_snapshot[i].destroy();
+
 	// Clean up
+	delete etd;
+	uploads.destroy();
+	diagnostics.destroy();
+
 	glDeleteBuffers(1, &VBO);
 	glDeleteBuffers(1, &IBO);
 	glDeleteVertexArrays(1, &VAO);
 
-	glDeleteBuffers(1, &A1);
-	glDeleteBuffers(1, &A2);
-	glDeleteBuffers(1, &B1);
-	glDeleteBuffers(1, &B2);
+	A1.destroy();
+	A2.destroy();
+	B1.destroy();
+	B2.destroy();
+	tex_output.destroy();
 
 	shader.destroy();
 
@@ -328,6 +465,7 @@ std::string fileToString(const std::string& filename)
 
 // Press ESC to close the window
 // Press 1 to toggle wireframe mode
+// Press G to print the GPU memory per subsystem
 void glfw_onKey(GLFWwindow* window, int key, int scancode, int action, int mode)
 {
 	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
@@ -341,6 +479,9 @@ void glfw_onKey(GLFWwindow* window, int key, int scancode, int action, int mode)
 		else
 			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 	}
+
+	if (key == GLFW_KEY_G && action == GLFW_PRESS)
+		GpuMemory::report();
 }
 
 // Is called when the window is resized
@@ -363,6 +504,10 @@ bool initOpenGL()
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);	// forward compatible with newer versions of OpenGL as they become available but not backward compatible (it will not run on devices that do not support OpenGL 3.3
 
+	// The sweep only needs a context, keep its window hidden
+	if (BATCH_SWEEP)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
 	// Create a window
 	if (FULLSCREEN)
 	{
@@ -399,26 +544,3 @@ bool initOpenGL()
 
 	return true;
 }
-
-void showFPS(GLFWwindow* window) {
-	static double previousSeconds = 0.0;
-	static int frameCount = 0;
-	double elapsedSeconds;
-	double currentSeconds = glfwGetTime();
-
-	elapsedSeconds = currentSeconds - previousSeconds;
-
-	if (elapsedSeconds > 0.25) {
-		previousSeconds = currentSeconds;
-		double fps = (double)frameCount / elapsedSeconds;
-		double msPerFrame = 1000.0 / fps;
-
-		char title[80];
-		std::snprintf(title, sizeof(title), "Gray Scott @ fps: %.2f, ms/frame: %.2f", fps, msPerFrame);
-		glfwSetWindowTitle(window, title);
-
-		frameCount = 0;
-	}
-
-	frameCount++;
-}
@@ -0,0 +1,100 @@
+#version 440
+#extension GL_KHR_shader_subgroup_arithmetic : enable
+
+// Totals of the Gray Scott fields, see Diagnostics.h
+
+#define Q_SUM_A   0
+#define Q_SUM_B   1
+#define Q_MAX_B   2
+#define Q_NAN     3     // cells where A or B is NaN/Inf
+#define NUM_Q     4
+
+#define GROUP_SIZE 256
+
+layout(binding = 0) buffer dcA { float A [  ]; };
+layout(binding = 2) buffer dcB { float B [  ]; };
+layout(binding = 6) buffer dcPartial { float partial [  ]; };   // NUM_Q per work group of pass 0
+layout(binding = 7) buffer dcResult { float result [ NUM_Q ]; };
+
+uniform int N;          // cells
+uniform int pass;       // 0: fields -> partial, 1: partial -> result
+uniform int numPartials;
+
+layout(local_size_x = GROUP_SIZE) in;
+
+shared float sdata[NUM_Q][GROUP_SIZE];
+
+float combine(int q, float a, float b)
+{
+    return q == Q_MAX_B ? max(a, b) : a + b;
+}
+
+void main()
+{
+    uint lid = gl_LocalInvocationID.x;
+    float acc[NUM_Q] = { 0.0, 0.0, 0.0, 0.0 };
+
+    if (pass == 0)
+    {
+        for (uint idx = gl_GlobalInvocationID.x; idx < uint(N); idx += gl_NumWorkGroups.x * GROUP_SIZE)
+        {
+            float a = A[idx];
+            float b = B[idx];
+
+            if (isnan(a) || isinf(a) || isnan(b) || isinf(b))
+            {
+                acc[Q_NAN] += 1.0;
+                continue;
+            }
+
+            acc[Q_SUM_A] += a;
+            acc[Q_SUM_B] += b;
+            acc[Q_MAX_B] = max(acc[Q_MAX_B], b);
+        }
+    }
+    else
+    {
+        for (uint i = lid; i < uint(numPartials); i += GROUP_SIZE)
+            for (int q = 0; q < NUM_Q; q++)
+                acc[q] = combine(q, acc[q], partial[i * NUM_Q + q]);
+    }
+
+#ifdef GL_KHR_shader_subgroup_arithmetic
+    // Reduce within each subgroup first, then one value per subgroup goes through shared memory
+    for (int q = 0; q < NUM_Q; q++)
+        acc[q] = (q == Q_MAX_B) ? subgroupMax(acc[q]) : subgroupAdd(acc[q]);
+
+    if (subgroupElect())
+        for (int q = 0; q < NUM_Q; q++)
+            sdata[q][gl_SubgroupID] = acc[q];
+    barrier();
+
+    uint count = gl_NumSubgroups;
+#else
+    for (int q = 0; q < NUM_Q; q++)
+        sdata[q][lid] = acc[q];
+    barrier();
+
+    uint count = GROUP_SIZE;
+#endif
+
+    // Shared memory tree, count is a power of two
+    for (uint stride = count / 2; stride > 0; stride /= 2)
+    {
+        if (lid < stride)
+            for (int q = 0; q < NUM_Q; q++)
+                sdata[q][lid] = combine(q, sdata[q][lid], sdata[q][lid + stride]);
+        barrier();
+    }
+
+    if (lid == 0)
+    {
+        for (int q = 0; q < NUM_Q; q++)
+        {
+            if (pass == 0)
+                partial[gl_WorkGroupID.x * NUM_Q + q] = sdata[q][0];
+            else
+                result[q] = sdata[q][0];
+        }
+    }
+}
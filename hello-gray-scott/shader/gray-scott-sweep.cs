@@ -0,0 +1,73 @@
+#version 440
+
+// Batched Gray Scott: every z layer is an independent W x H simulation
+// with its own (f, k, DA, DB) taken from the params buffer.
+
+struct Params
+{
+    float f;
+    float k;
+    float DA;
+    float DB;
+};
+
+layout(binding = 0) buffer dcA1 { float A1 [  ]; };
+layout(binding = 1) buffer dcA2 { float A2 [  ]; };
+layout(binding = 2) buffer dcB1 { float B1 [  ]; };
+layout(binding = 3) buffer dcB2 { float B2 [  ]; };
+layout(binding = 5) readonly buffer dcP { Params P [  ]; };
+
+layout(local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+
+uniform int W;
+uniform int H;
+
+int per(int x, int nx)
+{
+    if (x < 0) x += nx;
+    if (x >= nx) x -= nx;
+    return x;
+}
+
+void main()
+{
+    int i = int(gl_GlobalInvocationID.x);
+    int j = int(gl_GlobalInvocationID.y);
+    int n = int(gl_GlobalInvocationID.z);   // instance
+
+    if (i >= W || j >= H)
+        return;
+
+    int base = n * W * H;                   // start of this instance's layer
+
+    float DA = P[n].DA;
+    float DB = P[n].DB;
+    float f = P[n].f;
+    float k = P[n].k;
+
+    float dt = 1.0;
+    int idx0, idx1, idx2, idx3, idx4, idx5, idx6, idx7, idx8;
+    int ip, jp, im, jm;
+
+    ip = per(i + 1, W);        // periodicity and neighbours (within the layer)
+    im = per(i - 1, W);
+    jp = per(j + 1, H);
+    jm = per(j - 1, H);
+    idx0 = base + i + W * j;
+    idx1 = base + ip + W * (jp);
+    idx2 = base + ip + W * (j);
+    idx3 = base + ip + W * (jm);
+    idx4 = base + i + W * (jm);
+    idx5 = base + im + W * (jm);
+    idx6 = base + im + W * (j);
+    idx7 = base + im + W * (jp);
+    idx8 = base + i + W * (jp);
+
+    // laplacians
+    float laplA = -1.0 * A1[idx0] + .2 * (A1[idx6] + A1[idx2] + A1[idx4] + A1[idx8]) + 0.05 * (A1[idx1] + A1[idx3] + A1[idx5] + A1[idx7]);
+    float laplB = -1.0 * B1[idx0] + .2 * (B1[idx6] + B1[idx2] + B1[idx4] + B1[idx8]) + 0.05 * (B1[idx1] + B1[idx3] + B1[idx5] + B1[idx7]);
+
+    // Gray Scott model
+    A2[idx0] = A1[idx0] + (DA * laplA - A1[idx0] * B1[idx0] * B1[idx0] + f * (1 - A1[idx0])) * dt;
+    B2[idx0] = B1[idx0] + (DB * laplB + A1[idx0] * B1[idx0] * B1[idx0] - (k + f) * B1[idx0]) * dt;
+}
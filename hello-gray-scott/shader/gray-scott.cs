@@ -11,6 +11,7 @@ layout(local_size_x = 20, local_size_y = 20, local_size_z = 1) in;
 
 uniform int W;
 uniform int H;
+uniform bool colorOnly;     // state was integrated elsewhere (CPU ETD), only visualize A1/B1
 
 int per(int x, int nx)
 {
@@ -42,6 +43,12 @@ void main()
 
     int idx = i + j * W;    // grid index
 
+    if (colorOnly)
+    {
+        imageStore(img, ivec2(gl_GlobalInvocationID.xy), color(1.51 * A1[idx] + 1.062 * B1[idx]));
+        return;
+    }
+
     float DA = 1.0;    // constants
     float DB = 0.4;
     float f = 0.04;
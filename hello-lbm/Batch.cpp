@@ -0,0 +1,597 @@
+#include "Batch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <fmt/core.h>
+
+#include "Forces.h"
+#include "Geometry.h"
+#include "LbmEngine.h"
+#include "LbmEnsemble.h"
+
+// Same order as LbmEngine::Field
+static const char* FIELD_NAMES[LbmEngine::NUM_FIELDS] = { "velocity_x", "velocity_y", "density", "pressure", "speed", "vorticity", "flags" };
+static const char* COLLISION_KEYS[] = { "bgk", "mrt", "cumulant" };
+static const char* STORAGE_KEYS[NUM_STORAGES] = { "fp32", "fp16", "fp16s", "fp16c" };
+
+static std::string trim(const std::string& s)
+{
+	size_t begin = s.find_first_not_of(" \t\r");
+	if (begin == std::string::npos)
+		return std::string();
+	size_t end = s.find_last_not_of(" \t\r");
+	return s.substr(begin, end - begin + 1);
+}
+
+static bool parseInt(const std::string& value, int& out)
+{
+	char* end;
+	long v = std::strtol(value.c_str(), &end, 10);
+	if (end == value.c_str() || *end != '\0')
+		return false;
+	out = (int)v;
+	return true;
+}
+
+static bool parseFloat(const std::string& value, float& out)
+{
+	char* end;
+	float v = std::strtof(value.c_str(), &end);
+	if (end == value.c_str() || *end != '\0')
+		return false;
+	out = v;
+	return true;
+}
+
+static bool parseBool(const std::string& value, bool& out)
+{
+	if (value == "1" || value == "true" || value == "on" || value == "yes")
+		out = true;
+	else if (value == "0" || value == "false" || value == "off" || value == "no")
+		out = false;
+	else
+		return false;
+	return true;
+}
+
+static bool parseKeyword(const std::string& value, const char* const* keys, int count, int& out)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (value == keys[i])
+		{
+			out = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Sets one key of a scenario, false for an unknown key or a bad value
+//-----------------------------------------------------------------------------
+static bool setKey(Scenario& s, const std::string& key, const std::string& value)
+{
+	int storage;
+	if (key == "nx") return parseInt(value, s.nx);
+	if (key == "ny") return parseInt(value, s.ny);
+	if (key == "steps") return parseInt(value, s.steps);
+	if (key == "tau") return parseFloat(value, s.tau);
+	if (key == "force_x") return parseFloat(value, s.forceX);
+	if (key == "force_y") return parseFloat(value, s.forceY);
+	if (key == "collision") return parseKeyword(value, COLLISION_KEYS, 3, s.collision);
+	if (key == "smagorinsky") return parseFloat(value, s.smagorinsky);
+	if (key == "bouzidi") return parseBool(value, s.bouzidi);
+	if (key == "sparse_tiles") return parseBool(value, s.sparseTiles);
+	if (key == "obstacle") { s.obstacle = value; return !value.empty(); }
+	if (key == "obstacle_x") return parseFloat(value, s.obstacleX);
+	if (key == "obstacle_y") return parseFloat(value, s.obstacleY);
+	if (key == "obstacle_r") return parseFloat(value, s.obstacleR);
+	if (key == "sample_interval") return parseInt(value, s.sampleInterval);
+
+	if (key == "storage")
+	{
+		if (!parseKeyword(value, STORAGE_KEYS, NUM_STORAGES, storage))
+			return false;
+		s.storage = (Storage)storage;
+		return true;
+	}
+
+	if (key == "outputs")
+	{
+		s.outputs.clear();
+		size_t pos = 0;
+		while (pos < value.size())
+		{
+			size_t end = value.find_first_of(" \t,", pos);
+			std::string name = value.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+			pos = end == std::string::npos ? value.size() : end + 1;
+			if (name.empty())
+				continue;
+
+			int field;
+			if (!parseKeyword(name, FIELD_NAMES, LbmEngine::NUM_FIELDS, field))
+				return false;
+			s.outputs.push_back(name);
+		}
+		return true;
+	}
+
+	return false;
+}
+
+bool loadScenarios(const char* filename, std::vector<Scenario>& scenarios)
+{
+	std::ifstream file(filename);
+	if (!file)
+	{
+		fmt::println("Unable to open {}", filename);
+		return false;
+	}
+
+	Scenario defaults;
+	Scenario* current = &defaults;
+	scenarios.clear();
+
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+
+		size_t comment = line.find('#');
+		if (comment != std::string::npos)
+			line.erase(comment);
+		line = trim(line);
+		if (line.empty())
+			continue;
+
+		if (line.front() == '[' && line.back() == ']')
+		{
+			scenarios.push_back(defaults);
+			scenarios.back().name = trim(line.substr(1, line.size() - 2));
+			current = &scenarios.back();
+			if (current->name.empty())
+			{
+				fmt::println("{}:{}: scenario without a name", filename, lineNumber);
+				return false;
+			}
+			continue;
+		}
+
+		size_t eq = line.find('=');
+		if (eq == std::string::npos)
+		{
+			fmt::println("{}:{}: expected key = value", filename, lineNumber);
+			return false;
+		}
+
+		std::string key = trim(line.substr(0, eq));
+		std::string value = trim(line.substr(eq + 1));
+		if (!setKey(*current, key, value))
+		{
+			fmt::println("{}:{}: bad {} '{}'", filename, lineNumber, key, value);
+			return false;
+		}
+	}
+
+	if (scenarios.empty())
+		fmt::println("{} has no scenarios", filename);
+	return !scenarios.empty();
+}
+
+//-----------------------------------------------------------------------------
+// Writes a (rows, cols) view as a contiguous .npy array
+//-----------------------------------------------------------------------------
+static bool writeNpy(const std::string& filename, const LbmEngine::FieldView& view)
+{
+	FILE* fp = std::fopen(filename.c_str(), "wb");
+	if (fp == NULL)
+	{
+		fmt::println("Unable to write {}", filename);
+		return false;
+	}
+
+	// The header is padded so that the data starts on a multiple of 64 bytes
+	std::string header = fmt::format("{{'descr': '{}', 'fortran_order': False, 'shape': ({}, {}), }}",
+		view.isInt ? "<i4" : "<f4", view.rows, view.cols);
+	header.append(63 - (10 + header.size()) % 64, ' ');
+	header += '\n';
+
+	unsigned short headerLen = (unsigned short)header.size();
+	std::fwrite("\x93NUMPY\x01\x00", 1, 8, fp);
+	std::fwrite(&headerLen, sizeof(headerLen), 1, fp);
+	std::fwrite(header.data(), 1, header.size(), fp);
+
+	std::vector<char> row(view.cols * 4);
+	for (size_t y = 0; y < view.rows; y++)
+	{
+		const char* src = (const char*)view.data + y * view.rowStride;
+		for (size_t x = 0; x < view.cols; x++)
+			std::memcpy(&row[x * 4], src + x * view.colStride, 4);
+		std::fwrite(row.data(), 1, row.size(), fp);
+	}
+
+	std::fclose(fp);
+	return true;
+}
+
+static float element(const LbmEngine::FieldView& view, size_t idx)
+{
+	size_t x = idx % view.cols, y = idx / view.cols;
+	return *(const float*)((const char*)view.data + y * view.rowStride + x * view.colStride);
+}
+
+struct Sample
+{
+	double meanU = 0.0;
+	double maxSpeed = 0.0;
+	double meanRho = 0.0;
+	long long nanCells = 0;
+};
+
+//-----------------------------------------------------------------------------
+// Fluid averages of the newest state
+//-----------------------------------------------------------------------------
+static Sample sample(const LbmEngine::FieldView& u, const LbmEngine::FieldView& speed, const LbmEngine::FieldView& rho,
+	const std::vector<int>& fluid)
+{
+	Sample s;
+	size_t cells = fluid.size(), count = 0;
+
+	for (size_t idx = 0; idx < cells; idx++)
+	{
+		if (!fluid[idx])
+			continue;
+
+		float ui = element(u, idx), si = element(speed, idx), ri = element(rho, idx);
+		if (!std::isfinite(ui) || !std::isfinite(si) || !std::isfinite(ri))
+		{
+			s.nanCells++;
+			continue;
+		}
+
+		s.meanU += ui;
+		s.meanRho += ri;
+		s.maxSpeed = std::max(s.maxSpeed, double(si));
+		count++;
+	}
+
+	if (count > 0)
+	{
+		s.meanU /= count;
+		s.meanRho /= count;
+	}
+	return s;
+}
+
+static Sample sample(LbmEngine& engine, const std::vector<int>& fluid)
+{
+	return sample(engine.field(LbmEngine::VELOCITY_X), engine.field(LbmEngine::SPEED), engine.field(LbmEngine::DENSITY), fluid);
+}
+
+//-----------------------------------------------------------------------------
+// Signed distances of the obstacle of a scenario, empty for none
+//-----------------------------------------------------------------------------
+static bool rasterize(const Scenario& sc, Geometry& geometry, std::vector<float>& sdf)
+{
+	sdf.clear();
+	if (sc.obstacle == "none")
+		return true;
+
+	if (sc.obstacle == "circle")
+		geometry.setCircle();
+	else if (!geometry.load(sc.obstacle.c_str()))
+		return false;
+	geometry.rasterize(sc.obstacleX * sc.nx, sc.obstacleY * sc.ny, sc.obstacleR * sc.nx, sc.nx, sc.ny, sdf);
+	return true;
+}
+
+bool runBatch(const std::vector<Scenario>& scenarios, const std::string& outputDir)
+{
+	std::error_code ec;
+	std::filesystem::create_directories(outputDir, ec);
+
+	std::string runsName = outputDir + "/runs.csv";
+	FILE* runs = std::fopen(runsName.c_str(), "w");
+	if (runs == NULL)
+	{
+		fmt::println("Unable to write {}", runsName);
+		return false;
+	}
+	fmt::println(runs, "name,nx,ny,storage,steps,reused,setup_s,run_s,mlups,mean_u,max_speed,mean_rho,nan_cells,residual,cd,cl,status");
+
+	LbmEngine engine;
+	Geometry geometry;
+	bool ok = true;
+
+	for (size_t i = 0; i < scenarios.size(); i++)
+	{
+		const Scenario& sc = scenarios[i];
+		std::string dir = outputDir + "/" + sc.name;
+		std::filesystem::create_directories(dir, ec);
+
+		fmt::println("Batch: {} ({}/{}), {} x {}, {} steps", sc.name, i + 1, scenarios.size(), sc.nx, sc.ny, sc.steps);
+
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+		// Same grid and options as the run before: back to rest on the same buffers
+		bool bouzidi = sc.bouzidi && sc.storage == STORAGE_FP32;
+		bool reused = engine.nx() == sc.nx && engine.ny() == sc.ny && engine.storage() == sc.storage &&
+			engine.bouzidi() == bouzidi && engine.sparse() == sc.sparseTiles;
+		if (reused)
+			engine.reset();
+		else if (!engine.init(sc.nx, sc.ny, sc.storage, sc.bouzidi, sc.sparseTiles))
+		{
+			fmt::println(runs, "{},{},{},{},0,0,0,0,0,0,0,0,0,0,0,0,failed", sc.name, sc.nx, sc.ny, STORAGE_KEYS[sc.storage]);
+			ok = false;
+			continue;
+		}
+
+		engine.setTau(sc.tau);
+		engine.setForce(sc.forceX, sc.forceY);
+		engine.setCollision(sc.collision);
+		engine.setSmagorinsky(sc.smagorinsky);
+
+		std::vector<float> sdf;
+		float radius = sc.obstacleR * sc.nx;
+		if (!rasterize(sc, geometry, sdf))
+		{
+			fmt::println(runs, "{},{},{},{},0,0,0,0,0,0,0,0,0,0,0,0,failed", sc.name, sc.nx, sc.ny, STORAGE_KEYS[sc.storage]);
+			ok = false;
+			continue;
+		}
+		engine.setObstacle(sdf);
+
+		LbmEngine::FieldView flags = engine.field(LbmEngine::FLAGS);
+		std::vector<int> fluid((const int*)flags.data, (const int*)flags.data + size_t(sc.nx) * sc.ny);
+
+		Forces forces(sc.sampleInterval, sc.obstacle != "none" ? 2.0f * radius : 0.0f);
+		forces.init();
+		forces.setOutput((dir + "/forces.csv").c_str());
+		engine.setForces(&forces);
+
+		std::string metricsName = dir + "/metrics.csv";
+		FILE* metrics = std::fopen(metricsName.c_str(), "w");
+		if (metrics != NULL)
+			fmt::println(metrics, "step,mean_u,max_speed,mean_rho,nan_cells");
+
+		glFinish();
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+		Sample last, previous;
+		int interval = sc.sampleInterval > 0 ? sc.sampleInterval : sc.steps;
+		while (engine.steps() < sc.steps)
+		{
+			engine.step((int)std::min<long long>(interval, sc.steps - engine.steps()));
+
+			previous = last;
+			last = sample(engine, fluid);
+			if (metrics != NULL)
+				fmt::println(metrics, "{},{:.6e},{:.6e},{:.6f},{}", engine.steps(), last.meanU, last.maxSpeed, last.meanRho, last.nanCells);
+
+			if (last.nanCells > 0)
+			{
+				fmt::println("Batch: {} went unstable at step {}", sc.name, engine.steps());
+				break;
+			}
+		}
+
+		forces.flush();
+		std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+		engine.setForces(NULL);
+		forces.destroy();
+		if (metrics != NULL)
+			std::fclose(metrics);
+
+		for (const std::string& name : sc.outputs)
+		{
+			for (int f = 0; f < LbmEngine::NUM_FIELDS; f++)
+				if (name == FIELD_NAMES[f])
+					ok &= writeNpy(dir + "/" + name + ".npy", engine.field((LbmEngine::Field)f));
+		}
+
+		double setup = std::chrono::duration<double>(t1 - t0).count();
+		double seconds = std::chrono::duration<double>(t2 - t1).count();
+		double mlups = seconds > 0.0 ? double(sc.nx) * sc.ny * engine.steps() / seconds * 1e-6 : 0.0;
+		// Relative change of the mean velocity over the last sample interval, small once settled
+		double residual = last.meanU != 0.0 ? std::fabs(last.meanU - previous.meanU) / std::fabs(last.meanU) : 0.0;
+		bool stable = last.nanCells == 0;
+		ok &= stable;
+
+		fmt::println(runs, "{},{},{},{},{},{},{:.3f},{:.3f},{:.1f},{:.6e},{:.6e},{:.6f},{},{:.3e},{:.5f},{:.5f},{}",
+			sc.name, sc.nx, sc.ny, STORAGE_KEYS[sc.storage], engine.steps(), reused ? 1 : 0, setup, seconds, mlups,
+			last.meanU, last.maxSpeed, last.meanRho, last.nanCells, residual, forces.drag(), forces.lift(),
+			stable ? "ok" : "unstable");
+		std::fflush(runs);
+
+		fmt::println("Batch: {} done in {:.1f} s ({:.1f} MLUPS), mean u {:.4e}, Cd {:.4f}", sc.name, seconds, mlups, last.meanU, forces.drag());
+	}
+
+	engine.destroy();
+	std::fclose(runs);
+
+	fmt::println("Batch: {} runs written to {}", scenarios.size(), outputDir);
+	return ok;
+}
+
+//-----------------------------------------------------------------------------
+// Scenarios an ensemble can step together: everything but the force, tau and
+// obstacle has to match
+//-----------------------------------------------------------------------------
+static bool sameGroup(const Scenario& a, const Scenario& b)
+{
+	return a.nx == b.nx && a.ny == b.ny && a.steps == b.steps && a.collision == b.collision &&
+		a.smagorinsky == b.smagorinsky && a.storage == b.storage && a.sampleInterval == b.sampleInterval;
+}
+
+bool runEnsemble(const std::vector<Scenario>& scenarios, const std::string& outputDir)
+{
+	std::error_code ec;
+	std::filesystem::create_directories(outputDir, ec);
+
+	std::string summaryName = outputDir + "/ensemble.csv";
+	FILE* summary = std::fopen(summaryName.c_str(), "w");
+	if (summary == NULL)
+	{
+		fmt::println("Unable to write {}", summaryName);
+		return false;
+	}
+	fmt::println(summary, "name,group,members,nx,ny,storage,steps,setup_s,run_s,mlups,mean_u,max_speed,mean_rho,nan_cells,cd,cl,status");
+
+	// Groups in the order their first scenario comes in the file
+	std::vector<std::vector<size_t>> groups;
+	for (size_t i = 0; i < scenarios.size(); i++)
+	{
+		size_t g = 0;
+		while (g < groups.size() && !sameGroup(scenarios[groups[g][0]], scenarios[i]))
+			g++;
+		if (g == groups.size())
+			groups.emplace_back();
+		groups[g].push_back(i);
+	}
+
+	LbmEnsemble ensemble;
+	Geometry geometry;
+	bool ok = true;
+
+	for (size_t g = 0; g < groups.size(); g++)
+	{
+		const std::vector<size_t>& group = groups[g];
+		const Scenario& first = scenarios[group[0]];
+		int members = (int)group.size();
+		size_t cells = size_t(first.nx) * first.ny;
+
+		fmt::println("Ensemble: group {}/{}, {} runs of {} x {}, {} steps", g + 1, groups.size(), members, first.nx, first.ny, first.steps);
+
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+		if (!ensemble.init(first.nx, first.ny, members, first.storage))
+		{
+			for (size_t i : group)
+				fmt::println(summary, "{},{},{},{},{},{},0,0,0,0,0,0,0,0,0,0,failed", scenarios[i].name, g, members,
+					first.nx, first.ny, STORAGE_KEYS[first.storage]);
+			ok = false;
+			continue;
+		}
+		ensemble.setCollision(first.collision);
+		ensemble.setSmagorinsky(first.smagorinsky);
+
+		struct Member
+		{
+			std::vector<int> fluid;
+			float diameter = 0.0f;
+			FILE* metrics = NULL;
+			FILE* forces = NULL;
+			Sample last;
+			Forces::Sample lastForces = Forces::Sample();
+			bool failed = false;
+		};
+		std::vector<Member> state(members);
+
+		for (int m = 0; m < members; m++)
+		{
+			const Scenario& sc = scenarios[group[m]];
+			std::string dir = outputDir + "/" + sc.name;
+			std::filesystem::create_directories(dir, ec);
+
+			if (sc.bouzidi || sc.sparseTiles)
+				fmt::println("Ensemble: {} runs with half-way bounce-back and without sparse tiles", sc.name);
+
+			ensemble.setMember(m, sc.forceX, sc.forceY, sc.tau);
+
+			std::vector<float> sdf;
+			if (!rasterize(sc, geometry, sdf))
+			{
+				// Still stepped with an empty channel, only its results are dropped
+				state[m].failed = true;
+				ok = false;
+			}
+			ensemble.setObstacle(m, sdf);
+			state[m].diameter = sc.obstacle != "none" ? 2.0f * sc.obstacleR * sc.nx : 0.0f;
+
+			LbmEngine::FieldView flags = ensemble.field(LbmEngine::FLAGS, m);
+			state[m].fluid.assign((const int*)flags.data, (const int*)flags.data + cells);
+
+			state[m].metrics = std::fopen((dir + "/metrics.csv").c_str(), "w");
+			if (state[m].metrics != NULL)
+				fmt::println(state[m].metrics, "step,mean_u,max_speed,mean_rho,nan_cells");
+			state[m].forces = std::fopen((dir + "/forces.csv").c_str(), "w");
+			if (state[m].forces != NULL)
+				fmt::println(state[m].forces, "step,fx,fy,fx_walls,fy_walls,u_mean,v_mean,cd,cl");
+		}
+
+		glFinish();
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+		// One member going unstable does not stop the others
+		int interval = first.sampleInterval > 0 ? first.sampleInterval : first.steps;
+		while (ensemble.steps() < first.steps)
+		{
+			ensemble.step((int)std::min<long long>(interval, first.steps - ensemble.steps()));
+
+			for (int m = 0; m < members; m++)
+			{
+				Member& mb = state[m];
+				mb.last = sample(ensemble.field(LbmEngine::VELOCITY_X, m), ensemble.field(LbmEngine::SPEED, m),
+					ensemble.field(LbmEngine::DENSITY, m), mb.fluid);
+				mb.lastForces = ensemble.forces(m, mb.diameter);
+
+				const Sample& s = mb.last;
+				const Forces::Sample& f = mb.lastForces;
+				if (mb.metrics != NULL)
+					fmt::println(mb.metrics, "{},{:.6e},{:.6e},{:.6f},{}", ensemble.steps(), s.meanU, s.maxSpeed, s.meanRho, s.nanCells);
+				if (mb.forces != NULL)
+					fmt::println(mb.forces, "{},{:.6e},{:.6e},{:.6e},{:.6e},{:.6e},{:.6e},{:.5f},{:.5f}",
+						ensemble.steps(), f.fx, f.fy, f.wallX, f.wallY, f.u, f.v, f.cd, f.cl);
+			}
+		}
+
+		std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+		double setup = std::chrono::duration<double>(t1 - t0).count();
+		double seconds = std::chrono::duration<double>(t2 - t1).count();
+		double mlups = seconds > 0.0 ? double(cells) * members * ensemble.steps() / seconds * 1e-6 : 0.0;
+
+		for (int m = 0; m < members; m++)
+		{
+			const Scenario& sc = scenarios[group[m]];
+			Member& mb = state[m];
+			if (mb.metrics != NULL)
+				std::fclose(mb.metrics);
+			if (mb.forces != NULL)
+				std::fclose(mb.forces);
+
+			for (const std::string& name : sc.outputs)
+			{
+				for (int f = 0; f < LbmEngine::NUM_FIELDS; f++)
+					if (name == FIELD_NAMES[f])
+						ok &= writeNpy(outputDir + "/" + sc.name + "/" + name + ".npy", ensemble.field((LbmEngine::Field)f, m));
+			}
+
+			bool stable = mb.last.nanCells == 0;
+			ok &= stable;
+			fmt::println(summary, "{},{},{},{},{},{},{},{:.3f},{:.3f},{:.1f},{:.6e},{:.6e},{:.6f},{},{:.5f},{:.5f},{}",
+				sc.name, g, members, sc.nx, sc.ny, STORAGE_KEYS[sc.storage], ensemble.steps(), setup, seconds, mlups,
+				mb.last.meanU, mb.last.maxSpeed, mb.last.meanRho, mb.last.nanCells, mb.lastForces.cd, mb.lastForces.cl,
+				mb.failed ? "failed" : stable ? "ok" : "unstable");
+		}
+		std::fflush(summary);
+
+		fmt::println("Ensemble: group {} done in {:.1f} s ({:.1f} MLUPS over {} runs)", g + 1, seconds, mlups, members);
+	}
+
+	ensemble.destroy();
+	std::fclose(summary);
+
+	fmt::println("Ensemble: {} runs in {} groups written to {}", scenarios.size(), groups.size(), outputDir);
+	return ok;
+}
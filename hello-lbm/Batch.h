@@ -0,0 +1,72 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+#include <vector>
+
+#include "Storage.h"
+
+// One run of the 2D solver, as read from a scenario file
+struct Scenario
+{
+	std::string name;
+
+	int nx = 640;				// multiples of 10
+	int ny = 360;
+	int steps = 20000;
+
+	float tau = 0.631f;
+	float forceX = -0.000007f;
+	float forceY = 0.0f;
+	int collision = 0;			// BGK, MRT, cumulant
+	float smagorinsky = 0.0f;
+	Storage storage = STORAGE_FP32;
+	bool bouzidi = true;
+	bool sparseTiles = true;
+
+	// "circle", "none" or a file for Geometry::load; centre and radius in fractions of nx, ny and nx
+	std::string obstacle = "circle";
+	float obstacleX = 0.5f;
+	float obstacleY = 0.5f;
+	float obstacleR = 1.0f / 14.0f;
+
+	int sampleInterval = 1000;	// metrics and forces every that many steps
+	std::vector<std::string> outputs = { "speed", "vorticity" };	// fields written after the last step
+};
+
+// Scenario files are INI-like: "[name]" starts a scenario, "key = value" lines set
+// its fields under the Scenario names in snake case (force_x, sample_interval, ...)
+// and '#' starts a comment. Keys before the first section are the defaults of every
+// scenario. collision takes bgk, mrt or cumulant, storage fp32, fp16, fp16s or
+// fp16c, outputs a space separated list of velocity_x, velocity_y, density,
+// pressure, speed, vorticity and flags.
+//
+//   steps = 50000
+//   [re100]
+//   tau = 0.56
+//   [wing]
+//   obstacle = shapes/naca0012.txt
+bool loadScenarios(const char* filename, std::vector<Scenario>& scenarios);
+
+// Runs the scenarios one after the other on the current context through one
+// LbmEngine, so lbm.cs is compiled once per storage and a run with the same grid
+// and options as the one before it reuses its buffers. Writes into outputDir:
+//   runs.csv                one line per run: setup and run time, MLUPS, final metrics
+//   <name>/metrics.csv      mean velocity, max speed, mean density and NaN cells per sample
+//   <name>/forces.csv       drag and lift per sample (see Forces.h)
+//   <name>/<field>.npy      the requested fields after the last step, (ny, nx) float32
+// A run that fails or goes unstable is reported and the next one starts anyway.
+bool runBatch(const std::vector<Scenario>& scenarios, const std::string& outputDir);
+
+// Runs the scenarios through LbmEnsemble instead: scenarios with the same grid,
+// steps, sample interval, collision, LES constant and storage go into one group
+// that is stepped in one dispatch per step, only force, tau and obstacle differ
+// between them. Bouzidi links and sparse tiles are not used. Writes into outputDir:
+//   ensemble.csv            one line per run: its group, the group's run time and MLUPS, final metrics
+//   <name>/metrics.csv      as runBatch
+//   <name>/forces.csv       as runBatch, wall forces included
+//   <name>/<field>.npy      as runBatch
+// A member that goes unstable is reported, the rest of its group runs on.
+bool runEnsemble(const std::vector<Scenario>& scenarios, const std::string& outputDir);
+
+#endif // BATCH_H
@@ -0,0 +1,438 @@
+#include "CpuLbm.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include <fmt/core.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Same as in shaders/lbm.cs
+static const int ex[9] = { 0, 1, 0, -1, 0, 1, -1, -1, 1 };
+static const int ey[9] = { 0, 0, 1, 0, -1, 1, 1, -1, -1 };
+static const int inv[9] = { 0, 3, 4, 1, 2, 7, 8, 5, 6 };
+static const float w[9] = { 4.0f / 9.0f, 1.0f / 9.0f, 1.0f / 9.0f, 1.0f / 9.0f, 1.0f / 9.0f,
+	1.0f / 36.0f, 1.0f / 36.0f, 1.0f / 36.0f, 1.0f / 36.0f };
+
+// The directions that cross a row boundary downwards and upwards
+static const int DOWN[3] = { 4, 7, 8 };
+static const int UP[3] = { 2, 5, 6 };
+
+//-----------------------------------------------------------------------------
+// Keeps the thread on one logical processor, so the pages it first touches stay
+// on its node. Not supported everywhere (macOS), the thread then floats.
+//-----------------------------------------------------------------------------
+static bool pinThread(std::thread& thread, int cpu)
+{
+#ifdef _WIN32
+	if (cpu >= 64)
+		return false;
+	return SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << cpu) != 0;
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#else
+	(void)thread;
+	(void)cpu;
+	return false;
+#endif
+}
+
+CpuLbm::CpuLbm()
+	: mNX(0), mNY(0), mSteps(0),
+	  mJob(NULL), mGeneration(0), mBusy(0), mQuit(false)
+{
+}
+
+CpuLbm::~CpuLbm()
+{
+	destroy();
+}
+
+bool CpuLbm::init(int nx, int ny, int slabs)
+{
+	if (nx <= 0 || slabs <= 0 || ny < 2 * slabs)
+	{
+		fmt::println("CpuLbm: {} x {} does not split into {} slabs of at least two rows", nx, ny, slabs);
+		return false;
+	}
+
+	destroy();
+
+	mNX = nx;
+	mNY = ny;
+	mSteps = 0;
+	mQuit = false;
+	mGeneration = 0;
+
+	for (int s = 0; s < slabs; s++)
+	{
+		std::unique_ptr<Slab> slab(new Slab);
+		slab->y0 = ny * s / slabs;
+		slab->rows = ny * (s + 1) / slabs - slab->y0;
+		slab->current = 0;
+		slab->seqDown = slab->seqUp = 0;
+		slab->below = slab->above = NULL;
+		slab->waitSeconds = 0.0;
+		mSlabs.push_back(std::move(slab));
+	}
+	for (int s = 0; s < slabs; s++)
+	{
+		mSlabs[s]->below = s > 0 ? mSlabs[s - 1].get() : NULL;
+		mSlabs[s]->above = s < slabs - 1 ? mSlabs[s + 1].get() : NULL;
+		mSlabs[s]->thread = std::thread(&CpuLbm::worker, this, mSlabs[s].get());
+	}
+
+	// Spread over all processors, nodes own contiguous ranges of them so the
+	// slabs split across the nodes too
+	int cpus = std::max(1, (int)std::thread::hardware_concurrency());
+	int pinned = 0;
+	for (int s = 0; s < slabs; s++)
+		pinned += pinThread(mSlabs[s]->thread, int((long long)s * cpus / slabs)) ? 1 : 0;
+	if (pinned < slabs)
+		fmt::println("CpuLbm: pinned {} of {} workers, the others may move between nodes", pinned, slabs);
+
+	// First touch on the worker, so the pages are on its node
+	run([nx](Slab& slab) {
+		size_t cells = size_t(slab.rows + 2) * nx;
+		for (int i = 0; i < 2; i++)
+		{
+			slab.f[i].resize(cells * 9);
+			for (size_t c = 0; c < cells; c++)
+				for (int k = 0; k < 9; k++)
+					slab.f[i][c * 9 + k] = w[k];
+
+			slab.haloDown[i].assign(3 * size_t(nx), 0.0f);
+			slab.haloUp[i].assign(3 * size_t(nx), 0.0f);
+		}
+		slab.flags.assign(cells, 0);
+		slab.u.assign(size_t(slab.rows) * nx, 0.0f);
+		slab.v.assign(size_t(slab.rows) * nx, 0.0f);
+	});
+
+	setObstacle(std::vector<float>());
+	return true;
+}
+
+void CpuLbm::destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_all();
+
+	for (std::unique_ptr<Slab>& slab : mSlabs)
+		slab->thread.join();
+	mSlabs.clear();
+	mFlags.clear();
+
+	mNX = mNY = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Workers wait for the next job generation, the last one done wakes run()
+//-----------------------------------------------------------------------------
+void CpuLbm::run(const std::function<void(Slab&)>& job)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	mJob = &job;
+	mBusy = (int)mSlabs.size();
+	mGeneration++;
+	mWake.notify_all();
+
+	mDone.wait(lock, [this] { return mBusy == 0; });
+	mJob = NULL;
+}
+
+void CpuLbm::worker(Slab* slab)
+{
+	long long seen = 0;
+	for (;;)
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mWake.wait(lock, [&] { return mQuit || mGeneration != seen; });
+		if (mQuit)
+			return;
+		seen = mGeneration;
+		const std::function<void(Slab&)>* job = mJob;
+		lock.unlock();
+
+		(*job)(*slab);
+
+		lock.lock();
+		if (--mBusy == 0)
+			mDone.notify_one();
+	}
+}
+
+void CpuLbm::setObstacle(const std::vector<float>& sdf)
+{
+	size_t cells = size_t(mNX) * mNY;
+	mFlags.resize(cells);
+	for (size_t idx = 0; idx < cells; idx++)
+		mFlags[idx] = sdf.size() == cells && sdf[idx] < 0.0f ? 0 : 1;
+	for (int x = 0; x < mNX; x++)
+		mFlags[x] = mFlags[x + size_t(mNY - 1) * mNX] = 0;
+
+	// Ghost rows mirror the neighbours' edge rows, outside the lattice they are solid
+	run([this](Slab& slab) {
+		for (int r = 0; r < slab.rows + 2; r++)
+		{
+			int y = slab.y0 + r - 1;
+			for (int x = 0; x < mNX; x++)
+				slab.flags[size_t(r) * mNX + x] = y >= 0 && y < mNY ? mFlags[size_t(y) * mNX + x] : 0;
+		}
+	});
+}
+
+void CpuLbm::step(int steps)
+{
+	run([this, steps](Slab& slab) { stepSlab(slab, steps); });
+	mSteps += steps;
+}
+
+//-----------------------------------------------------------------------------
+// Collision and push streaming of one row, as main() of lbm.cs
+//-----------------------------------------------------------------------------
+void CpuLbm::collideRow(const float* src, float* dst, const int* flags, int nx, int r, const Params& p,
+	float* uOut, float* vOut)
+{
+	for (int x = 0; x < nx; x++)
+	{
+		size_t idx = size_t(r) * nx + x;
+		if (flags[idx] != 1)
+			continue;
+
+		float fc[9], feq[9], fpost[9];
+		float rho = 0.0f, u = 0.0f, v = 0.0f;
+		for (int k = 0; k < 9; k++)
+		{
+			fc[k] = src[idx * 9 + k];
+			rho += fc[k];
+			u += fc[k] * ex[k];
+			v += fc[k] * ey[k];
+		}
+		u /= rho;
+		v /= rho;
+		if (uOut != NULL)
+		{
+			uOut[x] = u;
+			vOut[x] = v;
+		}
+		u += 0.5f * p.fx;
+		v += 0.5f * p.fy;
+
+		for (int k = 0; k < 9; k++)
+		{
+			float eu = ex[k] * u + ey[k] * v;
+			feq[k] = w[k] * rho * (1.0f - 1.5f * (u * u + v * v) + 3.0f * eu + 4.5f * eu * eu);
+		}
+
+		// Smagorinsky: the eddy viscosity from the non-equilibrium stress raises tau locally
+		float tauS = p.tau;
+		if (p.smagorinsky > 0.0f)
+		{
+			float pxx = 0.0f, pxy = 0.0f, pyy = 0.0f;
+			for (int k = 0; k < 9; k++)
+			{
+				float fneq = fc[k] - feq[k];
+				pxx += ex[k] * ex[k] * fneq;
+				pxy += ex[k] * ey[k] * fneq;
+				pyy += ey[k] * ey[k] * fneq;
+			}
+			float s = std::sqrt(2.0f * (pxx * pxx + 2.0f * pxy * pxy + pyy * pyy));
+			tauS = 0.5f * (p.tau + std::sqrt(p.tau * p.tau + 18.0f * p.smagorinsky * p.smagorinsky * s / rho));
+		}
+		float omega = 1.0f / tauS;
+
+		for (int k = 0; k < 9; k++)
+			fpost[k] = (1.0f - omega) * fc[k] + omega * feq[k];
+
+		for (int k = 0; k < 9; k++)
+		{
+			int xp = x + ex[k];
+			xp = xp < 0 ? nx - 1 : xp == nx ? 0 : xp;
+			size_t idxp = size_t(r + ey[k]) * nx + xp;
+
+			if (flags[idxp] != 1)
+				dst[idx * 9 + inv[k]] = fpost[k];
+			else
+				dst[idxp * 9 + k] = fpost[k];
+		}
+	}
+}
+
+void CpuLbm::collideRow(Slab& slab, int r, bool output)
+{
+	size_t row = size_t(r - 1) * mNX;
+	collideRow(slab.f[slab.current].data(), slab.f[1 - slab.current].data(), slab.flags.data(), mNX, r, mParams,
+		output ? slab.u.data() + row : NULL, output ? slab.v.data() + row : NULL);
+}
+
+//-----------------------------------------------------------------------------
+// Edge rows, halos out, interior rows, halos in
+//-----------------------------------------------------------------------------
+void CpuLbm::stepSlab(Slab& slab, int steps)
+{
+	slab.waitSeconds = 0.0;
+	int top = slab.rows + 1;
+
+	for (int i = 0; i < steps; i++)
+	{
+		long long n = mSteps + i;
+		int parity = int(n & 1);
+		bool output = i == steps - 1;
+		float* dst = slab.f[1 - slab.current].data();
+
+		collideRow(slab, 1, output);
+		collideRow(slab, slab.rows, output);
+
+		if (slab.below != NULL)
+		{
+			float* halo = slab.haloDown[parity].data();
+			for (int x = 0; x < mNX; x++)
+				for (int d = 0; d < 3; d++)
+					halo[x * 3 + d] = dst[size_t(x) * 9 + DOWN[d]];
+			slab.seqDown.store(n + 1, std::memory_order_release);
+		}
+		if (slab.above != NULL)
+		{
+			float* halo = slab.haloUp[parity].data();
+			for (int x = 0; x < mNX; x++)
+				for (int d = 0; d < 3; d++)
+					halo[x * 3 + d] = dst[(size_t(top) * mNX + x) * 9 + UP[d]];
+			slab.seqUp.store(n + 1, std::memory_order_release);
+		}
+
+		for (int r = 2; r < slab.rows; r++)
+			collideRow(slab, r, output);
+
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		if (slab.below != NULL)
+			while (slab.below->seqUp.load(std::memory_order_acquire) < n + 1)
+				std::this_thread::yield();
+		if (slab.above != NULL)
+			while (slab.above->seqDown.load(std::memory_order_acquire) < n + 1)
+				std::this_thread::yield();
+		slab.waitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+		// Only what a fluid cell pushed is taken, a fluid cell next to a solid one has
+		// its population from bouncing back already
+		if (slab.below != NULL)
+		{
+			const float* halo = slab.below->haloUp[parity].data();
+			for (int x = 0; x < mNX; x++)
+				for (int d = 0; d < 3; d++)
+				{
+					int xs = (x - ex[UP[d]] + mNX) % mNX;
+					if (slab.flags[xs] == 1)
+						dst[(size_t(mNX) + x) * 9 + UP[d]] = halo[x * 3 + d];
+				}
+		}
+		if (slab.above != NULL)
+		{
+			const float* halo = slab.above->haloDown[parity].data();
+			for (int x = 0; x < mNX; x++)
+				for (int d = 0; d < 3; d++)
+				{
+					int xs = (x - ex[DOWN[d]] + mNX) % mNX;
+					if (slab.flags[size_t(top) * mNX + xs] == 1)
+						dst[(size_t(slab.rows) * mNX + x) * 9 + DOWN[d]] = halo[x * 3 + d];
+				}
+		}
+
+		slab.current = 1 - slab.current;
+	}
+}
+
+void CpuLbm::velocity(std::vector<float>& u, std::vector<float>& v) const
+{
+	u.resize(size_t(mNX) * mNY);
+	v.resize(size_t(mNX) * mNY);
+	for (const std::unique_ptr<Slab>& slab : mSlabs)
+	{
+		std::copy(slab->u.begin(), slab->u.end(), u.begin() + size_t(slab->y0) * mNX);
+		std::copy(slab->v.begin(), slab->v.end(), v.begin() + size_t(slab->y0) * mNX);
+	}
+}
+
+double CpuLbm::haloWait() const
+{
+	double sum = 0.0;
+	for (const std::unique_ptr<Slab>& slab : mSlabs)
+		sum += slab->waitSeconds;
+	return mSlabs.empty() ? 0.0 : sum / mSlabs.size();
+}
+
+//-----------------------------------------------------------------------------
+// Strong and weak scaling over the slab counts
+//-----------------------------------------------------------------------------
+static bool benchmarkRun(const CpuBenchmark& cfg, int ny, int slabs, double& mlups)
+{
+	CpuLbm lbm;
+	if (!lbm.init(cfg.nx, ny, slabs))
+		return false;
+	lbm.setTau(cfg.tau);
+	lbm.setForce(cfg.force, 0.0f);
+
+	lbm.step(cfg.warmup);
+
+	auto start = std::chrono::steady_clock::now();
+	lbm.step(cfg.steps);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	double updates = double(cfg.nx) * ny * cfg.steps;
+	mlups = updates / seconds * 1e-6;
+	double bytes = updates * 9 * 2 * sizeof(float);
+	fmt::print("{:4} slabs, {}x{}: {:8.1f} MLUPS, {:6.1f} GB/s, halo wait {:5.1f}%",
+		slabs, cfg.nx, ny, mlups, bytes / seconds * 1e-9, 100.0 * lbm.haloWait() / seconds);
+
+	lbm.destroy();
+	return true;
+}
+
+bool runCpuBenchmark(const CpuBenchmark& cfg)
+{
+	int maxSlabs = cfg.maxSlabs > 0 ? cfg.maxSlabs : std::max(1, (int)std::thread::hardware_concurrency());
+
+	std::vector<int> counts;
+	for (int s = 1; s < maxSlabs; s *= 2)
+		counts.push_back(s);
+	counts.push_back(maxSlabs);
+
+	fmt::println("CPU D2Q9 strong scaling, {}x{}, {} steps", cfg.nx, cfg.ny, cfg.steps);
+	double base = 0.0;
+	for (int slabs : counts)
+	{
+		double mlups;
+		if (!benchmarkRun(cfg, cfg.ny, slabs, mlups))
+			return false;
+		if (slabs == 1)
+			base = mlups;
+		fmt::println(", speedup {:5.2f}, efficiency {:5.1f}%", mlups / base, 100.0 * mlups / (base * slabs));
+	}
+
+	fmt::println("CPU D2Q9 weak scaling, {}x{} per slab, {} steps", cfg.nx, cfg.weakRows, cfg.steps);
+	for (int slabs : counts)
+	{
+		double mlups;
+		if (!benchmarkRun(cfg, cfg.weakRows * slabs, slabs, mlups))
+			return false;
+		if (slabs == 1)
+			base = mlups;
+		fmt::println(", efficiency {:5.1f}%", 100.0 * mlups / (base * slabs));
+	}
+
+	return true;
+}
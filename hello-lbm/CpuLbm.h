@@ -0,0 +1,132 @@
+#ifndef CPU_LBM_H
+#define CPU_LBM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// The 2D step of lbm.cs on the CPU for machines without a GPU, split into slabs
+// of rows that step in parallel.
+//
+// Same D2Q9 BGK with body force, Smagorinsky LES and half-way bounce-back as
+// the FP32 storage of the shader, periodic in x with walls in the first and last
+// row, so both agree to rounding. No MRT, cumulant, Bouzidi links or forces.
+//
+// Every slab has a worker thread of its own, pinned to one processor, that
+// allocates and first touches its populations, so on a NUMA machine they stay
+// in the memory of the node the thread runs on and the step never reads across
+// nodes. Where pinning is not supported the worker may migrate and lose this.
+// What a slab pushes over its edge rows lands in ghost rows and goes to the
+// neighbour through a small halo buffer per direction and step parity; a
+// sequence number per halo, stored with release and loaded with acquire, says
+// which step it holds. A step does the two edge rows first, publishes their
+// halos, does the interior rows and only then waits for the halos of its
+// neighbours, so the exchange hides behind the interior. Slabs only ever wait
+// for their neighbours, never for all.
+class CpuLbm
+{
+public:
+	struct Params
+	{
+		float fx = 0.0f, fy = 0.0f;		// body force
+		float tau = 0.6f;
+		float smagorinsky = 0.0f;
+	};
+
+	// Collides row r of src and pushes it into rows r - 1 .. r + 1 of dst, both rows
+	// of nx cells of 9 floats, periodic in x. flags has the same rows, 1 fluid. u and
+	// v get the velocity of row r when not NULL. Shared with StreamingLbm.
+	static void collideRow(const float* src, float* dst, const int* flags, int nx, int r, const Params& p,
+		float* u, float* v);
+
+	CpuLbm();
+	~CpuLbm();
+
+	// Starts one worker per slab; at least two rows per slab. Starts at rest
+	// without obstacle.
+	bool init(int nx, int ny, int slabs);
+	void destroy();
+
+	void setForce(float fx, float fy) { mParams.fx = fx; mParams.fy = fy; }
+	void setTau(float tau) { mParams.tau = tau; }
+	void setSmagorinsky(float c) { mParams.smagorinsky = c; }
+	// nx * ny signed distances, negative in the solid, as LbmEngine::setObstacle
+	void setObstacle(const std::vector<float>& sdf);
+
+	// Returns once every slab has done all steps, the last one writes the velocity
+	void step(int steps);
+	// Velocity at the start of the last step, nx * ny each
+	void velocity(std::vector<float>& u, std::vector<float>& v) const;
+
+	int nx() const { return mNX; }
+	int ny() const { return mNY; }
+	int slabs() const { return (int)mSlabs.size(); }
+	long long steps() const { return mSteps; }
+	// Seconds the slabs waited for halos in the last step(), averaged over the slabs
+	double haloWait() const;
+
+private:
+	struct Slab
+	{
+		int y0, rows;				// rows y0 .. y0 + rows - 1 of the lattice
+		std::vector<float> f[2];	// rows + 2 rows of nx cells, ghost rows first and last
+		std::vector<int> flags;		// same rows, 1 fluid
+		std::vector<float> u, v;	// rows * nx
+		int current;
+
+		// Populations pushed out of the slab, 3 per column, by step parity
+		std::vector<float> haloDown[2], haloUp[2];
+		std::atomic<long long> seqDown, seqUp;	// steps whose halos are out
+		Slab* below;
+		Slab* above;
+
+		double waitSeconds;
+		std::thread thread;
+	};
+
+	// Runs job on every worker, returns when all are done
+	void run(const std::function<void(Slab&)>& job);
+	void worker(Slab* slab);
+
+	void stepSlab(Slab& slab, int steps);
+	void collideRow(Slab& slab, int r, bool output);
+
+	int mNX, mNY;
+	Params mParams;
+	long long mSteps;
+
+	std::vector<std::unique_ptr<Slab>> mSlabs;
+	std::vector<int> mFlags;		// nx * ny of the whole lattice
+
+	std::mutex mMutex;
+	std::condition_variable mWake, mDone;
+	const std::function<void(Slab&)>* mJob;
+	long long mGeneration;
+	int mBusy;
+	bool mQuit;
+};
+
+struct CpuBenchmark
+{
+	// Channel as the demo's, stepped once per slab count
+	int nx = 1280;
+	int ny = 720;
+	int weakRows = 180;		// rows per slab of the weak scaling runs
+
+	int maxSlabs = 0;		// 0 is one per hardware thread
+	int warmup = 20;
+	int steps = 200;
+	float tau = 0.6f;
+	float force = 1e-5f;
+};
+
+// Strong scaling (nx x ny split into 1, 2, 4 ... slabs) and weak scaling (nx x
+// weakRows per slab), printed as MLUPS, speedup, efficiency and the share of time
+// spent waiting for halos. Needs no GL context.
+bool runCpuBenchmark(const CpuBenchmark& cfg);
+
+#endif // CPU_LBM_H
@@ -0,0 +1,91 @@
+#include "CurvedBoundary.h"
+
+#include <algorithm>
+
+static const int ex[9] = { 0, 1, 0, -1, 0, 1, -1, -1, 1 };
+static const int ey[9] = { 0, 0, 1, 0, -1, 1, 1, -1, -1 };
+
+CurvedBoundary::CurvedBoundary()
+	: mNX(0), mNY(0), mCapacity(0), mNumLinks(0)
+{
+}
+
+bool CurvedBoundary::init(int nx, int ny)
+{
+	if (!mProgram.loadComputeShader("shaders/bouzidi.cs"))
+		return false;
+
+	mNX = nx;
+	mNY = ny;
+
+	mBuffer.create("boundary", 0, NULL, GL_DYNAMIC_DRAW);
+	// Room for an obstacle with a rim as long as the channel, grows beyond
+	mUploads.init(size_t(4 * (nx + ny)) * sizeof(Link));
+	return true;
+}
+
+void CurvedBoundary::destroy()
+{
+	mBuffer.destroy();
+	mUploads.destroy();
+	mCapacity = 0;
+	mNumLinks = 0;
+
+	mProgram.destroy();
+}
+
+void CurvedBoundary::update(const std::vector<float>& sdf)
+{
+	if (mBuffer == 0)
+		return;
+
+	mLinks.clear();
+	for (int y = 1; y < mNY - 1; y++)
+	{
+		for (int x = 0; x < mNX; x++)
+		{
+			int idx = x + y * mNX;
+			if (sdf[idx] < 0.0f)
+				continue;
+
+			for (int k = 1; k < 9; k++)
+			{
+				int xp = (x + ex[k] + mNX) % mNX;
+				int yp = y + ey[k];
+				float d = sdf[xp + yp * mNX];
+				if (d >= 0.0f)
+					continue;
+
+				// The distance is close to linear across one link
+				float q = std::clamp(sdf[idx] / (sdf[idx] - d), 1e-3f, 1.0f);
+				mLinks.push_back({ idx, k, q, 0.0f });
+			}
+		}
+	}
+	mNumLinks = (int)mLinks.size();
+
+	// Grows only, a moving obstacle changes its link count every frame
+	if (mLinks.size() > mCapacity)
+	{
+		mCapacity = mLinks.size() * 2;
+		mBuffer.create("boundary", mCapacity * sizeof(Link), NULL, GL_DYNAMIC_DRAW);
+	}
+	if (mNumLinks > 0)
+		mUploads.upload(mBuffer, 0, mLinks.data(), mLinks.size() * sizeof(Link));
+}
+
+void CurvedBoundary::schedule(PassScheduler& scheduler, GLuint f)
+{
+	if (mNumLinks == 0)
+		return;
+
+	int groups = (mNumLinks + 63) / 64;
+
+	Pass pass;
+	pass.program = mProgram.getProgram();
+	pass.bind(1, f).bind(11, mBuffer);
+	pass.uniform(0, mNX).uniform(1, mNY).uniform(2, mNumLinks);
+	pass.read(f).read(mBuffer).write(f);
+	pass.dispatch = [groups] { glDispatchCompute(groups, 1, 1); };
+	scheduler.add(pass);
+}
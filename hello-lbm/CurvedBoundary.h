@@ -0,0 +1,59 @@
+#ifndef CURVED_BOUNDARY_H
+#define CURVED_BOUNDARY_H
+
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "GpuMemory.h"
+#include "PassScheduler.h"
+#include "ShaderProgram.h"
+#include "UploadRing.h"
+
+// Interpolated (Bouzidi) bounce-back on the obstacle.
+//
+// Half-way bounce-back puts every wall half a link from the fluid cell, so a circle
+// becomes a staircase and its drag only converges at fine resolutions. update() cuts
+// every fluid-solid link with the signed distance field from Geometry and keeps the
+// list of (cell, direction, q), q being the fraction of the link in the fluid. After
+// each lbm.cs step shaders/bouzidi.cs replaces the half-way value of each of those
+// links by the linear interpolation of Bouzidi, Firdaouss & Lallemand (2001), one
+// invocation per link. The channel walls are flat and half-way, which is exact there.
+//
+// Needs FP32 storage. Forces still sums the half-way momentum exchange.
+class CurvedBoundary
+{
+public:
+	CurvedBoundary();
+
+	// Needs a current context
+	bool init(int nx, int ny);
+	void destroy();
+
+	// Call after the flags changed, sdf as from Geometry::rasterize
+	void update(const std::vector<float>& sdf);
+
+	// Queues the pass after the lbm.cs step into f, the flags have to be bound at 2
+	void schedule(PassScheduler& scheduler, GLuint f);
+
+	int links() const { return mNumLinks; }
+
+private:
+	struct Link
+	{
+		int cell;
+		int k;
+		float q;
+		float pad;
+	};
+
+	int mNX, mNY;
+	ShaderProgram mProgram;
+	GpuBuffer mBuffer;
+	size_t mCapacity;
+	int mNumLinks;
+	std::vector<Link> mLinks;
+	UploadRing mUploads;		// the links of every update()
+};
+
+#endif // CURVED_BOUNDARY_H
@@ -0,0 +1,129 @@
+#include "Diagnostics.h"
+
+#include <algorithm>
+
+#include <fmt/core.h>
+
+// Lattice speed of sound is 1/sqrt(3), well below that the BGK model stays stable
+static const float MAX_STABLE_SPEED = 0.3f;
+
+Diagnostics::Diagnostics(int nx, int ny, int interval)
+	: mCells(nx * ny), mInterval(interval), mNumGroups(0),
+	  mFence(0), mStep(0), mNextSample(0), mPendingStep(0), mHasReference(false), mDiverged(false)
+{
+}
+
+bool Diagnostics::init(const std::string& defines)
+{
+	if (!mProgram.loadComputeShader("shaders/diagnostics.cs", defines))
+		return false;
+
+	mNumGroups = std::min(MAX_GROUPS, (mCells + GROUP_SIZE - 1) / GROUP_SIZE);
+
+	mPartial.create("diagnostics", mNumGroups * sizeof(LBMTotals), NULL, GL_DYNAMIC_COPY);
+	mResult.create("diagnostics", sizeof(LBMTotals), NULL, GL_DYNAMIC_READ);
+
+	return true;
+}
+
+void Diagnostics::destroy()
+{
+	if (mFence != 0)
+		glDeleteSync(mFence);
+	mFence = 0;
+
+	mPartial.destroy();
+	mResult.destroy();
+
+	mProgram.destroy();
+}
+
+void Diagnostics::update(GLuint fBuffer, int steps)
+{
+	if (mInterval <= 0 || mResult == 0)
+		return;
+
+	mStep += steps;
+
+	collect();
+
+	// A sample still in flight just pushes this one back
+	if (mStep >= mNextSample && mFence == 0)
+	{
+		dispatch(fBuffer);
+		mNextSample = mStep + mInterval;
+	}
+}
+
+void Diagnostics::dispatch(GLuint fBuffer)
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, fBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, mPartial);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, mResult);
+
+	mProgram.use();
+	mProgram.setUniform("N", mCells);
+	mProgram.setUniform("numPartials", mNumGroups);
+
+	mProgram.setUniform("pass", 0);
+	glDispatchCompute(mNumGroups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	mProgram.setUniform("pass", 1);
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	glUseProgram(0);
+
+	mFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	mPendingStep = mStep;
+}
+
+//-----------------------------------------------------------------------------
+// Reads the totals back once the reduction has finished, never blocks
+//-----------------------------------------------------------------------------
+void Diagnostics::collect()
+{
+	if (mFence == 0)
+		return;
+
+	GLenum status = glClientWaitSync(mFence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		return;
+
+	glDeleteSync(mFence);
+	mFence = 0;
+
+	LBMTotals totals;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mResult);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(LBMTotals), &totals);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	report(totals);
+}
+
+void Diagnostics::report(const LBMTotals& totals)
+{
+	// Moving the obstacle adds or removes fluid, start measuring drift again
+	if (!mHasReference || totals.fluidCells != mReference.fluidCells)
+	{
+		mReference = totals;
+		mHasReference = true;
+	}
+
+	double drift = mReference.mass != 0.0f ? (double(totals.mass) - mReference.mass) / mReference.mass : 0.0;
+
+	fmt::println("LBM step {}: mass {:.3f} (drift {:+.2e}), momentum ({:+.4e}, {:+.4e}), kinetic energy {:.4e}, max |u| {:.4f}",
+		mPendingStep, totals.mass, drift, totals.momentumX, totals.momentumY, totals.kineticEnergy, totals.maxSpeed);
+
+	if (totals.nanCells > 0.0f)
+	{
+		if (!mDiverged)
+			fmt::println("LBM step {}: {} of {} fluid cells are NaN/Inf, the solution has diverged",
+				mPendingStep, (long long)totals.nanCells, (long long)totals.fluidCells);
+		mDiverged = true;
+	}
+	else if (totals.maxSpeed > MAX_STABLE_SPEED)
+		fmt::println("LBM step {}: max |u| {:.3f} is above {}, expect compressibility errors or instability",
+			mPendingStep, totals.maxSpeed, MAX_STABLE_SPEED);
+}
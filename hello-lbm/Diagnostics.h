@@ -0,0 +1,62 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <glad/glad.h>
+
+#include "GpuMemory.h"
+#include "ShaderProgram.h"
+
+// Totals over the fluid cells, same order as the Q_* slots in shaders/diagnostics.cs
+struct LBMTotals
+{
+	float mass;
+	float momentumX, momentumY;
+	float kineticEnergy;
+	float maxSpeed;
+	float nanCells;
+	float fluidCells;
+	float pad;
+};
+
+// Conservation and stability checks for long runs.
+//
+// Every `interval` steps the distributions are reduced on the GPU (shaders/diagnostics.cs,
+// two passes of subgroup / shared memory trees) into the 32 bytes of LBMTotals, which are
+// read back once a fence says they are done, so the solver never waits on them. Mass drift
+// is measured against the first sample and reset whenever the obstacle changes the number
+// of fluid cells.
+class Diagnostics
+{
+public:
+	Diagnostics(int nx, int ny, int interval);
+
+	// Needs a current context; `defines` select the distribution storage (see Storage.h)
+	bool init(const std::string& defines = "");
+	void destroy();
+
+	// Call after advancing `steps` steps; fBuffer holds the newest distributions and
+	// the obstacle flags must be bound at 2
+	void update(GLuint fBuffer, int steps);
+
+	bool diverged() const { return mDiverged; }
+
+private:
+	static const int GROUP_SIZE = 256;
+	static const int MAX_GROUPS = 256;
+
+	void dispatch(GLuint fBuffer);
+	void collect();
+	void report(const LBMTotals& totals);
+
+	int mCells, mInterval, mNumGroups;
+	ShaderProgram mProgram;
+	GpuBuffer mPartial, mResult;
+
+	GLsync mFence;
+	long long mStep, mNextSample, mPendingStep;
+
+	LBMTotals mReference;
+	bool mHasReference, mDiverged;
+};
+
+#endif // DIAGNOSTICS_H
@@ -0,0 +1,63 @@
+#include "FieldView.h"
+
+FieldView::FieldView()
+	: mNX(0), mNY(0), mVAO(0)
+{
+}
+
+bool FieldView::init(int nx, int ny)
+{
+	if (!mCompute.loadComputeShader("shaders/field.cs"))
+		return false;
+	if (!mDraw.loadShaders("shaders/vert_screen.glsl", "shaders/frag_screen.glsl"))
+		return false;
+
+	mNX = nx;
+	mNY = ny;
+
+	mTexture.create2D("view", GL_RGBA8, mNX, mNY);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenVertexArrays(1, &mVAO);
+
+	return true;
+}
+
+void FieldView::destroy()
+{
+	mTexture.destroy();
+	glDeleteVertexArrays(1, &mVAO);
+	mVAO = 0;
+
+	mCompute.destroy();
+	mDraw.destroy();
+}
+
+void FieldView::draw(GLuint fields, GLuint flags, View view, float range)
+{
+	if (mTexture == 0)
+		return;
+
+	mCompute.use();
+	mCompute.setUniform("NX", mNX);
+	mCompute.setUniform("NY", mNY);
+	mCompute.setUniform("view", (GLint)view);
+	mCompute.setUniform("range", range);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, flags);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, fields);
+	glBindImageTexture(0, mTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+	glDispatchCompute((mNX + 15) / 16, (mNY + 15) / 16, 1);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	mDraw.use();
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, mTexture);
+	mDraw.setUniform("screenTexture", 0);
+	glBindVertexArray(mVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(0);
+}
@@ -0,0 +1,37 @@
+#ifndef FIELD_VIEW_H
+#define FIELD_VIEW_H
+
+#include <glad/glad.h>
+
+#include "GpuMemory.h"
+#include "ShaderProgram.h"
+
+// Speed or vorticity drawn as a colour field, the cheap alternative to the particles.
+//
+// Works on the packed fields lbm.cs writes with OUT_FIELDS on the sampled step:
+// shaders/field.cs maps one component per cell through the gray-scott palette into
+// an RGBA8 texture of the lattice size, which is then stretched over the viewport
+// by a single triangle. That is one texel per cell, no blending, no overdraw.
+class FieldView
+{
+public:
+	enum View { SPEED, VORTICITY };
+
+	FieldView();
+
+	// Needs a current context
+	bool init(int nx, int ny);
+	void destroy();
+
+	// fields as written by lbm.cs, flags as in cF_SSB; range is the speed at the top of
+	// the palette, or the |vorticity| at either end
+	void draw(GLuint fields, GLuint flags, View view, float range);
+
+private:
+	int mNX, mNY;
+	ShaderProgram mCompute, mDraw;
+	GpuTexture mTexture;
+	GLuint mVAO;
+};
+
+#endif // FIELD_VIEW_H
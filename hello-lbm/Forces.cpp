@@ -0,0 +1,176 @@
+#include "Forces.h"
+
+#include <cmath>
+
+#include <fmt/core.h>
+
+Forces::Forces(int interval, float diameter)
+	: mInterval(interval), mDiameter(diameter), mFile(NULL),
+	  mHead(0), mPending(0), mActive(-1), mStep(0), mNextSample(0), mCd(0.0), mCl(0.0)
+{
+	for (int i = 0; i < NUM_SLOTS; i++)
+	{
+		mFence[i] = 0;
+		mSlotStep[i] = 0;
+	}
+}
+
+Forces::~Forces()
+{
+	if (mFile != NULL)
+		fclose(mFile);
+}
+
+bool Forces::init()
+{
+	mBuffer.create("forces", NUM_SLOTS * SLOT_SIZE * sizeof(GLint), NULL, GL_DYNAMIC_READ);
+
+	return true;
+}
+
+void Forces::destroy()
+{
+	for (int i = 0; i < NUM_SLOTS; i++)
+	{
+		if (mFence[i] != 0)
+			glDeleteSync(mFence[i]);
+		mFence[i] = 0;
+	}
+	mPending = 0;
+
+	mBuffer.destroy();
+}
+
+void Forces::setOutput(const char* path)
+{
+	if (mFile != NULL)
+		fclose(mFile);
+	mFile = NULL;
+
+	if (path == NULL)
+		return;
+
+	mFile = fopen(path, "w");
+	if (mFile == NULL)
+	{
+		fmt::println("Unable to open {}, forces go to stdout", path);
+		return;
+	}
+	fmt::println(mFile, "step,fx,fy,fx_walls,fy_walls,u_mean,v_mean,cd,cl");
+}
+
+int Forces::begin(int steps)
+{
+	mActive = -1;
+	if (mInterval <= 0 || mBuffer == 0)
+		return -1;
+
+	collect();
+
+	mStep += steps;
+
+	// A full ring just pushes the sample back
+	if (mStep < mNextSample || mPending == NUM_SLOTS)
+		return -1;
+
+	mActive = mHead;
+	mSlotStep[mActive] = mStep;
+	mNextSample = mStep + mInterval;
+
+	GLint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mBuffer);
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32I, mActive * SLOT_SIZE * sizeof(GLint), SLOT_SIZE * sizeof(GLint),
+		GL_RED_INTEGER, GL_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, mBuffer);
+
+	return mActive;
+}
+
+void Forces::end()
+{
+	if (mActive < 0)
+		return;
+
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	mFence[mActive] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	mHead = (mHead + 1) % NUM_SLOTS;
+	mPending++;
+	mActive = -1;
+}
+
+void Forces::flush()
+{
+	collect(true);
+}
+
+//-----------------------------------------------------------------------------
+// Reads back every slot whose fence has signaled, oldest first, only blocks
+// when asked to wait
+//-----------------------------------------------------------------------------
+void Forces::collect(bool wait)
+{
+	while (mPending > 0)
+	{
+		int slot = (mHead - mPending + NUM_SLOTS) % NUM_SLOTS;
+
+		GLenum status = glClientWaitSync(mFence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			return;
+
+		glDeleteSync(mFence[slot]);
+		mFence[slot] = 0;
+		mPending--;
+
+		GLint sums[SLOT_SIZE];
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mBuffer);
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, slot * SLOT_SIZE * sizeof(GLint), sizeof(sums), sums);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		report(mSlotStep[slot], sums);
+	}
+}
+
+long long Forces::velocitySum(const int* sums, int axis)
+{
+	int lo = 2 * NUM_BODIES + axis;
+	return (long long)sums[lo + HIGH] * 4294967296LL + (unsigned int)sums[lo];
+}
+
+Forces::Sample Forces::decode(const int* sums, float diameter)
+{
+	Sample s;
+	s.fx = sums[0] / FORCE_SCALE;
+	s.fy = sums[1] / FORCE_SCALE;
+	s.wallX = sums[2] / FORCE_SCALE;
+	s.wallY = sums[3] / FORCE_SCALE;
+
+	int cells = sums[2 * NUM_BODIES + 2];
+	s.u = cells > 0 ? velocitySum(sums, 0) / VEL_SCALE / cells : 0.0;
+	s.v = cells > 0 ? velocitySum(sums, 1) / VEL_SCALE / cells : 0.0;
+
+	// Drag along the mean flow, lift across it
+	double speed = std::sqrt(s.u * s.u + s.v * s.v);
+	s.cd = s.cl = 0.0;
+	if (speed > 0.0 && diameter > 0.0f)
+	{
+		double q = 0.5 * speed * speed * diameter;
+		s.cd = (s.fx * s.u + s.fy * s.v) / speed / q;
+		s.cl = (s.fy * s.u - s.fx * s.v) / speed / q;
+	}
+	return s;
+}
+
+void Forces::report(long long step, const int* sums)
+{
+	Sample s = decode(sums, mDiameter);
+	mCd = s.cd;
+	mCl = s.cl;
+
+	if (mFile != NULL)
+		fmt::println(mFile, "{},{:.6e},{:.6e},{:.6e},{:.6e},{:.6e},{:.6e},{:.5f},{:.5f}", step, s.fx, s.fy, s.wallX, s.wallY, s.u, s.v, s.cd, s.cl);
+	else
+		fmt::println("LBM step {}: obstacle force ({:+.4e}, {:+.4e}), mean u ({:+.4e}, {:+.4e}), Cd {:.4f}, Cl {:+.4f}",
+			step, s.fx, s.fy, s.u, s.v, s.cd, s.cl);
+}
@@ -0,0 +1,88 @@
+#ifndef FORCES_H
+#define FORCES_H
+
+#include <cstdio>
+
+#include <glad/glad.h>
+
+#include "GpuMemory.h"
+
+// Drag and lift on the obstacle by momentum exchange.
+//
+// The bounce-back branch of shaders/lbm.cs adds 2*f*e_k for every fluid-solid link
+// to per-body sums (obstacle and channel walls), reduced through subgroups and
+// shared memory into one integer atomic per work group, only on the step that
+// carries a readback slot. The velocity sums over every fluid cell take two words
+// each, so they do not wrap on large grids. Each slot gets a fence and is read
+// back a few frames later, so sampling never stalls the solver. The coefficients
+// use the mean fluid velocity as reference, drag is along it and lift across it:
+//
+//   Cd = 2 Fd / (rho U^2 D),  Cl = 2 Fl / (rho U^2 D),  rho = 1
+class Forces
+{
+public:
+	// One slot of the sums in lbm.cs, in lattice units
+	struct Sample
+	{
+		double fx, fy;			// on the obstacle
+		double wallX, wallY;	// on the channel walls
+		double u, v;			// mean fluid velocity
+		double cd, cl;			// 0 without a diameter or flow
+	};
+
+	// Same layout as F_SLOT_SIZE in shaders/lbm.cs
+	static const int SLOT_SIZE = 9;
+
+	static Sample decode(const int* sums, float diameter);
+
+	Forces(int interval, float diameter);
+	~Forces();
+
+	// Needs a current context
+	bool init();
+	void destroy();
+
+	// One CSV line per sample instead of stdout; NULL goes back to stdout
+	void setOutput(const char* path);
+
+	// Call before dispatching `steps` steps. Returns the slot to pass as forceSlot
+	// to the last of them, or -1 if none of them is sampled.
+	int begin(int steps);
+	// Call after the dispatches
+	void end();
+
+	// Waits for every sample still in flight and reports it
+	void flush();
+
+	// Coefficients of the last sample reported, 0 before the first
+	double drag() const { return mCd; }
+	double lift() const { return mCl; }
+
+private:
+	// Same layout as NUM_BODIES / *_SCALE in shaders/lbm.cs
+	static const int NUM_SLOTS = 4;
+	static const int NUM_BODIES = 2;
+	static constexpr double FORCE_SCALE = 1048576.0;
+	static constexpr double VEL_SCALE = 16384.0;
+	static const int HIGH = 3;
+
+	// Sum u (0) or v (1) from its low and high word
+	static long long velocitySum(const int* sums, int axis);
+
+	void collect(bool wait = false);
+	void report(long long step, const int* sums);
+
+	int mInterval;
+	float mDiameter;
+	FILE* mFile;
+
+	GpuBuffer mBuffer;
+	GLsync mFence[NUM_SLOTS];
+	long long mSlotStep[NUM_SLOTS];
+	int mHead, mPending, mActive;
+
+	long long mStep, mNextSample;
+	double mCd, mCl;
+};
+
+#endif // FORCES_H
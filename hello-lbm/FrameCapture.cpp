@@ -0,0 +1,305 @@
+#include "FrameCapture.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <fmt/core.h>
+
+// glibc rejects "b" in a popen mode, the Windows pipe needs it not to mangle frames
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#define PIPE_WRITE "wb"
+#else
+#define PIPE_WRITE "w"
+#endif
+
+FrameCapture::FrameCapture()
+	: mRecording(false), mWidth(0), mHeight(0), mFormat(Y4M), mPolicy(DROP),
+	  mHead(0), mPending(0), mOut(NULL), mDone(false),
+	  mCaptured(0), mDropped(0), mWritten(0)
+{
+	for (int i = 0; i < NUM_PBO; i++)
+		mFence[i] = 0;
+}
+
+FrameCapture::~FrameCapture()
+{
+	stop();
+}
+
+//-----------------------------------------------------------------------------
+// Opens the output, allocates the PBO ring and starts the writer thread
+//-----------------------------------------------------------------------------
+bool FrameCapture::start(const std::string& path, int width, int height, int fps, Format format, Policy policy)
+{
+	if (mRecording)
+		stop();
+
+	mWidth = width;
+	mHeight = height;
+	mFormat = format;
+	mPolicy = policy;
+
+	if (format == FFMPEG)
+	{
+		// The framebuffer is bottom-up, let ffmpeg flip it
+		std::string cmd = fmt::format("ffmpeg -loglevel error -y -f rawvideo -pix_fmt rgba -s {}x{} -r {} -i - -vf vflip -c:v libx264 -pix_fmt yuv420p \"{}\"",
+			width, height, fps, path);
+		mOut = popen(cmd.c_str(), PIPE_WRITE);
+	}
+	else
+	{
+		mOut = std::fopen(path.c_str(), "wb");
+		if (mOut != NULL)
+			std::fprintf(mOut, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+	}
+
+	if (mOut == NULL)
+	{
+		fmt::println("Unable to open capture output {}", path);
+		return false;
+	}
+
+	const size_t frameBytes = size_t(width) * height * 4;
+
+	for (int i = 0; i < NUM_PBO; i++)
+	{
+		mPBO[i].create("capture", frameBytes, NULL, GL_STREAM_READ);
+		mFence[i] = 0;
+	}
+
+	mHead = 0;
+	mPending = 0;
+	mCaptured = mDropped = mWritten = 0;
+	mDone = false;
+	mQueue.clear();
+	mFree.assign(QUEUE_DEPTH, std::vector<unsigned char>(frameBytes));
+
+	mWriter = std::thread(&FrameCapture::writerLoop, this);
+	mRecording = true;
+
+	fmt::println("Capture: recording {}x{} to {}", width, height, path);
+	return true;
+}
+
+void FrameCapture::capture()
+{
+	if (!mRecording)
+		return;
+
+	collect(false);
+
+	// Every PBO still has a read in flight
+	if (mPending == NUM_PBO)
+	{
+		if (mPolicy == DROP)
+		{
+			mDropped++;
+			return;
+		}
+		collect(true);
+
+		// The wait timed out or failed, the oldest read is still in flight
+		if (mPending == NUM_PBO)
+		{
+			mDropped++;
+			return;
+		}
+	}
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, mPBO[mHead]);
+	glReadPixels(0, 0, mWidth, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	mFence[mHead] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	mHead = (mHead + 1) % NUM_PBO;
+	mPending++;
+	mCaptured++;
+}
+
+//-----------------------------------------------------------------------------
+// Maps the oldest PBOs whose reads have completed. With wait set, at least the
+// oldest one is waited for.
+//-----------------------------------------------------------------------------
+void FrameCapture::collect(bool wait)
+{
+	while (mPending > 0)
+	{
+		int oldest = (mHead - mPending + NUM_PBO) % NUM_PBO;
+
+		GLenum status = glClientWaitSync(mFence[oldest], 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED && wait)
+			status = glClientWaitSync(mFence[oldest], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+
+		glDeleteSync(mFence[oldest]);
+		mFence[oldest] = 0;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, mPBO[oldest]);
+		const unsigned char* pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size_t(mWidth) * mHeight * 4, GL_MAP_READ_BIT);
+		if (pixels != NULL)
+		{
+			enqueue(pixels);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		mPending--;
+		wait = false;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Copies a mapped frame into a free slot of the writer queue
+//-----------------------------------------------------------------------------
+void FrameCapture::enqueue(const unsigned char* pixels)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	if (mFree.empty())
+	{
+		if (mPolicy == DROP)
+		{
+			mDropped++;
+			return;
+		}
+		mFreed.wait(lock, [this] { return !mFree.empty(); });
+	}
+
+	std::vector<unsigned char> frame = std::move(mFree.back());
+	mFree.pop_back();
+	lock.unlock();
+
+	std::memcpy(frame.data(), pixels, frame.size());
+
+	lock.lock();
+	mQueue.push_back(std::move(frame));
+	mQueued.notify_one();
+}
+
+void FrameCapture::writerLoop()
+{
+	for (;;)
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mQueued.wait(lock, [this] { return mDone || !mQueue.empty(); });
+
+		if (mQueue.empty())
+			return;
+
+		std::vector<unsigned char> frame = std::move(mQueue.front());
+		mQueue.pop_front();
+		lock.unlock();
+
+		if (mFormat == Y4M)
+			writeY4M(frame);
+		else
+			std::fwrite(frame.data(), 1, frame.size(), mOut);
+
+		lock.lock();
+		mWritten++;
+		mFree.push_back(std::move(frame));
+		mFreed.notify_one();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// RGBA (bottom-up) to full range BT.601 YUV 4:2:0 (top-down)
+//-----------------------------------------------------------------------------
+void FrameCapture::writeY4M(const std::vector<unsigned char>& rgba)
+{
+	const int cw = (mWidth + 1) / 2;
+	const int ch = (mHeight + 1) / 2;
+
+	mYUV.resize(size_t(mWidth) * mHeight + 2 * size_t(cw) * ch);
+	unsigned char* Y = mYUV.data();
+	unsigned char* U = Y + size_t(mWidth) * mHeight;
+	unsigned char* V = U + size_t(cw) * ch;
+
+	for (int y = 0; y < mHeight; y++)
+	{
+		const unsigned char* row = &rgba[size_t(mHeight - 1 - y) * mWidth * 4];
+		for (int x = 0; x < mWidth; x++)
+		{
+			int r = row[x * 4 + 0], g = row[x * 4 + 1], b = row[x * 4 + 2];
+			Y[size_t(y) * mWidth + x] = (unsigned char)((77 * r + 150 * g + 29 * b + 128) >> 8);
+		}
+	}
+
+	for (int y = 0; y < ch; y++)
+	{
+		for (int x = 0; x < cw; x++)
+		{
+			// Average the 2x2 block (clamped at odd edges)
+			int r = 0, g = 0, b = 0;
+			for (int dy = 0; dy < 2; dy++)
+			{
+				for (int dx = 0; dx < 2; dx++)
+				{
+					int sx = std::min(2 * x + dx, mWidth - 1);
+					int sy = std::min(2 * y + dy, mHeight - 1);
+					const unsigned char* p = &rgba[(size_t(mHeight - 1 - sy) * mWidth + sx) * 4];
+					r += p[0];
+					g += p[1];
+					b += p[2];
+				}
+			}
+			r /= 4;
+			g /= 4;
+			b /= 4;
+
+			// Saturated blue (U) or red (V) rounds to 256, which would wrap to 0
+			U[size_t(y) * cw + x] = (unsigned char)std::min((-43 * r - 85 * g + 128 * b + 128 * 256 + 128) >> 8, 255);
+			V[size_t(y) * cw + x] = (unsigned char)std::min((128 * r - 107 * g - 21 * b + 128 * 256 + 128) >> 8, 255);
+		}
+	}
+
+	std::fputs("FRAME\n", mOut);
+	std::fwrite(mYUV.data(), 1, mYUV.size(), mOut);
+}
+
+void FrameCapture::stop()
+{
+	if (!mRecording)
+		return;
+
+	// Drain the ring; the writer queue may block here even with DROP
+	Policy policy = mPolicy;
+	mPolicy = BLOCK;
+	for (int i = 0; i < NUM_PBO && mPending > 0; i++)
+		collect(true);
+	mPolicy = policy;
+
+	// Reads that timed out are abandoned, their fences must not outlive the PBOs
+	for (int i = 0; i < NUM_PBO; i++)
+	{
+		if (mFence[i] != 0)
+			glDeleteSync(mFence[i]);
+		mFence[i] = 0;
+	}
+	mPending = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mDone = true;
+	}
+	mQueued.notify_one();
+	mWriter.join();
+
+	if (mFormat == FFMPEG)
+		pclose(mOut);
+	else
+		std::fclose(mOut);
+	mOut = NULL;
+
+	for (int i = 0; i < NUM_PBO; i++)
+		mPBO[i].destroy();
+
+	mRecording = false;
+
+	fmt::println("Capture: {} frames captured, {} written, {} dropped", mCaptured, mWritten, mDropped);
+}
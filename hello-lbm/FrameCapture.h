@@ -0,0 +1,82 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "GpuMemory.h"
+
+// Records the default framebuffer without stalling the render loop.
+//
+// Every frame is read into the next PBO of a small ring with glReadPixels (which
+// only queues the copy) and gets a fence. A PBO is mapped a few frames later,
+// once its fence has signaled, and the pixels are handed to a writer thread
+// through a bounded queue. The writer converts to Y4M or pipes raw RGBA into a
+// local ffmpeg process. All GL calls stay on the thread that owns the context.
+class FrameCapture
+{
+public:
+	enum Format
+	{
+		Y4M,		// raw YUV 4:2:0 stream, playable by ffplay/mpv/vlc
+		FFMPEG		// piped to `ffmpeg`, which has to be on the PATH
+	};
+
+	// What to do when the PBO ring or the writer queue is full
+	enum Policy
+	{
+		DROP,		// skip the frame and count it
+		BLOCK		// wait, the frame rate follows the writer
+	};
+
+	FrameCapture();
+	~FrameCapture();
+
+	bool start(const std::string& path, int width, int height, int fps, Format format, Policy policy);
+	// Call after a frame is rendered, before swapping buffers
+	void capture();
+	// Flushes every pending frame and closes the output
+	void stop();
+
+	bool isRecording() const { return mRecording; }
+
+private:
+	void collect(bool wait);
+	void enqueue(const unsigned char* pixels);
+	void writerLoop();
+	void writeY4M(const std::vector<unsigned char>& rgba);
+
+	static const int NUM_PBO = 3;
+	static const size_t QUEUE_DEPTH = 8;
+
+	bool mRecording;
+	int mWidth, mHeight;
+	Format mFormat;
+	Policy mPolicy;
+
+	GpuBuffer mPBO[NUM_PBO];
+	GLsync mFence[NUM_PBO];
+	int mHead;			// next PBO to read into
+	int mPending;		// PBOs with a read in flight, oldest is (mHead - mPending)
+
+	FILE* mOut;
+	std::vector<unsigned char> mYUV;
+
+	std::thread mWriter;
+	std::mutex mMutex;
+	std::condition_variable mQueued, mFreed;
+	std::deque<std::vector<unsigned char>> mQueue;
+	std::vector<std::vector<unsigned char>> mFree;
+	bool mDone;
+
+	size_t mCaptured, mDropped, mWritten;
+};
+
+#endif // FRAME_CAPTURE_H
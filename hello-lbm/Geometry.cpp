@@ -0,0 +1,302 @@
+#include "Geometry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+
+#include <fmt/core.h>
+
+static const float FAR = std::numeric_limits<float>::max();
+
+//-----------------------------------------------------------------------------
+// Exact squared distance transform of one row or column (Felzenszwalb & Huttenlocher)
+//-----------------------------------------------------------------------------
+static void distanceTransform1D(const float* f, float* d, int n, int* v, float* z)
+{
+	int k = 0;
+	v[0] = 0;
+	z[0] = -FAR;
+	z[1] = FAR;
+	for (int q = 1; q < n; q++)
+	{
+		// Drop the parabolas the new one hides from below
+		float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
+		while (s <= z[k])
+		{
+			k--;
+			s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
+		}
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k + 1] = FAR;
+	}
+
+	k = 0;
+	for (int q = 0; q < n; q++)
+	{
+		while (z[k + 1] < q)
+			k++;
+		d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Squared distance of every pixel to the nearest pixel with seed set
+//-----------------------------------------------------------------------------
+static std::vector<float> distanceTransform(const std::vector<bool>& seed, int w, int h)
+{
+	// Large but finite, so that the parabola intersections stay finite
+	const float inf = 1e20f;
+	int n = std::max(w, h);
+	std::vector<float> grid(size_t(w) * h), f(n), d(n), z(n + 1);
+	std::vector<int> v(n);
+
+	for (size_t i = 0; i < grid.size(); i++)
+		grid[i] = seed[i] ? 0.0f : inf;
+
+	for (int x = 0; x < w; x++)
+	{
+		for (int y = 0; y < h; y++)
+			f[y] = grid[x + y * w];
+		distanceTransform1D(f.data(), d.data(), h, v.data(), z.data());
+		for (int y = 0; y < h; y++)
+			grid[x + y * w] = d[y];
+	}
+	for (int y = 0; y < h; y++)
+	{
+		distanceTransform1D(&grid[y * w], d.data(), w, v.data(), z.data());
+		std::copy(d.begin(), d.begin() + w, grid.begin() + y * w);
+	}
+
+	return grid;
+}
+
+Geometry::Geometry()
+	: mKind(CIRCLE), mMaskW(0), mMaskH(0), mMaskScale(0.0f)
+{
+}
+
+bool Geometry::load(const char* filename)
+{
+	size_t len = strlen(filename);
+	if (len > 4 && strcmp(filename + len - 4, ".pgm") == 0)
+		return loadMask(filename);
+
+	return loadPolygons(filename);
+}
+
+void Geometry::setCircle()
+{
+	mKind = CIRCLE;
+}
+
+//-----------------------------------------------------------------------------
+// PGM mask, pixels darker than half of maxval are solid
+//-----------------------------------------------------------------------------
+bool Geometry::loadMask(const char* filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+	{
+		fmt::println("Unable to open {}", filename);
+		return false;
+	}
+
+	// Header tokens, skipping comments
+	auto token = [&file]()
+	{
+		std::string t;
+		while (file >> t)
+		{
+			if (t[0] != '#')
+				return t;
+			std::getline(file, t);
+		}
+		return std::string();
+	};
+
+	std::string magic = token();
+	int w = std::atoi(token().c_str());
+	int h = std::atoi(token().c_str());
+	int maxval = std::atoi(token().c_str());
+	if ((magic != "P2" && magic != "P5") || w <= 0 || h <= 0 || maxval <= 0 || maxval > 65535)
+	{
+		fmt::println("{} is not a PGM image", filename);
+		return false;
+	}
+
+	std::vector<bool> solid(size_t(w) * h), fluid(size_t(w) * h);
+	if (magic == "P5")
+	{
+		// One whitespace character after maxval, then the raster, 16 bit big endian above 255
+		file.get();
+		int bytes = maxval > 255 ? 2 : 1;
+		std::vector<unsigned char> raster(size_t(w) * h * bytes);
+		if (!file.read((char*)raster.data(), raster.size()))
+		{
+			fmt::println("{} is truncated", filename);
+			return false;
+		}
+		for (size_t i = 0; i < solid.size(); i++)
+		{
+			int value = bytes == 2 ? (raster[2 * i] << 8 | raster[2 * i + 1]) : raster[i];
+			solid[i] = 2 * value < maxval;
+		}
+	}
+	else
+	{
+		for (size_t i = 0; i < solid.size(); i++)
+		{
+			int value;
+			if (!(file >> value))
+			{
+				fmt::println("{} is truncated", filename);
+				return false;
+			}
+			solid[i] = 2 * value < maxval;
+		}
+	}
+
+	// The first row of a PGM is the top of the image, the lattice counts y upwards
+	for (int y = 0; y < h / 2; y++)
+		for (int x = 0; x < w; x++)
+		{
+			bool t = solid[x + y * w];
+			solid[x + y * w] = solid[x + (h - 1 - y) * w];
+			solid[x + (h - 1 - y) * w] = t;
+		}
+	for (size_t i = 0; i < solid.size(); i++)
+		fluid[i] = !solid[i];
+
+	// Pixel centres are half a pixel from the outline between a solid and a fluid pixel
+	std::vector<float> toSolid = distanceTransform(solid, w, h);
+	std::vector<float> toFluid = distanceTransform(fluid, w, h);
+
+	mMaskW = w;
+	mMaskH = h;
+	mMaskScale = 2.0f / std::max(w, h);
+	mMaskSdf.resize(solid.size());
+	for (size_t i = 0; i < solid.size(); i++)
+	{
+		float d = solid[i] ? -(std::sqrt(toFluid[i]) - 0.5f) : std::sqrt(toSolid[i]) - 0.5f;
+		mMaskSdf[i] = d * mMaskScale;
+	}
+
+	mKind = MASK;
+	fmt::println("Obstacle mask {}: {}x{}", filename, w, h);
+	return true;
+}
+
+bool Geometry::loadPolygons(const char* filename)
+{
+	std::ifstream file(filename);
+	if (!file)
+	{
+		fmt::println("Unable to open {}", filename);
+		return false;
+	}
+
+	std::vector<std::vector<glm::vec2>> polygons(1);
+	std::string line;
+	while (std::getline(file, line))
+	{
+		line = line.substr(0, line.find('#'));
+
+		glm::vec2 p;
+		std::istringstream ss(line);
+		if (ss >> p.x >> p.y)
+			polygons.back().push_back(p);
+		else if (line.find_first_not_of(" \t\r") == std::string::npos && !polygons.back().empty())
+			polygons.emplace_back();
+	}
+
+	polygons.erase(std::remove_if(polygons.begin(), polygons.end(),
+		[](const std::vector<glm::vec2>& poly) { return poly.size() < 3; }), polygons.end());
+	if (polygons.empty())
+	{
+		fmt::println("{} has no polygon with 3 or more vertices", filename);
+		return false;
+	}
+
+	mPolygons = polygons;
+	mKind = POLYGONS;
+	fmt::println("Obstacle polygons {}: {}", filename, mPolygons.size());
+	return true;
+}
+
+float Geometry::maskDistance(glm::vec2 p) const
+{
+	// Pixel coordinates, the mask centred in the square
+	float px = (p.x + mMaskW * mMaskScale * 0.5f) / mMaskScale - 0.5f;
+	float py = (p.y + mMaskH * mMaskScale * 0.5f) / mMaskScale - 0.5f;
+
+	// Outside of the image the outline is at least as far as the border
+	float cx = std::clamp(px, 0.0f, mMaskW - 1.0f);
+	float cy = std::clamp(py, 0.0f, mMaskH - 1.0f);
+	float outside = std::sqrt((px - cx) * (px - cx) + (py - cy) * (py - cy)) * mMaskScale;
+
+	int x0 = std::min(int(cx), mMaskW - 2 < 0 ? 0 : mMaskW - 2);
+	int y0 = std::min(int(cy), mMaskH - 2 < 0 ? 0 : mMaskH - 2);
+	int x1 = std::min(x0 + 1, mMaskW - 1);
+	int y1 = std::min(y0 + 1, mMaskH - 1);
+	float tx = cx - x0, ty = cy - y0;
+
+	float d = (1 - tx) * (1 - ty) * mMaskSdf[x0 + y0 * mMaskW] + tx * (1 - ty) * mMaskSdf[x1 + y0 * mMaskW]
+		+ (1 - tx) * ty * mMaskSdf[x0 + y1 * mMaskW] + tx * ty * mMaskSdf[x1 + y1 * mMaskW];
+	return d + outside;
+}
+
+float Geometry::polygonDistance(glm::vec2 p) const
+{
+	float d2 = FAR;
+	bool inside = false;
+
+	for (const std::vector<glm::vec2>& poly : mPolygons)
+	{
+		for (size_t i = 0, j = poly.size() - 1; i < poly.size(); j = i++)
+		{
+			glm::vec2 a = poly[j], b = poly[i];
+
+			glm::vec2 ab = b - a, ap = p - a;
+			float t = std::clamp(glm::dot(ap, ab) / glm::dot(ab, ab), 0.0f, 1.0f);
+			glm::vec2 e = ap - t * ab;
+			d2 = std::min(d2, glm::dot(e, e));
+
+			if ((a.y > p.y) != (b.y > p.y) && p.x < a.x + (p.y - a.y) / (b.y - a.y) * (b.x - a.x))
+				inside = !inside;
+		}
+	}
+
+	return inside ? -std::sqrt(d2) : std::sqrt(d2);
+}
+
+float Geometry::distance(glm::vec2 p) const
+{
+	switch (mKind)
+	{
+	case MASK:
+		return maskDistance(p);
+	case POLYGONS:
+		return polygonDistance(p);
+	default:
+		return glm::length(p) - 1.0f;
+	}
+}
+
+void Geometry::rasterize(float cx, float cy, float r, int nx, int ny, std::vector<float>& sdf) const
+{
+	sdf.assign(size_t(nx) * ny, FAR);
+
+	// The shape stays inside its square, two cells around it cover every cut link
+	int x0 = std::max(int(std::floor(cx - r)) - 2, 0), x1 = std::min(int(std::ceil(cx + r)) + 2, nx - 1);
+	int y0 = std::max(int(std::floor(cy - r)) - 2, 0), y1 = std::min(int(std::ceil(cy + r)) + 2, ny - 1);
+
+	for (int y = y0; y <= y1; y++)
+		for (int x = x0; x <= x1; x++)
+			sdf[x + y * nx] = r * distance(glm::vec2((x - cx) / r, (y - cy) / r));
+}
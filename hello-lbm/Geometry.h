@@ -0,0 +1,52 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <vector>
+
+#include "glm/glm.hpp"
+
+// Obstacle shape as a signed distance field.
+//
+// The shape lives in its own [-1, 1] square: the unit circle by default, the dark
+// pixels of a PGM mask (longer side across the square), or polygons from a text
+// file. rasterize() places it on the lattice like updateObstacle() always placed
+// its circle, centre and radius in cells, and returns the distance of every cell
+// centre to the outline: negative inside. CurvedBoundary cuts the links with it.
+//
+// Polygon files hold one "x y" vertex per line, a blank line starts the next
+// polygon and '#' starts a comment. Inside is even-odd over all polygons, so an
+// inner polygon makes a hole.
+class Geometry
+{
+public:
+	Geometry();
+
+	// PGM (P2 or P5) when the name ends in .pgm, polygons otherwise. Keeps the
+	// previous shape when loading fails.
+	bool load(const char* filename);
+	void setCircle();
+
+	// sdf gets nx * ny distances in cells
+	void rasterize(float cx, float cy, float r, int nx, int ny, std::vector<float>& sdf) const;
+
+private:
+	enum Kind { CIRCLE, MASK, POLYGONS };
+
+	bool loadMask(const char* filename);
+	bool loadPolygons(const char* filename);
+
+	// In shape units
+	float distance(glm::vec2 p) const;
+	float maskDistance(glm::vec2 p) const;
+	float polygonDistance(glm::vec2 p) const;
+
+	Kind mKind;
+
+	int mMaskW, mMaskH;
+	float mMaskScale;						// shape units per mask pixel
+	std::vector<float> mMaskSdf;			// per pixel, in shape units
+
+	std::vector<std::vector<glm::vec2>> mPolygons;
+};
+
+#endif // GEOMETRY_H
@@ -0,0 +1,92 @@
+#ifndef GPU_MEMORY_H
+#define GPU_MEMORY_H
+
+#include <cstddef>
+
+#include <glad/glad.h>
+
+// Accounting of the GPU memory each subsystem holds.
+//
+// Buffers and textures made through GpuBuffer and GpuTexture record their size
+// under the subsystem name they were created with ("lattice", "particles", ...)
+// and take it back off when they are destroyed or re-specified. report() prints
+// the live bytes and objects per subsystem next to the peak, so a run can be
+// sized before it is started. With a budget set, an allocation that would take
+// the total over it is warned about before it is made; it still goes ahead, the
+// driver is the one that fails or pages.
+//
+// The counts are what was asked for; drivers round up and keep their own copies,
+// so the real footprint is somewhat larger. Thread safe, the simulation thread
+// allocates too.
+class GpuMemory
+{
+public:
+	// 0 is no budget
+	static void setBudget(size_t bytes);
+
+	static void allocate(const char* subsystem, size_t bytes, int objects);
+	static void release(const char* subsystem, size_t bytes, int objects);
+
+	static size_t liveBytes();
+	static int liveObjects();
+
+	// One line per subsystem that allocated anything
+	static void report(const char* title = "GPU memory");
+};
+
+// A buffer object whose storage is counted under its subsystem. Converts to its
+// GLuint, so it binds like one.
+//
+// The wrappers live in globals that outlive the context, so the destructor never
+// calls GL; destroy() has to, like every other init/destroy pair here. A wrapper
+// still holding a buffer when it goes away is reported as leaked.
+class GpuBuffer
+{
+public:
+	GpuBuffer();
+	~GpuBuffer();
+
+	GpuBuffer(const GpuBuffer&) = delete;
+	GpuBuffer& operator=(const GpuBuffer&) = delete;
+
+	// glBufferData, generates the buffer the first time and re-specifies it after
+	void create(const char* subsystem, size_t bytes, const void* data, GLenum usage);
+	// glBufferStorage (GL 4.4), immutable so only once per destroy()
+	void createStorage(const char* subsystem, size_t bytes, const void* data, GLbitfield flags);
+	void destroy();
+
+	operator GLuint() const { return mHandle; }
+	size_t bytes() const { return mBytes; }
+
+private:
+	void account(const char* subsystem, size_t bytes);
+
+	GLuint mHandle;
+	size_t mBytes;
+	const char* mSubsystem;
+};
+
+// A 2D texture with immutable storage, counted like GpuBuffer
+class GpuTexture
+{
+public:
+	GpuTexture();
+	~GpuTexture();
+
+	GpuTexture(const GpuTexture&) = delete;
+	GpuTexture& operator=(const GpuTexture&) = delete;
+
+	// glTexStorage2D with one level, leaves the texture bound to GL_TEXTURE_2D for its parameters
+	void create2D(const char* subsystem, GLenum internalFormat, int width, int height);
+	void destroy();
+
+	operator GLuint() const { return mHandle; }
+	size_t bytes() const { return mBytes; }
+
+private:
+	GLuint mHandle;
+	size_t mBytes;
+	const char* mSubsystem;
+};
+
+#endif // GPU_MEMORY_H
@@ -0,0 +1,156 @@
+#include "Lbm3D.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include <fmt/core.h>
+
+static const int NUM_VECTORS = 19;
+static const int C_BND = 0, C_FLD = 1;
+
+// D3Q19 weights, same order as shaders/lbm3d.cs
+static const float W[NUM_VECTORS] = { 1.0f / 3.0f,
+	1.0f / 18.0f, 1.0f / 18.0f, 1.0f / 18.0f, 1.0f / 18.0f, 1.0f / 18.0f, 1.0f / 18.0f,
+	1.0f / 36.0f, 1.0f / 36.0f, 1.0f / 36.0f, 1.0f / 36.0f, 1.0f / 36.0f, 1.0f / 36.0f,
+	1.0f / 36.0f, 1.0f / 36.0f, 1.0f / 36.0f, 1.0f / 36.0f, 1.0f / 36.0f, 1.0f / 36.0f };
+
+Lbm3D::Lbm3D()
+	: mNX(0), mNY(0), mNZ(0), mCurrent(0), mVAO(0)
+{
+}
+
+bool Lbm3D::init(int nx, int ny, int nz)
+{
+	if (!mStep.loadComputeShader("shaders/lbm3d.cs") || !mSlice.loadComputeShader("shaders/slice3d.cs"))
+		return false;
+	if (!mDraw.loadShaders("shaders/vert_screen.glsl", "shaders/frag_screen.glsl"))
+		return false;
+
+	mNX = nx;
+	mNY = ny;
+	mNZ = nz;
+	mCurrent = 0;
+
+	// Fluid at rest, one plane of equal values per direction
+	size_t n = cells();
+	std::vector<float> rest(n * NUM_VECTORS);
+	for (int k = 0; k < NUM_VECTORS; k++)
+		std::fill(rest.begin() + k * n, rest.begin() + (k + 1) * n, W[k]);
+
+	for (int i = 0; i < 2; i++)
+		mF[i].create("lbm3d", rest.size() * sizeof(float), rest.data(), GL_DYNAMIC_COPY);
+	mFlags.create("lbm3d", n * sizeof(int), NULL, GL_DYNAMIC_DRAW);
+	mUploads.init(2 * n * sizeof(int));
+	setObstacle(-1.0f, -1.0f, -1.0f, 0.0f);
+
+	mTexture.create2D("lbm3d", GL_RGBA8, mNX, mNY);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenVertexArrays(1, &mVAO);
+
+	return true;
+}
+
+void Lbm3D::destroy()
+{
+	mF[0].destroy();
+	mF[1].destroy();
+	mFlags.destroy();
+	mTexture.destroy();
+	glDeleteVertexArrays(1, &mVAO);
+	mVAO = 0;
+
+	mStep.destroy();
+	mSlice.destroy();
+	mDraw.destroy();
+	mUploads.destroy();
+}
+
+void Lbm3D::setObstacle(float cx, float cy, float cz, float r)
+{
+	if (mFlags == 0)
+		return;
+
+	int* flags = (int*)mUploads.map(cells() * sizeof(int));
+
+	for (int z = 0; z < mNZ; z++)
+		for (int y = 0; y < mNY; y++)
+			for (int x = 0; x < mNX; x++)
+			{
+				bool wall = y == 0 || z == 0 || y == mNY - 1 || z == mNZ - 1;
+				float d = std::sqrt((x - cx) * (x - cx) + (y - cy) * (y - cy) + (z - cz) * (z - cz));
+				flags[x + mNX * (y + mNY * z)] = wall || d < r ? C_BND : C_FLD;
+			}
+
+	mUploads.copy(mFlags, 0);
+}
+
+void Lbm3D::step(int steps, float fx, float fy, float fz, float tau)
+{
+	mStep.use();
+	glUniform3i(0, mNX, mNY, mNZ);
+	glUniform3f(1, fx, fy, fz);
+	glUniform1f(2, tau);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mFlags);
+
+	for (int i = 0; i < steps; i++)
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mF[mCurrent]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, mF[1 - mCurrent]);
+		glDispatchCompute((mNX + 7) / 8, (mNY + 7) / 8, (mNZ + 3) / 4);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		mCurrent = 1 - mCurrent;
+	}
+	glUseProgram(0);
+}
+
+void Lbm3D::drawSlice(int z, float maxSpeed)
+{
+	mSlice.use();
+	glUniform3i(0, mNX, mNY, mNZ);
+	glUniform1i(1, std::max(0, std::min(z, mNZ - 1)));
+	glUniform1f(2, maxSpeed);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mF[mCurrent]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mFlags);
+	glBindImageTexture(0, mTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+	glDispatchCompute((mNX + 15) / 16, (mNY + 15) / 16, 1);
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	mDraw.use();
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, mTexture);
+	mDraw.setUniform("screenTexture", 0);
+	glBindVertexArray(mVAO);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(0);
+}
+
+bool runLbm3DBenchmark(const Lbm3DBenchmark& cfg)
+{
+	Lbm3D lbm;
+	if (!lbm.init(cfg.nx, cfg.ny, cfg.nz))
+		return false;
+	lbm.setObstacle(cfg.nx / 4.0f, cfg.ny / 2.0f, cfg.nz / 2.0f, cfg.ny / 8.0f);
+
+	lbm.step(cfg.warmup, cfg.force, 0.0f, 0.0f, cfg.tau);
+	glFinish();
+
+	auto start = std::chrono::steady_clock::now();
+	lbm.step(cfg.steps, cfg.force, 0.0f, 0.0f, cfg.tau);
+	glFinish();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	double updates = double(lbm.cells()) * cfg.steps;
+	double bytes = updates * NUM_VECTORS * 2 * sizeof(float);
+	fmt::println("D3Q19 {}x{}x{}, {} steps in {:.3f} s: {:.1f} MLUPS, {:.1f} GB/s",
+		cfg.nx, cfg.ny, cfg.nz, cfg.steps, seconds, updates / seconds * 1e-6, bytes / seconds * 1e-9);
+
+	lbm.destroy();
+	return true;
+}
@@ -0,0 +1,69 @@
+#ifndef LBM_3D_H
+#define LBM_3D_H
+
+#include <glad/glad.h>
+
+#include "GpuMemory.h"
+#include "ShaderProgram.h"
+#include "UploadRing.h"
+
+// D3Q19 BGK solver, the 3D counterpart of the lbm.cs demo.
+//
+// A duct with walls on the four y/z faces, periodic in x, driven by a body force
+// around the same sphere obstacle the 2D demo drags around. shaders/lbm3d.cs keeps
+// the populations as structure of arrays (f[k * cells + idx]) so that the 8x8x4
+// work groups read and write whole cache lines for every direction, and it only
+// stores populations: nothing per step is spent on velocity fields.
+//
+// For display shaders/slice3d.cs reduces a single z plane to speeds in an RGBA8
+// texture, drawn as one fullscreen triangle. That costs a plane, not a volume, per frame.
+class Lbm3D
+{
+public:
+	Lbm3D();
+
+	// Needs a current context; nx, ny, nz need not be multiples of the work groups
+	bool init(int nx, int ny, int nz);
+	void destroy();
+
+	// Sphere in lattice cells, rebuilds the flags including the duct walls
+	void setObstacle(float cx, float cy, float cz, float r);
+
+	void step(int steps, float fx, float fy, float fz, float tau);
+
+	// Renders the speed on plane z into the current viewport
+	void drawSlice(int z, float maxSpeed);
+
+	int nx() const { return mNX; }
+	int ny() const { return mNY; }
+	int nz() const { return mNZ; }
+	size_t cells() const { return size_t(mNX) * mNY * mNZ; }
+
+private:
+	int mNX, mNY, mNZ;
+	int mCurrent;				// buffer holding the newest populations
+
+	ShaderProgram mStep, mSlice, mDraw;
+	GpuBuffer mF[2], mFlags;
+	GpuTexture mTexture;
+	GLuint mVAO;
+	UploadRing mUploads;		// for the flags
+};
+
+struct Lbm3DBenchmark
+{
+	int nx = 128;
+	int ny = 128;
+	int nz = 128;
+
+	int warmup = 20;
+	int steps = 500;
+	float tau = 0.6f;
+	float force = 1e-6f;
+};
+
+// Steps the duct headless and prints MLUPS and the effective memory bandwidth
+// (19 floats read and written per cell). Needs a current GL 4.3+ context.
+bool runLbm3DBenchmark(const Lbm3DBenchmark& cfg);
+
+#endif // LBM_3D_H
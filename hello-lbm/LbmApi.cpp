@@ -0,0 +1,193 @@
+#include "LbmApi.h"
+
+#include <vector>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <fmt/core.h>
+
+#include "LbmEngine.h"
+
+struct lbm_sim
+{
+	LbmEngine engine;
+	GLFWwindow* window;		// hidden, only when lbm_create() made the context
+};
+
+lbm_config lbm_default_config(void)
+{
+	lbm_config config;
+	config.nx = 640;
+	config.ny = 360;
+	config.tau = 0.631f;
+	config.force_x = -0.000007f;
+	config.force_y = 0.0f;
+	config.collision = 0;
+	config.storage = STORAGE_FP32;
+	config.bouzidi = 1;
+	config.sparse_tiles = 1;
+	config.shader_dir = NULL;
+	return config;
+}
+
+// Hidden windows made by createContext(), and whether it initialized GLFW; then
+// the last destroyContext() terminates it again
+static int sWindows = 0;
+static bool sInitialized = false;
+
+//-----------------------------------------------------------------------------
+// A context of our own when the caller has none
+//-----------------------------------------------------------------------------
+static GLFWwindow* createContext()
+{
+	// A caller that uses GLFW without a current context keeps its GLFW
+	glfwGetError(NULL);
+	glfwGetCurrentContext();
+	bool initialize = glfwGetError(NULL) == GLFW_NOT_INITIALIZED;
+
+	if (!glfwInit())
+	{
+		fmt::println("GLFW initialization failed");
+		return NULL;
+	}
+
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+	GLFWwindow* window = glfwCreateWindow(1, 1, "lbm-engine", NULL, NULL);
+	if (window == NULL)
+	{
+		fmt::println("Failed to create GLFW window");
+		if (initialize)
+			glfwTerminate();
+		return NULL;
+	}
+
+	sInitialized = sInitialized || initialize;
+	sWindows++;
+	glfwMakeContextCurrent(window);
+	return window;
+}
+
+static void destroyContext(GLFWwindow* window)
+{
+	glfwDestroyWindow(window);
+	if (--sWindows == 0 && sInitialized)
+	{
+		glfwTerminate();
+		sInitialized = false;
+	}
+}
+
+lbm_sim* lbm_create(const lbm_config* config)
+{
+	lbm_config c = config != NULL ? *config : lbm_default_config();
+
+	GLFWwindow* window = NULL;
+	if (glfwGetCurrentContext() == NULL)
+	{
+		window = createContext();
+		if (window == NULL)
+			return NULL;
+	}
+	if (!gladLoadGL())
+	{
+		fmt::println("Failed to load OpenGL");
+		if (window != NULL)
+			destroyContext(window);
+		return NULL;
+	}
+
+	if (c.storage < STORAGE_FP32 || c.storage > STORAGE_FP16C)
+	{
+		fmt::println("lbm_create: unknown storage {}", c.storage);
+		c.storage = STORAGE_FP32;
+	}
+
+	if (c.shader_dir != NULL)
+		ShaderProgram::setDirectory(c.shader_dir);
+
+	lbm_sim* sim = new lbm_sim;
+	sim->window = window;
+	if (!sim->engine.init(c.nx, c.ny, (Storage)c.storage, c.bouzidi != 0, c.sparse_tiles != 0))
+	{
+		lbm_destroy(sim);
+		return NULL;
+	}
+
+	sim->engine.setTau(c.tau);
+	sim->engine.setForce(c.force_x, c.force_y);
+	sim->engine.setCollision(c.collision);
+	return sim;
+}
+
+void lbm_destroy(lbm_sim* sim)
+{
+	if (sim == NULL)
+		return;
+
+	sim->engine.destroy();
+	if (sim->window != NULL)
+		destroyContext(sim->window);
+	delete sim;
+}
+
+void lbm_step(lbm_sim* sim, int steps)
+{
+	if (steps > 0)
+		sim->engine.step(steps);
+}
+
+long long lbm_steps(const lbm_sim* sim)
+{
+	return sim->engine.steps();
+}
+
+void lbm_set_force(lbm_sim* sim, float fx, float fy)
+{
+	sim->engine.setForce(fx, fy);
+}
+
+void lbm_set_tau(lbm_sim* sim, float tau)
+{
+	sim->engine.setTau(tau);
+}
+
+void lbm_set_obstacle(lbm_sim* sim, const float* sdf)
+{
+	size_t cells = size_t(sim->engine.nx()) * sim->engine.ny();
+	if (sdf == NULL)
+		sim->engine.setObstacle(std::vector<float>());
+	else
+		sim->engine.setObstacle(std::vector<float>(sdf, sdf + cells));
+}
+
+void lbm_set_obstacle_mask(lbm_sim* sim, const unsigned char* mask)
+{
+	size_t cells = size_t(sim->engine.nx()) * sim->engine.ny();
+	std::vector<float> sdf(cells);
+	for (size_t idx = 0; idx < cells; idx++)
+		sdf[idx] = mask[idx] ? -0.5f : 0.5f;
+	sim->engine.setObstacle(sdf);
+}
+
+int lbm_get_field(lbm_sim* sim, int field, lbm_field* out)
+{
+	if (field < LBM_VELOCITY_X || field > LBM_FLAGS || out == NULL)
+		return -1;
+
+	// lbm_field_id follows LbmEngine::Field
+	LbmEngine::FieldView view = sim->engine.field((LbmEngine::Field)field);
+	out->data = view.data;
+	out->dtype = view.isInt ? LBM_INT32 : LBM_FLOAT32;
+	out->ndim = 2;
+	out->shape[0] = view.rows;
+	out->shape[1] = view.cols;
+	out->strides[0] = view.rowStride;
+	out->strides[1] = view.colStride;
+	out->mapped = view.mapped ? 1 : 0;
+	return 0;
+}
@@ -0,0 +1,97 @@
+#ifndef LBM_API_H
+#define LBM_API_H
+
+/*
+ * C API of the LBM solver, built as the lbm-engine shared library.
+ *
+ * lbm_create() uses the OpenGL context current on the calling thread, or makes
+ * a hidden window with a 4.3 context of its own when there is none. Every call
+ * on a simulation has to come from the thread it was created on.
+ *
+ * lbm_get_field() fills an lbm_field with a pointer to the field and its shape
+ * and byte strides, row-major (ny, nx), the way numpy's array interface wants
+ * them. The pointer stays valid until the next lbm_step() or lbm_destroy().
+ */
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#  if defined(LBM_API_EXPORTS)
+#    define LBM_API __declspec(dllexport)
+#  else
+#    define LBM_API __declspec(dllimport)
+#  endif
+#else
+#  define LBM_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct lbm_sim lbm_sim;
+
+enum lbm_field_id
+{
+    LBM_VELOCITY_X,
+    LBM_VELOCITY_Y,
+    LBM_DENSITY,
+    LBM_PRESSURE,
+    LBM_SPEED,
+    LBM_VORTICITY,
+    LBM_FLAGS           /* 1 fluid, 0 solid */
+};
+
+enum lbm_dtype
+{
+    LBM_FLOAT32,
+    LBM_INT32
+};
+
+typedef struct lbm_config
+{
+    int nx, ny;             /* multiples of 10 */
+    float tau;
+    float force_x, force_y;
+    int collision;          /* 0 BGK, 1 MRT, 2 cumulant */
+    int storage;            /* 0 fp32, 1 fp16, 2 shifted fp16, 3 compressed fp16 */
+    int bouzidi;            /* interpolated bounce-back, fp32 only */
+    int sparse_tiles;       /* skip tiles without fluid */
+    const char* shader_dir; /* where shaders/lbm.cs is, NULL for the working directory */
+} lbm_config;
+
+typedef struct lbm_field
+{
+    const void* data;
+    int dtype;              /* lbm_dtype */
+    int ndim;               /* always 2 */
+    size_t shape[2];        /* ny, nx */
+    size_t strides[2];      /* in bytes */
+    int mapped;             /* data points into GPU-written mapped memory */
+} lbm_field;
+
+LBM_API lbm_config lbm_default_config(void);
+
+/* NULL on failure, the reason is printed */
+LBM_API lbm_sim* lbm_create(const lbm_config* config);
+LBM_API void lbm_destroy(lbm_sim* sim);
+
+LBM_API void lbm_step(lbm_sim* sim, int steps);
+LBM_API long long lbm_steps(const lbm_sim* sim);
+
+LBM_API void lbm_set_force(lbm_sim* sim, float fx, float fy);
+LBM_API void lbm_set_tau(lbm_sim* sim, float tau);
+
+/* nx * ny signed distances in cells, negative in the solid; NULL removes the obstacle */
+LBM_API void lbm_set_obstacle(lbm_sim* sim, const float* sdf);
+/* nx * ny bytes, non-zero for solid; the wall is put half-way between cells */
+LBM_API void lbm_set_obstacle_mask(lbm_sim* sim, const unsigned char* mask);
+
+/* 0 on success */
+LBM_API int lbm_get_field(lbm_sim* sim, int field, lbm_field* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LBM_API_H */
@@ -0,0 +1,305 @@
+#include "LbmEngine.h"
+
+#include <fmt/core.h>
+
+// Same values as OUT_* in shaders/lbm.cs
+static const int OUT_VELOCITY = 1;
+static const int OUT_FIELDS = 2;
+
+LbmEngine::LbmEngine()
+	: mNX(0), mNY(0), mStorage(STORAGE_FP32), mSparse(false),
+	  mFx(0.0f), mFy(0.0f), mTau(0.6f), mSmagorinsky(0.0f), mCollision(0), mBouzidi(false), mForces(NULL),
+	  mCurrent(0), mSteps(0), mMapped(NULL)
+{
+}
+
+bool LbmEngine::init(int nx, int ny, Storage storage, bool bouzidi, bool sparse)
+{
+	if (nx <= 0 || ny <= 0 || nx % 10 != 0 || ny % 10 != 0)
+	{
+		fmt::println("LbmEngine: {} x {} is not a multiple of the 10 x 10 work groups", nx, ny);
+		return false;
+	}
+
+	if (mNX > 0)
+		release();
+
+	if (mProgram.getProgram() == 0 || storage != mStorage)
+	{
+		mProgram.destroy();
+		if (!mProgram.loadComputeShader("shaders/lbm.cs", storageDefines(storage)))
+			return false;
+	}
+
+	mNX = nx;
+	mNY = ny;
+	mStorage = storage;
+	mCurrent = 0;
+	mSteps = 0;
+
+	size_t cells = size_t(nx) * ny;
+	std::vector<unsigned char> rest(cells * storageBytesPerCell(storage));
+	storageFillRest(rest.data(), (int)cells, storage);
+	mF[0].create("lattice", rest.size(), rest.data(), GL_DYNAMIC_COPY);
+	mF[1].create("lattice", rest.size(), rest.data(), GL_DYNAMIC_COPY);
+
+	std::vector<float> zero(4 * cells, 0.0f);
+	mFlags.create("lattice", cells * sizeof(int), NULL, GL_DYNAMIC_COPY);
+	mU.create("fields", cells * sizeof(float), zero.data(), GL_DYNAMIC_COPY);
+	mV.create("fields", cells * sizeof(float), zero.data(), GL_DYNAMIC_COPY);
+	mFields.create("fields", 4 * cells * sizeof(float), zero.data(), GL_DYNAMIC_COPY);
+	mUploads.init(rest.size());
+
+	// Both velocities, the packed fields and the flags
+	size_t readbackBytes = 7 * cells * sizeof(float);
+	if (GLAD_GL_VERSION_4_4)
+	{
+		GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		mReadback.createStorage("readback", readbackBytes, NULL, flags | GL_CLIENT_STORAGE_BIT);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mReadback);
+		mMapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, readbackBytes, flags);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	else
+	{
+		mReadback.create("readback", readbackBytes, NULL, GL_STREAM_READ);
+		mHost.resize(7 * cells);
+	}
+
+	if (bouzidi && storage != STORAGE_FP32)
+		fmt::println("LbmEngine: Bouzidi bounce-back needs FP32 storage, running half-way");
+	mBouzidi = bouzidi && storage == STORAGE_FP32 && mCurvedBoundary.init(nx, ny);
+
+	setObstacle(std::vector<float>());
+
+	// Builds its first tile list from the flags bound at 2
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mFlags);
+	mSparse = sparse && mSparseTiles.init(nx, ny);
+
+	return true;
+}
+
+void LbmEngine::destroy()
+{
+	release();
+	mProgram.destroy();
+}
+
+void LbmEngine::release()
+{
+	if (mReadback != 0 && mMapped != NULL)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mReadback);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	mF[0].destroy();
+	mF[1].destroy();
+	mFlags.destroy();
+	mU.destroy();
+	mV.destroy();
+	mFields.destroy();
+	mReadback.destroy();
+	mMapped = NULL;
+	mHost.clear();
+	mUploads.destroy();
+
+	if (mBouzidi)
+		mCurvedBoundary.destroy();
+	if (mSparse)
+		mSparseTiles.destroy();
+	mBouzidi = mSparse = false;
+
+	mNX = mNY = 0;
+}
+
+void LbmEngine::reset()
+{
+	size_t cells = size_t(mNX) * mNY;
+	size_t latticeBytes = cells * storageBytesPerCell(mStorage);
+	for (int i = 0; i < 2; i++)
+	{
+		storageFillRest(mUploads.map(latticeBytes), (int)cells, mStorage);
+		mUploads.copy(mF[i], 0);
+	}
+
+	float zero = 0.0f;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mU);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32F, GL_RED, GL_FLOAT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mV);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32F, GL_RED, GL_FLOAT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mFields);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32F, GL_RED, GL_FLOAT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	mCurrent = 0;
+	mSteps = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Flags, Bouzidi links and tile list from a signed distance field
+//-----------------------------------------------------------------------------
+void LbmEngine::setObstacle(const std::vector<float>& sdf)
+{
+	size_t cells = size_t(mNX) * mNY;
+	std::vector<float> dist = sdf.size() == cells ? sdf : std::vector<float>(cells, 1.0f);
+
+	int* flags = (int*)mUploads.map(cells * sizeof(int));
+	for (size_t idx = 0; idx < cells; idx++)
+		flags[idx] = dist[idx] < 0.0f ? 0 : 1;
+	for (int x = 0; x < mNX; x++)
+		flags[x] = flags[x + (mNY - 1) * mNX] = 0;
+	mUploads.copy(mFlags, 0);
+
+	if (mBouzidi)
+		mCurvedBoundary.update(dist);
+
+	if (mSparse)
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mFlags);
+		mSparseTiles.rebuild();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// One lbm.cs pass per step, each followed by the Bouzidi links
+//-----------------------------------------------------------------------------
+void LbmEngine::schedule(PassScheduler& passes, const StepSetup& setup, int steps, int& current,
+	const std::function<void(GLuint src, GLuint dst)>& afterStep)
+{
+	for (int i = 0; i < steps; i++)
+	{
+		GLuint src = setup.f[current], dst = setup.f[1 - current];
+		current = 1 - current;
+		bool last = i == steps - 1;
+
+		// Only the swapped pair and the uniforms of the last step change between steps
+		Pass lbm;
+		lbm.program = setup.program;
+		lbm.bind(0, src).bind(1, dst).bind(2, setup.flags).bind(3, setup.u).bind(4, setup.v).bind(6, setup.fields);
+		lbm.uniform(0, setup.nx).uniform(1, setup.ny).uniform(2, setup.fx).uniform(3, setup.fy);
+		lbm.uniform(4, last ? setup.forceSlot : -1).uniform(5, setup.collision).uniform(6, setup.tau).uniform(7, setup.smagorinsky);
+		lbm.uniform(8, setup.sparse != NULL ? 1 : 0);
+		lbm.uniform(9, last ? setup.outputs : 0);
+		lbm.read(src).read(setup.flags).write(dst);
+		if (last)
+			lbm.write(setup.u).write(setup.v).write(setup.fields);
+		SparseTiles* sparse = setup.sparse;
+		int nx = setup.nx, ny = setup.ny;
+		lbm.dispatch = [sparse, nx, ny] {
+			if (sparse != NULL)
+				sparse->dispatch();
+			else
+				glDispatchCompute(nx / 10, ny / 10, 1);
+		};
+		passes.add(lbm);
+
+		if (setup.curved != NULL)
+			setup.curved->schedule(passes, dst);
+		if (afterStep)
+			afterStep(src, dst);
+	}
+}
+
+void LbmEngine::step(int steps)
+{
+	StepSetup setup;
+	setup.program = mProgram.getProgram();
+	setup.f[0] = mF[0];
+	setup.f[1] = mF[1];
+	setup.flags = mFlags;
+	setup.u = mU;
+	setup.v = mV;
+	setup.fields = mFields;
+	setup.nx = mNX;
+	setup.ny = mNY;
+	setup.fx = mFx;
+	setup.fy = mFy;
+	setup.tau = mTau;
+	setup.smagorinsky = mSmagorinsky;
+	setup.collision = mCollision;
+	setup.forceSlot = mForces != NULL ? mForces->begin(steps) : -1;
+	setup.outputs = OUT_VELOCITY | OUT_FIELDS;
+	setup.sparse = mSparse ? &mSparseTiles : NULL;
+	setup.curved = mBouzidi ? &mCurvedBoundary : NULL;
+
+	schedule(mPasses, setup, steps, mCurrent);
+
+	mPasses.run();
+	if (mForces != NULL)
+		mForces->end();
+	mSteps += steps;
+}
+
+size_t LbmEngine::regionOffset(Field f) const
+{
+	size_t cells = size_t(mNX) * mNY;
+	switch (f)
+	{
+	case VELOCITY_X: return 0;
+	case VELOCITY_Y: return cells;
+	case FLAGS: return 6 * cells;
+	default: return 2 * cells;		// the packed fields, copied whole
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Copies the buffer behind a field into its region of the readback buffer
+//-----------------------------------------------------------------------------
+LbmEngine::FieldView LbmEngine::field(Field f)
+{
+	size_t cells = size_t(mNX) * mNY;
+
+	GLuint source = mFields;
+	size_t count = 4 * cells;
+	if (f == VELOCITY_X || f == VELOCITY_Y || f == FLAGS)
+	{
+		source = f == VELOCITY_X ? mU : f == VELOCITY_Y ? mV : mFlags;
+		count = cells;
+	}
+
+	// The steps wrote it from a shader, the copy is a buffer update command
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	size_t offset = regionOffset(f) * sizeof(float);
+	glBindBuffer(GL_COPY_READ_BUFFER, source);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mReadback);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset, count * sizeof(float));
+
+	const char* base;
+	if (mMapped != NULL)
+	{
+		// Coherent, the fence is all it takes for the copy to be visible
+		GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(fence);
+		base = (const char*)mMapped;
+	}
+	else
+	{
+		glGetBufferSubData(GL_COPY_WRITE_BUFFER, offset, count * sizeof(float), (char*)mHost.data() + offset);
+		base = (const char*)mHost.data();
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	FieldView view;
+	view.data = base + offset;
+	view.isInt = f == FLAGS;
+	view.rows = mNY;
+	view.cols = mNX;
+	view.rowStride = mNX * sizeof(float);
+	view.colStride = sizeof(float);
+	view.mapped = mMapped != NULL;
+
+	// rho, pressure, speed and vorticity of one cell are next to each other
+	if (f >= DENSITY && f <= VORTICITY)
+	{
+		view.data = base + offset + (f - DENSITY) * sizeof(float);
+		view.rowStride *= 4;
+		view.colStride *= 4;
+	}
+
+	return view;
+}
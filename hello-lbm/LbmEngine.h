@@ -0,0 +1,141 @@
+#ifndef LBM_ENGINE_H
+#define LBM_ENGINE_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "CurvedBoundary.h"
+#include "Forces.h"
+#include "GpuMemory.h"
+#include "PassScheduler.h"
+#include "ShaderProgram.h"
+#include "SparseTiles.h"
+#include "Storage.h"
+#include "UploadRing.h"
+
+// The 2D solver of the demo without the window, particles or views, for driving
+// it from other programs (see LbmApi.h for the C API around it).
+//
+// Same lbm.cs step, storage modes, Bouzidi links and sparse tiles as main.cpp,
+// the steps of a step() call go through one PassScheduler run. The last step of
+// every call writes the velocity and the packed fields, so field() always sees
+// the newest state.
+//
+// field() copies one field into a readback buffer and returns a view of it with
+// its shape and strides, nothing is converted or repacked: the density of the
+// packed fields is every fourth float. The readback buffer is persistently
+// mapped where glBufferStorage exists (GL 4.4), so the view points straight at
+// memory the GPU wrote, otherwise it is a host copy. A view stays valid until
+// the next step().
+class LbmEngine
+{
+public:
+	enum Field
+	{
+		VELOCITY_X,
+		VELOCITY_Y,
+		DENSITY,
+		PRESSURE,
+		SPEED,
+		VORTICITY,
+		FLAGS,				// 1 fluid, 0 solid
+		NUM_FIELDS
+	};
+
+	struct FieldView
+	{
+		const void* data;
+		bool isInt;			// int32 elements, float32 otherwise
+		size_t rows, cols;	// ny, nx
+		size_t rowStride, colStride;	// in bytes
+		bool mapped;		// points into the persistently mapped buffer
+	};
+
+	// Everything the lbm.cs steps of one batch need besides the scheduler
+	struct StepSetup
+	{
+		GLuint program;
+		GLuint f[2];				// the ping-pong populations
+		GLuint flags, u, v, fields;
+		int nx, ny;
+		float fx, fy, tau, smagorinsky;
+		int collision;
+		int forceSlot;				// sampled on the last step, -1 for none
+		int outputs;				// OUT_* of lbm.cs written by the last step
+		SparseTiles* sparse;		// NULL dispatches the whole grid
+		CurvedBoundary* curved;		// NULL for half-way bounce-back only
+	};
+
+	// Queues `steps` steps from f[current] and flips current once per step. afterStep,
+	// when set, queues more passes after each step (the demo's refined patch). Shared by
+	// step() and main.cpp, so both step the same way.
+	static void schedule(PassScheduler& passes, const StepSetup& setup, int steps, int& current,
+		const std::function<void(GLuint src, GLuint dst)>& afterStep = nullptr);
+
+	LbmEngine();
+
+	// Needs a current context; nx and ny multiples of 10. Starts at rest without obstacle.
+	// Calling it again sets up a new grid, lbm.cs is only compiled again for another storage.
+	bool init(int nx, int ny, Storage storage = STORAGE_FP32, bool bouzidi = true, bool sparse = true);
+	void destroy();
+	// Back to rest at step 0 on the same buffers, keeps the obstacle and parameters
+	void reset();
+
+	void setForce(float fx, float fy) { mFx = fx; mFy = fy; }
+	void setTau(float tau) { mTau = tau; }
+	void setCollision(int collision) { mCollision = collision; }
+	void setSmagorinsky(float c) { mSmagorinsky = c; }
+	// Samples drag and lift into forces (already init()ed) from now on, NULL stops
+	void setForces(Forces* forces) { mForces = forces; }
+
+	// nx * ny signed distances in cells, negative in the solid (see Geometry::rasterize);
+	// empty for no obstacle. The channel walls at y = 0 and ny - 1 are always solid.
+	void setObstacle(const std::vector<float>& sdf);
+
+	void step(int steps);
+	FieldView field(Field f);
+
+	int nx() const { return mNX; }
+	int ny() const { return mNY; }
+	Storage storage() const { return mStorage; }
+	bool bouzidi() const { return mBouzidi; }
+	bool sparse() const { return mSparse; }
+	long long steps() const { return mSteps; }
+
+private:
+	// Everything but the program
+	void release();
+
+	// Floats in the readback buffer per field, each field has its own region
+	size_t regionOffset(Field f) const;
+
+	int mNX, mNY;
+	Storage mStorage;
+	bool mSparse;
+
+	float mFx, mFy, mTau, mSmagorinsky;
+	int mCollision;
+
+	ShaderProgram mProgram;
+	PassScheduler mPasses;
+	CurvedBoundary mCurvedBoundary;
+	SparseTiles mSparseTiles;
+	bool mBouzidi;
+	Forces* mForces;
+
+	GpuBuffer mF[2];			// populations, mF[mCurrent] is the newest
+	GpuBuffer mFlags, mU, mV, mFields;
+	int mCurrent;
+	long long mSteps;
+
+	UploadRing mUploads;
+
+	GpuBuffer mReadback;
+	void* mMapped;				// NULL without glBufferStorage
+	std::vector<float> mHost;	// the readback without a mapping
+};
+
+#endif // LBM_ENGINE_H
@@ -0,0 +1,201 @@
+#include "LbmEnsemble.h"
+
+#include <fmt/core.h>
+
+// Same values as OUT_* in shaders/lbm.cs
+static const int OUT_VELOCITY = 1;
+static const int OUT_FIELDS = 2;
+
+LbmEnsemble::LbmEnsemble()
+	: mNX(0), mNY(0), mMembers(0), mStorage(STORAGE_FP32), mSmagorinsky(0.0f), mCollision(0),
+	  mCurrent(0), mSteps(0), mParamsDirty(false)
+{
+}
+
+bool LbmEnsemble::init(int nx, int ny, int members, Storage storage)
+{
+	if (nx <= 0 || ny <= 0 || nx % 10 != 0 || ny % 10 != 0 || members <= 0)
+	{
+		fmt::println("LbmEnsemble: {} domains of {} x {} do not fit the 10 x 10 work groups", members, nx, ny);
+		return false;
+	}
+
+	GLint maxGroupsZ = 0;
+	glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 2, &maxGroupsZ);
+	if (members > maxGroupsZ)
+	{
+		fmt::println("LbmEnsemble: {} domains, at most {} per dispatch", members, maxGroupsZ);
+		return false;
+	}
+
+	if (mNX > 0)
+		destroy();
+
+	if (!mProgram.loadComputeShader("shaders/lbm.cs", "#define ENSEMBLE\n" + storageDefines(storage)))
+		return false;
+
+	mNX = nx;
+	mNY = ny;
+	mMembers = members;
+	mStorage = storage;
+	mCurrent = 0;
+	mSteps = 0;
+
+	size_t cells = size_t(nx) * ny * members;
+	std::vector<unsigned char> rest(cells * storageBytesPerCell(storage));
+	storageFillRest(rest.data(), (int)cells, storage);
+	mF[0].create("ensemble", rest.size(), rest.data(), GL_DYNAMIC_COPY);
+	mF[1].create("ensemble", rest.size(), rest.data(), GL_DYNAMIC_COPY);
+
+	std::vector<float> zero(4 * cells, 0.0f);
+	mFlags.create("ensemble", cells * sizeof(int), NULL, GL_DYNAMIC_COPY);
+	mU.create("ensemble", cells * sizeof(float), zero.data(), GL_DYNAMIC_COPY);
+	mV.create("ensemble", cells * sizeof(float), zero.data(), GL_DYNAMIC_COPY);
+	mFields.create("ensemble", 4 * cells * sizeof(float), zero.data(), GL_DYNAMIC_COPY);
+	mForces.create("ensemble", members * Forces::SLOT_SIZE * sizeof(GLint), NULL, GL_DYNAMIC_READ);
+
+	Params rest0 = { 0.0f, 0.0f, 0.6f, 0.0f };
+	mParamsCpu.assign(members, rest0);
+	mParams.create("ensemble", members * sizeof(Params), mParamsCpu.data(), GL_DYNAMIC_DRAW);
+	mParamsDirty = false;
+
+	mUploads.init(size_t(nx) * ny * sizeof(int));
+	mHost.resize(7 * size_t(nx) * ny);
+
+	for (int m = 0; m < members; m++)
+		setObstacle(m, std::vector<float>());
+
+	return true;
+}
+
+void LbmEnsemble::destroy()
+{
+	mF[0].destroy();
+	mF[1].destroy();
+	mFlags.destroy();
+	mU.destroy();
+	mV.destroy();
+	mFields.destroy();
+	mParams.destroy();
+	mForces.destroy();
+	mUploads.destroy();
+	mProgram.destroy();
+	mHost.clear();
+	mParamsCpu.clear();
+
+	mNX = mNY = mMembers = 0;
+}
+
+void LbmEnsemble::setMember(int member, float fx, float fy, float tau)
+{
+	Params p = { fx, fy, tau, 0.0f };
+	mParamsCpu[member] = p;
+	mParamsDirty = true;
+}
+
+//-----------------------------------------------------------------------------
+// Flags of one domain from a signed distance field, walls at y = 0 and ny - 1
+//-----------------------------------------------------------------------------
+void LbmEnsemble::setObstacle(int member, const std::vector<float>& sdf)
+{
+	size_t cells = size_t(mNX) * mNY;
+
+	int* flags = (int*)mUploads.map(cells * sizeof(int));
+	for (size_t idx = 0; idx < cells; idx++)
+		flags[idx] = sdf.size() == cells && sdf[idx] < 0.0f ? 0 : 1;
+	for (int x = 0; x < mNX; x++)
+		flags[x] = flags[x + (mNY - 1) * mNX] = 0;
+	mUploads.copy(mFlags, member * cells * sizeof(int));
+}
+
+void LbmEnsemble::step(int steps)
+{
+	if (mParamsDirty)
+	{
+		mUploads.upload(mParams, 0, mParamsCpu.data(), mParamsCpu.size() * sizeof(Params));
+		mParamsDirty = false;
+	}
+
+	// Every domain sums into its own slot of the last step
+	GLint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mForces);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32I, GL_RED_INTEGER, GL_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	for (int i = 0; i < steps; i++)
+	{
+		GLuint src = mF[mCurrent], dst = mF[1 - mCurrent];
+		mCurrent = 1 - mCurrent;
+		bool last = i == steps - 1;
+
+		Pass lbm;
+		lbm.program = mProgram.getProgram();
+		lbm.bind(0, src).bind(1, dst).bind(2, mFlags).bind(3, mU).bind(4, mV).bind(6, mFields);
+		lbm.bind(8, mForces).bind(9, mParams);
+		lbm.uniform(0, mNX).uniform(1, mNY);
+		lbm.uniform(4, last ? 0 : -1).uniform(5, mCollision).uniform(7, mSmagorinsky);
+		lbm.uniform(9, last ? OUT_VELOCITY | OUT_FIELDS : 0);
+		lbm.read(src).read(mFlags).read(mParams).write(dst);
+		if (last)
+			lbm.write(mU).write(mV).write(mFields).write(mForces);
+		lbm.dispatch = [this] { glDispatchCompute(mNX / 10, mNY / 10, mMembers); };
+		mPasses.add(lbm);
+	}
+
+	mPasses.run();
+	// field() and forces() read back with glGetBufferSubData
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	mSteps += steps;
+}
+
+//-----------------------------------------------------------------------------
+// Reads the buffer behind a field back for one domain
+//-----------------------------------------------------------------------------
+LbmEngine::FieldView LbmEnsemble::field(LbmEngine::Field f, int member)
+{
+	size_t cells = size_t(mNX) * mNY;
+
+	GLuint source = mFields;
+	size_t count = 4 * cells;
+	if (f == LbmEngine::VELOCITY_X || f == LbmEngine::VELOCITY_Y || f == LbmEngine::FLAGS)
+	{
+		source = f == LbmEngine::VELOCITY_X ? mU : f == LbmEngine::VELOCITY_Y ? mV : mFlags;
+		count = cells;
+	}
+
+	// Same regions as LbmEngine, so views of different fields can be used together
+	float* region = mHost.data() + (f == LbmEngine::VELOCITY_X ? 0 : f == LbmEngine::VELOCITY_Y ? cells :
+		f == LbmEngine::FLAGS ? 6 * cells : 2 * cells);
+	glBindBuffer(GL_COPY_READ_BUFFER, source);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, member * count * sizeof(float), count * sizeof(float), region);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	LbmEngine::FieldView view;
+	view.data = region;
+	view.isInt = f == LbmEngine::FLAGS;
+	view.rows = mNY;
+	view.cols = mNX;
+	view.rowStride = mNX * sizeof(float);
+	view.colStride = sizeof(float);
+	view.mapped = false;
+
+	// rho, pressure, speed and vorticity of one cell are next to each other
+	if (f >= LbmEngine::DENSITY && f <= LbmEngine::VORTICITY)
+	{
+		view.data = region + (f - LbmEngine::DENSITY);
+		view.rowStride *= 4;
+		view.colStride *= 4;
+	}
+
+	return view;
+}
+
+Forces::Sample LbmEnsemble::forces(int member, float diameter)
+{
+	GLint sums[Forces::SLOT_SIZE];
+	glBindBuffer(GL_COPY_READ_BUFFER, mForces);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, member * sizeof(sums), sizeof(sums), sums);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	return Forces::decode(sums, diameter);
+}
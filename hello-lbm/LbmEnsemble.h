@@ -0,0 +1,89 @@
+#ifndef LBM_ENSEMBLE_H
+#define LBM_ENSEMBLE_H
+
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "Forces.h"
+#include "GpuMemory.h"
+#include "LbmEngine.h"
+#include "PassScheduler.h"
+#include "ShaderProgram.h"
+#include "Storage.h"
+#include "UploadRing.h"
+
+// Many small independent runs of the 2D solver stepped as one.
+//
+// A 256 x 128 lattice is only 328 work groups of lbm.cs, too few to fill a GPU,
+// and a sweep of such runs one after the other pays a dispatch and a barrier per
+// step of each. Here K domains of the same size lie back to back in one set of
+// population, flag, velocity and field buffers. lbm.cs built with ENSEMBLE steps
+// all of them with one (nx / 10, ny / 10, K) dispatch per step: the z of a work
+// group picks the domain, whose body force and tau come from a small buffer of
+// per-domain parameters. Every domain has its own obstacle; collision operator,
+// LES constant and storage are shared. There are no Bouzidi links or sparse
+// tiles, obstacles bounce back half-way.
+//
+// Made for headless sweeps: the last step of every step() call writes the fields
+// and the forces of all domains, field() and forces() read one domain back.
+class LbmEnsemble
+{
+public:
+	LbmEnsemble();
+
+	// Needs a current context; nx and ny multiples of 10. Every domain starts at
+	// rest without obstacle.
+	bool init(int nx, int ny, int members, Storage storage = STORAGE_FP32);
+	void destroy();
+
+	void setMember(int member, float fx, float fy, float tau);
+	void setCollision(int collision) { mCollision = collision; }
+	void setSmagorinsky(float c) { mSmagorinsky = c; }
+	// nx * ny signed distances for one domain, as LbmEngine::setObstacle
+	void setObstacle(int member, const std::vector<float>& sdf);
+
+	void step(int steps);
+
+	// One domain of the newest state, in host memory until field() reads the same
+	// field (or the packed fields) again
+	LbmEngine::FieldView field(LbmEngine::Field f, int member);
+	// Forces on the obstacle of one domain in the last step
+	Forces::Sample forces(int member, float diameter);
+
+	int nx() const { return mNX; }
+	int ny() const { return mNY; }
+	int members() const { return mMembers; }
+	long long steps() const { return mSteps; }
+
+private:
+	// std430 layout of Member in shaders/lbm.cs
+	struct Params
+	{
+		float fx, fy;
+		float tau;
+		float pad;
+	};
+
+	int mNX, mNY, mMembers;
+	Storage mStorage;
+	float mSmagorinsky;
+	int mCollision;
+
+	ShaderProgram mProgram;
+	PassScheduler mPasses;
+
+	GpuBuffer mF[2];				// populations, mF[mCurrent] is the newest
+	GpuBuffer mFlags, mU, mV, mFields;
+	GpuBuffer mParams, mForces;
+	int mCurrent;
+	long long mSteps;
+
+	std::vector<Params> mParamsCpu;
+	bool mParamsDirty;
+
+	UploadRing mUploads;
+	std::vector<float> mHost;		// what field() read back, one region per buffer
+};
+
+#endif // LBM_ENSEMBLE_H
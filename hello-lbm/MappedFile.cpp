@@ -0,0 +1,192 @@
+#include "MappedFile.h"
+
+#include <algorithm>
+
+#include <fmt/core.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+	: mData(NULL), mSize(0), mPageSize(4096),
+#ifdef _WIN32
+	  mFile(INVALID_HANDLE_VALUE), mMapping(NULL)
+#else
+	  mFile(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::pages(size_t& offset, size_t& bytes) const
+{
+	if (mData == NULL || offset >= mSize || bytes == 0)
+		return false;
+
+	size_t end = std::min(offset + bytes, mSize);
+	offset = offset / mPageSize * mPageSize;
+	bytes = end - offset;
+	return true;
+}
+
+#ifdef _WIN32
+//-----------------------------------------------------------------------------
+// Windows
+//-----------------------------------------------------------------------------
+bool MappedFile::open(const std::string& filename, size_t bytes)
+{
+	close();
+
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	mPageSize = info.dwPageSize;
+
+	mFile = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (mFile == INVALID_HANDLE_VALUE)
+	{
+		fmt::println("MappedFile: unable to open {}", filename);
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	size.QuadPart = (LONGLONG)bytes;
+	mMapping = SetFilePointerEx(mFile, size, NULL, FILE_BEGIN) && SetEndOfFile(mFile) ?
+		CreateFileMappingA(mFile, NULL, PAGE_READWRITE, size.HighPart, size.LowPart, NULL) : NULL;
+	mData = mMapping != NULL ? (char*)MapViewOfFile(mMapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes) : NULL;
+	if (mData == NULL)
+	{
+		fmt::println("MappedFile: unable to map {} bytes of {}", bytes, filename);
+		close();
+		return false;
+	}
+
+	mSize = bytes;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (mData != NULL)
+	{
+		FlushViewOfFile(mData, 0);
+		FlushFileBuffers(mFile);
+		UnmapViewOfFile(mData);
+	}
+	if (mMapping != NULL)
+		CloseHandle(mMapping);
+	if (mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+
+	mData = NULL;
+	mMapping = NULL;
+	mFile = INVALID_HANDLE_VALUE;
+	mSize = 0;
+}
+
+void MappedFile::prefetch(size_t offset, size_t bytes)
+{
+	if (!pages(offset, bytes))
+		return;
+
+	WIN32_MEMORY_RANGE_ENTRY range = { mData + offset, bytes };
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+void MappedFile::writeBack(size_t offset, size_t bytes)
+{
+	// Queues the dirty pages for writing, does not wait for the disk
+	if (pages(offset, bytes))
+		FlushViewOfFile(mData + offset, bytes);
+}
+
+void MappedFile::release(size_t offset, size_t bytes)
+{
+	// Unlocking pages that are not locked takes them out of the working set
+	if (pages(offset, bytes))
+		VirtualUnlock(mData + offset, bytes);
+}
+
+#else
+//-----------------------------------------------------------------------------
+// POSIX
+//-----------------------------------------------------------------------------
+bool MappedFile::open(const std::string& filename, size_t bytes)
+{
+	close();
+
+	mPageSize = (size_t)sysconf(_SC_PAGESIZE);
+
+	mFile = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+	if (mFile < 0)
+	{
+		fmt::println("MappedFile: unable to open {}", filename);
+		return false;
+	}
+
+	void* data = ftruncate(mFile, (off_t)bytes) == 0 ?
+		mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, mFile, 0) : MAP_FAILED;
+	if (data == MAP_FAILED)
+	{
+		fmt::println("MappedFile: unable to map {} bytes of {}", bytes, filename);
+		close();
+		return false;
+	}
+
+	mData = (char*)data;
+	mSize = bytes;
+	// Bands are swept front to back, read ahead aggressively
+	madvise(mData, mSize, MADV_SEQUENTIAL);
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (mData != NULL)
+	{
+		msync(mData, mSize, MS_SYNC);
+		munmap(mData, mSize);
+	}
+	if (mFile >= 0)
+		::close(mFile);
+
+	mData = NULL;
+	mFile = -1;
+	mSize = 0;
+}
+
+void MappedFile::prefetch(size_t offset, size_t bytes)
+{
+	if (pages(offset, bytes))
+		madvise(mData + offset, bytes, MADV_WILLNEED);
+}
+
+void MappedFile::writeBack(size_t offset, size_t bytes)
+{
+	if (!pages(offset, bytes))
+		return;
+#ifdef __linux__
+	// Starts the writes and returns, msync(MS_ASYNC) does nothing on Linux
+	sync_file_range(mFile, (off_t)offset, (off_t)bytes, SYNC_FILE_RANGE_WRITE);
+#else
+	msync(mData + offset, bytes, MS_ASYNC);
+#endif
+}
+
+void MappedFile::release(size_t offset, size_t bytes)
+{
+	// Shared file pages only leave this mapping, dirty ones are still written back
+	if (pages(offset, bytes))
+		madvise(mData + offset, bytes, MADV_DONTNEED);
+}
+#endif
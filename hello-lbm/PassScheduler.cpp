@@ -0,0 +1,103 @@
+#include "PassScheduler.h"
+
+#include <algorithm>
+
+static const GLuint UNKNOWN = ~0u;
+
+PassScheduler::PassScheduler()
+	: mProgram(UNKNOWN), mBarriers(0), mStateChanges(0)
+{
+	forget();
+}
+
+void PassScheduler::forget()
+{
+	mProgram = UNKNOWN;
+	std::fill(mBound, mBound + MAX_BINDINGS, UNKNOWN);
+	mUniforms.clear();
+}
+
+bool PassScheduler::dirty(const std::vector<GLuint>& buffers) const
+{
+	for (GLuint b : buffers)
+		if (std::find(mDirty.begin(), mDirty.end(), b) != mDirty.end())
+			return true;
+	return false;
+}
+
+void PassScheduler::run()
+{
+	forget();
+	mDirty.clear();
+	mBarriers = mStateChanges = 0;
+
+	for (const Pass& pass : mPasses)
+	{
+		// Read after write and write after write need the earlier writes to land
+		if (dirty(pass.reads) || dirty(pass.writes))
+		{
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+			mDirty.clear();
+			mBarriers++;
+		}
+
+		// Opaque passes end with their own barrier
+		if (pass.program == 0)
+		{
+			pass.dispatch();
+			forget();
+			continue;
+		}
+
+		if (mProgram != pass.program)
+		{
+			glUseProgram(pass.program);
+			mProgram = pass.program;
+			mStateChanges++;
+		}
+
+		for (const std::pair<GLuint, GLuint>& b : pass.bindings)
+		{
+			if (b.first < MAX_BINDINGS && mBound[b.first] == b.second)
+				continue;
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, b.first, b.second);
+			if (b.first < MAX_BINDINGS)
+				mBound[b.first] = b.second;
+			mStateChanges++;
+		}
+
+		for (const Pass::Uniform& u : pass.uniforms)
+		{
+			auto last = std::find_if(mUniforms.begin(), mUniforms.end(),
+				[&](const std::pair<GLuint, Pass::Uniform>& v) { return v.first == pass.program && v.second.location == u.location; });
+
+			if (last != mUniforms.end() && last->second.isFloat == u.isFloat && last->second.i == u.i && last->second.f == u.f)
+				continue;
+
+			if (u.isFloat)
+				glUniform1f(u.location, u.f);
+			else
+				glUniform1i(u.location, u.i);
+
+			if (last != mUniforms.end())
+				last->second = u;
+			else
+				mUniforms.push_back(std::make_pair(pass.program, u));
+			mStateChanges++;
+		}
+
+		pass.dispatch();
+		mDirty.insert(mDirty.end(), pass.writes.begin(), pass.writes.end());
+	}
+
+	// Whatever comes after the passes reads their results
+	if (!mDirty.empty())
+	{
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		mDirty.clear();
+		mBarriers++;
+	}
+
+	glUseProgram(0);
+	mPasses.clear();
+}
@@ -0,0 +1,79 @@
+#ifndef PASS_SCHEDULER_H
+#define PASS_SCHEDULER_H
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+
+// One compute dispatch and everything it needs: the program, buffer bindings,
+// uniforms and the buffers it reads and writes. The dispatch function only
+// issues the dispatch (and whatever it binds itself, like the indirect buffer).
+//
+// A pass with program 0 is opaque: it sets its own state in the dispatch
+// function (Refinement::step) and ends with a barrier of its own. The scheduler
+// only puts a barrier before it if it reads or writes something still
+// unflushed, and forgets what it knew of the GL state afterwards.
+struct Pass
+{
+	struct Uniform
+	{
+		GLint location;
+		bool isFloat;
+		GLint i;
+		GLfloat f;
+	};
+
+	GLuint program = 0;
+	std::vector<std::pair<GLuint, GLuint>> bindings;	// (SSBO binding, buffer)
+	std::vector<Uniform> uniforms;
+	std::vector<GLuint> reads, writes;
+	std::function<void()> dispatch;
+
+	Pass& bind(GLuint binding, GLuint buffer) { bindings.push_back(std::make_pair(binding, buffer)); return *this; }
+	Pass& uniform(GLint location, GLint value) { uniforms.push_back({ location, false, value, 0.0f }); return *this; }
+	Pass& uniform(GLint location, GLfloat value) { uniforms.push_back({ location, true, 0, value }); return *this; }
+	Pass& read(GLuint buffer) { reads.push_back(buffer); return *this; }
+	Pass& write(GLuint buffer) { writes.push_back(buffer); return *this; }
+};
+
+// Runs a frame worth of passes as a tight sequence of dispatches.
+//
+// Passes are queued with add() and issued by run() in order. A shader storage
+// barrier only goes in when a pass reads or writes a buffer that an earlier
+// pass wrote since the last barrier. Programs, bindings and uniforms are only
+// set when they differ from what the scheduler last set, so a ping-pong pair
+// only rebinds the two buffers that swap and uniforms that are the same on
+// every step are set once. Nothing is cached across run()s, other code changes
+// the same state in between. run() ends with a barrier if anything is still
+// unflushed and with no program in use.
+class PassScheduler
+{
+public:
+	PassScheduler();
+
+	void add(const Pass& pass) { mPasses.push_back(pass); }
+	void run();
+
+	// What the last run() issued
+	int barriers() const { return mBarriers; }
+	int stateChanges() const { return mStateChanges; }
+
+private:
+	static const int MAX_BINDINGS = 16;
+
+	void forget();
+	bool dirty(const std::vector<GLuint>& buffers) const;
+
+	std::vector<Pass> mPasses;
+	std::vector<GLuint> mDirty;		// written since the last barrier
+
+	GLuint mProgram;				// in use, ~0 for unknown
+	GLuint mBound[MAX_BINDINGS];	// per SSBO binding, ~0 for unknown
+	std::vector<std::pair<GLuint, Pass::Uniform>> mUniforms;	// last value per (program, location)
+
+	int mBarriers, mStateChanges;
+};
+
+#endif // PASS_SCHEDULER_H
@@ -0,0 +1,141 @@
+#include "PrecisionCheck.h"
+
+#include <cmath>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <glad/glad.h>
+
+#include "GpuMemory.h"
+#include "ShaderProgram.h"
+#include "Storage.h"
+
+//-----------------------------------------------------------------------------
+// Steps the channel in one storage mode, returns the x-averaged u per row
+//-----------------------------------------------------------------------------
+static std::vector<double> runChannel(const PrecisionConfig& cfg, Storage storage)
+{
+	int cells = cfg.nx * cfg.ny;
+	std::vector<double> profile;
+
+	ShaderProgram program;
+	if (!program.loadComputeShader("shaders/lbm.cs", storageDefines(storage)))
+		return profile;
+
+	size_t latticeBytes = cells * storageBytesPerCell(storage);
+	std::vector<unsigned char> rest(latticeBytes);
+	storageFillRest(rest.data(), cells, storage);
+
+	std::vector<int> flags(cells, 1);
+	for (int x = 0; x < cfg.nx; x++)
+		flags[x] = flags[x + (cfg.ny - 1) * cfg.nx] = 0;
+
+	GpuBuffer buf[6];
+	const size_t sizes[6] = { latticeBytes, latticeBytes, cells * sizeof(int), cells * sizeof(float), cells * sizeof(float), 8 * sizeof(int) };
+	const void* data[6] = { rest.data(), rest.data(), flags.data(), NULL, NULL, NULL };
+	for (int b = 0; b < 6; b++)
+		buf[b].create("precision", sizes[b], data[b], GL_DYNAMIC_COPY);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, buf[2]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, buf[3]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, buf[4]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, buf[5]);
+
+	// Same uniforms as render(), plain BGK without forces
+	program.use();
+	glUniform1i(0, cfg.nx);
+	glUniform1i(1, cfg.ny);
+	glUniform1f(2, cfg.force);
+	glUniform1f(3, 0.0f);
+	glUniform1i(4, -1);
+	glUniform1i(5, 0);
+	glUniform1f(6, cfg.tau);
+	glUniform1f(7, 0.0f);
+
+	int c = 0;
+	for (int i = 0; i < cfg.steps; i++)
+	{
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, c, buf[0]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1 - c, buf[1]);
+		c = 1 - c;
+		glUniform1i(9, i == cfg.steps - 1 ? 1 : 0);	// OUT_VELOCITY
+		glDispatchCompute(cfg.nx / 10, cfg.ny / 10, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+	glUseProgram(0);
+
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	std::vector<float> u(cells);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buf[3]);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, cells * sizeof(float), u.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	profile.assign(cfg.ny, 0.0);
+	for (int y = 1; y < cfg.ny - 1; y++)
+	{
+		for (int x = 0; x < cfg.nx; x++)
+			profile[y] += u[x + y * cfg.nx];
+		profile[y] /= cfg.nx;
+	}
+
+	for (int b = 0; b < 6; b++)
+		buf[b].destroy();
+	program.destroy();
+
+	return profile;
+}
+
+//-----------------------------------------------------------------------------
+// Relative L2 difference over the fluid rows
+//-----------------------------------------------------------------------------
+static double relativeL2(const std::vector<double>& a, const std::vector<double>& b)
+{
+	double num = 0.0, den = 0.0;
+	for (size_t y = 1; y + 1 < a.size(); y++)
+	{
+		num += (a[y] - b[y]) * (a[y] - b[y]);
+		den += b[y] * b[y];
+	}
+	return den > 0.0 ? std::sqrt(num / den) : 0.0;
+}
+
+bool runPrecisionCheck(const PrecisionConfig& cfg)
+{
+	// Half-way bounce-back puts the walls half a cell into the fluid. The velocity shift
+	// forcing of lbm.cs adds omega * F / 2 of momentum per step.
+	double nu = (cfg.tau - 0.5) / 3.0;
+	double g = 0.5 * cfg.force / cfg.tau;
+	double H = cfg.ny - 2;
+
+	std::vector<double> analytic(cfg.ny, 0.0);
+	for (int y = 1; y < cfg.ny - 1; y++)
+	{
+		double yy = y - 0.5;
+		analytic[y] = g / (2.0 * nu) * yy * (H - yy);
+	}
+
+	fmt::println("Poiseuille channel {}x{}, tau {}, {} steps", cfg.nx, cfg.ny, cfg.tau, cfg.steps);
+	fmt::println("{:<10} {:>10} {:>12} {:>14} {:>14}", "storage", "bytes/cell", "u max", "L2 vs FP32", "L2 vs exact");
+
+	std::vector<double> reference;
+	for (int s = 0; s < NUM_STORAGES; s++)
+	{
+		Storage storage = Storage(s);
+		std::vector<double> profile = runChannel(cfg, storage);
+		if (profile.empty())
+			return false;
+
+		if (storage == STORAGE_FP32)
+			reference = profile;
+
+		double umax = 0.0;
+		for (double u : profile)
+			umax = std::fmax(umax, u);
+
+		fmt::println("{:<10} {:>10} {:>12.6f} {:>14.3e} {:>14.3e}", storageName(storage), storageBytesPerCell(storage),
+			umax, relativeL2(profile, reference), relativeL2(profile, analytic));
+	}
+
+	return true;
+}
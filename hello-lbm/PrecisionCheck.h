@@ -0,0 +1,20 @@
+#ifndef PRECISION_CHECK_H
+#define PRECISION_CHECK_H
+
+struct PrecisionConfig
+{
+	// Channel with walls in the first and last row, periodic in x; multiples of the 10x10 groups
+	int nx = 60;
+	int ny = 40;
+
+	int steps = 30000;
+	float tau = 1.0f;
+	float force = 9e-5f;		// about 0.05 peak velocity at tau = 1
+};
+
+// Runs body-force driven Poiseuille flow through shaders/lbm.cs in every distribution
+// storage (see Storage.h) and prints the velocity profile error of each against the
+// FP32 run and against the analytic parabola. Needs a current GL 4.3+ context.
+bool runPrecisionCheck(const PrecisionConfig& cfg);
+
+#endif // PRECISION_CHECK_H
@@ -0,0 +1,180 @@
+#include "Refinement.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const int NUM_VECTORS = 9;
+static const int C_BND = 0, C_FLD = 1, C_GHOST = 2;
+static const int MODE_GHOST = 0, MODE_INIT = 1, MODE_RESTRICT = 2;
+
+Refinement::Refinement()
+	: mNX(0), mNY(0), mCW(0), mCH(0), mFNX(0), mFNY(0), mOriginX(0), mOriginY(0),
+	  mCoarseFlags(0), mCoarseU(0), mCoarseV(0), mCurrent(0)
+{
+}
+
+bool Refinement::init(int nx, int ny, int cw, int ch, GLuint coarseFlags, GLuint coarseU, GLuint coarseV)
+{
+	if (!mProgram.loadComputeShader("shaders/refine.cs"))
+		return false;
+
+	mNX = nx;
+	mNY = ny;
+	mCoarseFlags = coarseFlags;
+	mCoarseU = coarseU;
+	mCoarseV = coarseV;
+
+	// lbm.cs has no bounds checks, the fine lattice (2 per coarse cell plus the ghost
+	// rim) has to be a whole number of 10x10 work groups: round to 5n + 4 coarse cells,
+	// down if it would not leave two cells to the walls
+	auto fit = [](int size, int limit)
+	{
+		size = ((size + 5) / 5) * 5 - 1;
+		return size > limit - 4 ? ((limit - 4 + 1) / 5) * 5 - 1 : size;
+	};
+	mCW = fit(cw, nx);
+	mCH = fit(ch, ny);
+	mFNX = 2 * mCW + 2;
+	mFNY = 2 * mCH + 2;
+
+	size_t cells = size_t(mFNX) * mFNY;
+	mUploads.init(cells * sizeof(int));
+
+	for (int i = 0; i < 2; i++)
+		mFine[i].create("refinement", cells * NUM_VECTORS * sizeof(float), NULL, GL_DYNAMIC_COPY);
+	mFlags.create("refinement", cells * sizeof(int), NULL, GL_DYNAMIC_DRAW);
+	mU.create("refinement", cells * sizeof(float), NULL, GL_DYNAMIC_COPY);
+	mV.create("refinement", cells * sizeof(float), NULL, GL_DYNAMIC_COPY);
+
+	return true;
+}
+
+void Refinement::destroy()
+{
+	mFine[0].destroy();
+	mFine[1].destroy();
+	mFlags.destroy();
+	mU.destroy();
+	mV.destroy();
+	mUploads.destroy();
+
+	mProgram.destroy();
+}
+
+void Refinement::place(const Geometry& geometry, float cx, float cy, float r, GLuint coarse, float tau)
+{
+	if (mFlags == 0)
+		return;
+
+	// Keep two coarse cells between the patch and the channel walls, x is periodic
+	// but the patch does not wrap
+	mOriginX = std::clamp(int(std::floor(cx - mCW / 2.0f)), 2, mNX - mCW - 2);
+	mOriginY = std::clamp(int(std::floor(cy - mCH / 2.0f)), 2, mNY - mCH - 2);
+
+	// Fine cell x has its centre at origin + (x - 1/2) / 2 - 1/2 in coarse cells
+	geometry.rasterize(2.0f * (cx - mOriginX) + 1.5f, 2.0f * (cy - mOriginY) + 1.5f, 2.0f * r, mFNX, mFNY, mSdf);
+	int* flags = (int*)mUploads.map(size_t(mFNX) * mFNY * sizeof(int));
+	for (int y = 0; y < mFNY; y++)
+	{
+		for (int x = 0; x < mFNX; x++)
+		{
+			int idx = x + y * mFNX;
+			bool rim = x == 0 || y == 0 || x == mFNX - 1 || y == mFNY - 1;
+			flags[idx] = rim ? C_GHOST : mSdf[idx] < 0.0f ? C_BND : C_FLD;
+		}
+	}
+
+	mUploads.copy(mFlags, 0);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, mFine[0]);
+	mCurrent = 0;
+	couple(MODE_INIT, coarse, coarse, 0.0f, tau);
+}
+
+void Refinement::couple(int mode, GLuint coarseOld, GLuint coarseNew, float alpha, float tau)
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mCoarseFlags);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, coarseOld);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, coarseNew);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, mFlags);
+
+	mProgram.use();
+	mProgram.setUniform("NX", mNX);
+	mProgram.setUniform("NY", mNY);
+	mProgram.setUniform("FNX", mFNX);
+	mProgram.setUniform("FNY", mFNY);
+	glUniform2i(glGetUniformLocation(mProgram.getProgram(), "origin"), mOriginX, mOriginY);
+	mProgram.setUniform("tauC", tau);
+	mProgram.setUniform("tauF", 2.0f * tau - 0.5f);
+	mProgram.setUniform("alpha", alpha);
+	mProgram.setUniform("mode", mode);
+
+	if (mode == MODE_RESTRICT)
+		glDispatchCompute((mCW + 9) / 10, (mCH + 9) / 10, 1);
+	else
+		glDispatchCompute(mFNX / 10, mFNY / 10, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void Refinement::schedule(PassScheduler& scheduler, GLuint lbmProgram, GLuint coarseOld, GLuint coarseNew, float fx, float fy, float tau)
+{
+	if (mFlags == 0)
+		return;
+
+	// Binds its own buffers and ends with the barrier of the restriction
+	Pass pass;
+	pass.read(coarseOld).read(coarseNew).write(coarseNew);
+	pass.dispatch = [=] { step(lbmProgram, coarseOld, coarseNew, fx, fy, tau); };
+	scheduler.add(pass);
+}
+
+void Refinement::step(GLuint lbmProgram, GLuint coarseOld, GLuint coarseNew, float fx, float fy, float tau)
+{
+	if (mFlags == 0)
+		return;
+
+	float tauF = 2.0f * tau - 0.5f;
+
+	for (int sub = 0; sub < 2; sub++)
+	{
+		GLuint src = mFine[mCurrent], dst = mFine[1 - mCurrent];
+
+		// Ghosts write the links into the patch, lbm.cs everything else of dst
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, dst);
+		couple(MODE_GHOST, coarseOld, coarseNew, 0.5f * sub, tau);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, src);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, dst);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mFlags);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, mU);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, mV);
+
+		// Same locations as lbm.cs. dx and dt halve, so does the force in lattice units, and
+		// lbm.cs adds it as a velocity shift that relaxes with 1/tau, hence tauF / tau.
+		glUseProgram(lbmProgram);
+		glUniform1i(0, mFNX);
+		glUniform1i(1, mFNY);
+		glUniform1f(2, 0.5f * fx * tauF / tau);
+		glUniform1f(3, 0.5f * fy * tauF / tau);
+		glUniform1i(4, -1);
+		glUniform1f(6, tauF);
+		glUniform1i(8, 0);
+		glUniform1i(9, 0);
+		glDispatchCompute(mFNX / 10, mFNY / 10, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		mCurrent = 1 - mCurrent;
+	}
+
+	// The restriction binds the coarse flags at 2 again
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, mCoarseU);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, mCoarseV);
+
+	glUseProgram(lbmProgram);
+	glUniform1i(0, mNX);
+	glUniform1i(1, mNY);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, mFine[mCurrent]);
+	couple(MODE_RESTRICT, coarseOld, coarseNew, 1.0f, tau);
+	glUseProgram(0);
+}
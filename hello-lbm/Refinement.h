@@ -0,0 +1,69 @@
+#ifndef REFINEMENT_H
+#define REFINEMENT_H
+
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "Geometry.h"
+#include "GpuMemory.h"
+#include "PassScheduler.h"
+#include "ShaderProgram.h"
+#include "UploadRing.h"
+
+// One patch at twice the resolution wrapped around the obstacle.
+//
+// The coarse lattice still covers the whole domain. After every coarse step the
+// patch does two fine steps with the same lbm.cs program (tau_f = 2 tau_c - 1/2,
+// half the body force), then the coarse cells under it are replaced by their four
+// fine cells. shaders/refine.cs does the coupling with the usual rescaling of the
+// non-equilibrium parts (Dupuis & Chopard 2003):
+//
+//   f_neq,fine = tau_f / (2 tau_c) f_neq,coarse,  f_neq,coarse = 2 tau_c / tau_f f_neq,fine
+//
+// The rim of the patch is a ring of ghost cells. Before each fine step they push
+// post-collision populations, interpolated from the coarse lattice in space and
+// (between the two coarse time levels) in time, into the patch.
+//
+// Only FP32 push storage is supported. Forces and particles stay on the coarse lattice.
+class Refinement
+{
+public:
+	Refinement();
+
+	// Needs a current context; the patch spans cw x ch coarse cells. The coarse flags and
+	// velocities are rebound after every fine step.
+	bool init(int nx, int ny, int cw, int ch, GLuint coarseFlags, GLuint coarseU, GLuint coarseV);
+	void destroy();
+
+	// Centres the patch on the obstacle (placed as in Geometry::rasterize, coarse cells),
+	// rebuilds its flags at the fine resolution and fills it from the newest coarse populations
+	void place(const Geometry& geometry, float cx, float cy, float r, GLuint coarse, float tau);
+
+	// Two fine steps and the restriction, after the coarse step from coarseOld into coarseNew.
+	// Leaves lbmProgram with the coarse NX/NY; force, tau and the SSBOs at 0/1 are set again
+	// by the coarse step anyway.
+	void step(GLuint lbmProgram, GLuint coarseOld, GLuint coarseNew, float fx, float fy, float tau);
+	// The same as an opaque pass, nothing is queued without a patch
+	void schedule(PassScheduler& scheduler, GLuint lbmProgram, GLuint coarseOld, GLuint coarseNew, float fx, float fy, float tau);
+
+	int fineCells() const { return mFNX * mFNY; }
+
+private:
+	void couple(int mode, GLuint coarseOld, GLuint coarseNew, float alpha, float tau);
+
+	int mNX, mNY;
+	int mCW, mCH;				// patch size in coarse cells
+	int mFNX, mFNY;				// fine lattice including the ghost rim
+	int mOriginX, mOriginY;
+	GLuint mCoarseFlags, mCoarseU, mCoarseV;
+
+	ShaderProgram mProgram;
+	GpuBuffer mFine[2], mFlags, mU, mV;
+	int mCurrent;				// fine buffer holding the newest populations
+
+	UploadRing mUploads;		// the flags of every place()
+	std::vector<float> mSdf;
+};
+
+#endif // REFINEMENT_H
@@ -6,6 +6,8 @@
 
 #include <fmt/core.h>
 
+string ShaderProgram::sDirectory;
+
 ShaderProgram::ShaderProgram()
 	: mHandle(0)
 {
@@ -21,6 +23,8 @@ ShaderProgram::~ShaderProgram()
 void ShaderProgram::destroy() {
 	if (mHandle != 0)
 		glDeleteProgram(mHandle);
+	mHandle = 0;
+	mUniformLocations.clear();
 }
 
 //-----------------------------------------------------------------------------
@@ -67,6 +71,74 @@ bool ShaderProgram::loadShaders(const char* vsFilename, const char* fsFilename)
 	return true;
 }
 
+//-----------------------------------------------------------------------------
+// Loads a compute shader into its own program
+//-----------------------------------------------------------------------------
+bool ShaderProgram::loadComputeShader(const char* csFilename, const string& defines)
+{
+	string source = fileToString(csFilename);
+	if (source.empty())
+	{
+		fmt::println("Unable to read compute shader {}", csFilename);
+		return false;
+	}
+
+	string csString = insertDefines(source, defines);
+	const GLchar* csSourcePtr = csString.c_str();
+
+	GLuint cs = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(cs, 1, &csSourcePtr, NULL);
+
+	glCompileShader(cs);
+	if (!checkCompileErrors(cs, COMPUTE))
+	{
+		glDeleteShader(cs);
+		return false;
+	}
+
+	mHandle = glCreateProgram();
+	if (mHandle == 0)
+	{
+		glDeleteShader(cs);
+		fmt::println("Unable to create shader program!");
+		return false;
+	}
+
+	glAttachShader(mHandle, cs);
+
+	glLinkProgram(mHandle);
+	bool linked = checkCompileErrors(mHandle, PROGRAM);
+
+	glDeleteShader(cs);
+
+	mUniformLocations.clear();
+
+	if (!linked)
+	{
+		glDeleteProgram(mHandle);
+		mHandle = 0;
+		return false;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Puts defines after the #version line, which has to stay first
+//-----------------------------------------------------------------------------
+string ShaderProgram::insertDefines(const string& source, const string& defines)
+{
+	if (defines.empty())
+		return source;
+
+	size_t version = source.find("#version");
+	size_t eol = version == string::npos ? string::npos : source.find('\n', version);
+	if (eol == string::npos)
+		return defines + source;
+
+	return source.substr(0, eol + 1) + defines + source.substr(eol + 1);
+}
+
 void ShaderProgram::use()
 {
 	if (mHandle > 0)
@@ -82,9 +154,12 @@ string ShaderProgram::fileToString(const string& filename)
 	std::stringstream ss;
 	std::ifstream file;
 
+	bool absolute = !filename.empty() && (filename[0] == '/' || filename[0] == '\\' || (filename.size() > 1 && filename[1] == ':'));
+	string path = sDirectory.empty() || absolute ? filename : sDirectory + "/" + filename;
+
 	try
 	{
-		file.open(filename, std::ios::in);
+		file.open(path, std::ios::in);
 
 		if (!file.fail())
 		{
@@ -113,7 +188,7 @@ const GLuint ShaderProgram::getProgram()
 //-----------------------------------------------------------------------------
 // Checks for shader compiler errors
 //-----------------------------------------------------------------------------
-void  ShaderProgram::checkCompileErrors(GLuint shader, ShaderType type)
+bool  ShaderProgram::checkCompileErrors(GLuint shader, ShaderType type)
 {
 	int status = 0;
 
@@ -148,6 +223,7 @@ void  ShaderProgram::checkCompileErrors(GLuint shader, ShaderType type)
 		}
 	}
 
+	return status != GL_FALSE;
 }
 
 //-----------------------------------------------------------------------------
@@ -186,6 +262,15 @@ void ShaderProgram::setUniform(const GLchar* name, const GLint v)
 	glUniform1i(loc, v);
 }
 
+//-----------------------------------------------------------------------------
+// Sets a GLfloat shader uniform
+//-----------------------------------------------------------------------------
+void ShaderProgram::setUniform(const GLchar* name, const GLfloat v)
+{
+	GLint loc = getUniformLocation(name);
+	glUniform1f(loc, v);
+}
+
 //-----------------------------------------------------------------------------
 // Returns the uniform identifier given it's string name.
 // NOTE: Shader must be currently active first.
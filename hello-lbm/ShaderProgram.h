@@ -18,11 +18,18 @@ public:
 	{
 		VERTEX,
 		FRAGMENT,
+		COMPUTE,
 		PROGRAM
 	};
 
 	// Only supports vertex and fragment (this series will only have those two)
 	bool loadShaders(const char* vsFilename, const char* fsFilename);
+	// Single stage compute program, `defines` ("#define NAME value" lines) go right after #version
+	// False and no program if the file is missing or does not build
+	bool loadComputeShader(const char* csFilename, const string& defines = "");
+	static string insertDefines(const string& source, const string& defines);
+	// Relative file names are read from here, the working directory by default
+	static void setDirectory(const string& dir) { sDirectory = dir; }
 	void use();
 	void destroy();
 
@@ -32,15 +39,19 @@ public:
 	void setUniform(const GLchar* name, const glm::vec3& v);
 	void setUniform(const GLchar* name, const glm::vec4& v);
 	void setUniform(const GLchar* name, const GLint v);
+	void setUniform(const GLchar* name, const GLfloat v);
 
 private:
 
 	string fileToString(const string& filename);
-	void  checkCompileErrors(GLuint shader, ShaderType type);
+	// Prints the log and returns false when compiling or linking failed
+	bool  checkCompileErrors(GLuint shader, ShaderType type);
 	// We are going to speed up looking for uniforms by keeping their locations in a map
 	GLint getUniformLocation(const GLchar* name);
 
 
+	static string sDirectory;
+
 	GLuint mHandle;
 	std::map<string, GLint> mUniformLocations;
 };
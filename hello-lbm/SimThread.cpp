@@ -0,0 +1,184 @@
+#include "SimThread.h"
+
+#include <chrono>
+
+#include <fmt/core.h>
+#include <GLFW/glfw3.h>
+
+#include "Trace.h"
+
+SimThread::SimThread()
+	: mWindow(NULL), mRate(0.0), mQuit(false), mSteps(0), mReady(-1), mReading(-1)
+{
+	for (int i = 0; i < NUM_SLOTS; i++)
+		mWritten[i] = mRead[i] = 0;
+}
+
+SimThread::~SimThread()
+{
+	stop();
+}
+
+//-----------------------------------------------------------------------------
+// Creates the shared context and waits for the first snapshot
+//-----------------------------------------------------------------------------
+bool SimThread::start(GLFWwindow* share, StepFunc step, double rate)
+{
+	if (mWindow != NULL)
+		return false;
+
+	// Keeps the context hints of the render window
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	mWindow = glfwCreateWindow(1, 1, "simulation", NULL, share);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+	if (mWindow == NULL)
+	{
+		fmt::println("Unable to create the simulation context, running on one thread");
+		return false;
+	}
+
+	mStep = step;
+	mRate = rate;
+	mQuit = false;
+	mSteps = 0;
+	mReady = mReading = -1;
+
+	// Everything set up so far has to be complete before the other context uses it
+	glFinish();
+	mThread = std::thread(&SimThread::run, this);
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	mFirst.wait(lock, [this] { return mReady >= 0; });
+	return true;
+}
+
+void SimThread::stop()
+{
+	if (mWindow == NULL)
+		return;
+
+	mQuit = true;
+	mThread.join();
+
+	// Sync objects are shared, the render context can delete them
+	for (int i = 0; i < NUM_SLOTS; i++)
+	{
+		if (mWritten[i] != 0)
+			glDeleteSync(mWritten[i]);
+		if (mRead[i] != 0)
+			glDeleteSync(mRead[i]);
+		mWritten[i] = mRead[i] = 0;
+	}
+
+	glfwDestroyWindow(mWindow);
+	mWindow = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Render thread side
+//-----------------------------------------------------------------------------
+int SimThread::acquire()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	if (mReady >= 0)
+	{
+		mReading = mReady;
+		mReady = -1;
+		glWaitSync(mWritten[mReading], 0, GL_TIMEOUT_IGNORED);
+	}
+
+	return mReading;
+}
+
+void SimThread::release()
+{
+	GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();	// the simulation context can only wait on a fence that was flushed
+
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (mRead[mReading] != 0)
+		glDeleteSync(mRead[mReading]);
+	mRead[mReading] = fence;
+}
+
+//-----------------------------------------------------------------------------
+// Simulation thread
+//-----------------------------------------------------------------------------
+void SimThread::run()
+{
+	glfwMakeContextCurrent(mWindow);
+
+	typedef std::chrono::steady_clock Clock;
+	Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(mRate > 0.0 ? 1.0 / mRate : 0.0));
+	Clock::time_point next = Clock::now();
+	GLsync inFlight = 0;
+
+	while (!mQuit)
+	{
+		// Neither the one being drawn nor the newest, which may be picked up any moment
+		int slot = 0;
+		GLsync read;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			while (slot == mReading || slot == mReady)
+				slot++;
+			read = mRead[slot];
+			mRead[slot] = 0;
+		}
+
+		if (read != 0)
+		{
+			glWaitSync(read, 0, GL_TIMEOUT_IGNORED);
+			glDeleteSync(read);
+		}
+
+		int steps;
+		{
+			TRACE_ZONE("simulate");
+			steps = mStep(slot);
+		}
+
+		GLsync written = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mWritten[slot] != 0)
+				glDeleteSync(mWritten[slot]);
+			mWritten[slot] = written;
+			mReady = slot;
+		}
+		mFirst.notify_all();
+		mSteps += steps;
+
+		// Wait for the previous batch before queueing the next one
+		if (inFlight != 0)
+		{
+			glClientWaitSync(inFlight, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			glDeleteSync(inFlight);
+		}
+		inFlight = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		TRACE_FRAME();
+
+		if (mRate > 0.0)
+		{
+			// Pace to mRate batches per second, without catching up after a stall
+			next += period;
+			Clock::time_point now = Clock::now();
+			if (next < now)
+				next = now;
+			else
+				std::this_thread::sleep_until(next);
+		}
+	}
+
+	// The GPU zones of this context are collected here, nowhere else can read them
+	glFinish();
+	TRACE_FRAME();
+
+	if (inFlight != 0)
+		glDeleteSync(inFlight);
+	glfwMakeContextCurrent(NULL);
+}
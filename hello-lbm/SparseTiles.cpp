@@ -0,0 +1,63 @@
+#include "SparseTiles.h"
+
+SparseTiles::SparseTiles()
+	: mNX(0), mNY(0)
+{
+}
+
+bool SparseTiles::init(int nx, int ny)
+{
+	if (!mProgram.loadComputeShader("shaders/tiles.cs"))
+		return false;
+
+	mNX = nx;
+	mNY = ny;
+
+	mTiles.create("tiles", (nx / TILE) * (ny / TILE) * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+	mIndirect.create("tiles", 3 * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+	const GLuint empty[3] = { 0, 1, 1 };
+	mEmpty.create("tiles", sizeof(empty), empty, GL_STATIC_COPY);
+
+	rebuild();
+
+	return true;
+}
+
+void SparseTiles::destroy()
+{
+	mTiles.destroy();
+	mIndirect.destroy();
+	mEmpty.destroy();
+
+	mProgram.destroy();
+}
+
+void SparseTiles::rebuild()
+{
+	if (mIndirect == 0)
+		return;
+
+	// No groups yet, tiles.cs counts them up
+	glBindBuffer(GL_COPY_READ_BUFFER, mEmpty);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mIndirect);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, 3 * sizeof(GLuint));
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, mTiles);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, mIndirect);
+
+	mProgram.use();
+	mProgram.setUniform("NX", mNX);
+	glDispatchCompute(mNX / TILE, mNY / TILE, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+	glUseProgram(0);
+}
+
+void SparseTiles::dispatch()
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, mTiles);
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, mIndirect);
+	glDispatchComputeIndirect(0);
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
@@ -0,0 +1,40 @@
+#ifndef SPARSE_TILES_H
+#define SPARSE_TILES_H
+
+#include <glad/glad.h>
+
+#include "GpuMemory.h"
+#include "ShaderProgram.h"
+
+// Sparse dispatch of lbm.cs over the 10x10 tiles that contain fluid.
+//
+// shaders/tiles.cs appends every tile with a fluid cell to a list and counts them
+// straight into a glDispatchComputeIndirect argument buffer, so the host never
+// reads anything back. lbm.cs (with the sparse uniform set) maps each work group
+// onto its tile from the list. Mostly solid domains then skip the solid tiles
+// entirely, including the neighbour loads a full dispatch still pays for them.
+// The list has to be rebuilt whenever the flags in cF_SSB change.
+class SparseTiles
+{
+public:
+	SparseTiles();
+
+	// Needs a current context
+	bool init(int nx, int ny);
+	void destroy();
+
+	// Call after the flags changed, they must be bound at 2
+	void rebuild();
+	// Dispatches the currently bound program (lbm.cs) over the active tiles
+	void dispatch();
+
+private:
+	static const int TILE = 10;
+
+	int mNX, mNY;
+	ShaderProgram mProgram;
+	GpuBuffer mTiles, mIndirect;
+	GpuBuffer mEmpty;			// the indirect arguments of no tiles, copied into mIndirect
+};
+
+#endif // SPARSE_TILES_H
@@ -0,0 +1,108 @@
+#include "StepController.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <GLFW/glfw3.h>
+#include <fmt/core.h>
+
+StepController::StepController(int steps, int minSteps, int maxSteps, double interval)
+	: mSteps(steps), mMinSteps(minSteps), mMaxSteps(maxSteps), mBudgetMs(0.0), mInterval(interval),
+	  mQueryHead(0), mQueryPending(0), mQueriesCreated(false), mContext(NULL), mMsPerStep(-1.0), mStepsDone(0)
+{
+	mLastReport = std::chrono::steady_clock::now();
+}
+
+void StepController::destroy()
+{
+	if (mQueriesCreated && glfwGetCurrentContext() == mContext)
+		glDeleteQueries(NUM_QUERIES * 2, &mQueries[0][0]);
+	mQueriesCreated = false;
+	mContext = NULL;
+	mQueryHead = mQueryPending = 0;
+}
+
+void StepController::begin()
+{
+	if (!mQueriesCreated)
+	{
+		glGenQueries(NUM_QUERIES * 2, &mQueries[0][0]);
+		mQueriesCreated = true;
+		mContext = glfwGetCurrentContext();
+		mLastReport = std::chrono::steady_clock::now();
+	}
+
+	resolve();
+
+	// With every query in flight this frame goes unmeasured rather than waiting
+	if (mQueryPending < NUM_QUERIES)
+		glQueryCounter(mQueries[mQueryHead][0], GL_TIMESTAMP);
+}
+
+void StepController::end(int steps)
+{
+	if (mQueryPending < NUM_QUERIES)
+	{
+		glQueryCounter(mQueries[mQueryHead][1], GL_TIMESTAMP);
+		mPendingSteps[mQueryHead] = steps;
+		mQueryHead = (mQueryHead + 1) % NUM_QUERIES;
+		mQueryPending++;
+	}
+
+	mStepsDone += steps;
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (mInterval > 0.0 && std::chrono::duration<double>(now - mLastReport).count() >= mInterval)
+		report();
+}
+
+//-----------------------------------------------------------------------------
+// Adapts to every frame whose timestamps have landed, oldest first
+//-----------------------------------------------------------------------------
+void StepController::resolve()
+{
+	while (mQueryPending > 0)
+	{
+		int oldest = (mQueryHead - mQueryPending + NUM_QUERIES) % NUM_QUERIES;
+
+		GLint available = 0;
+		glGetQueryObjectiv(mQueries[oldest][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			break;
+
+		GLuint64 t0 = 0, t1 = 0;
+		glGetQueryObjectui64v(mQueries[oldest][0], GL_QUERY_RESULT, &t0);
+		glGetQueryObjectui64v(mQueries[oldest][1], GL_QUERY_RESULT, &t1);
+
+		if (mPendingSteps[oldest] > 0)
+			adapt(double(t1 - t0) * 1e-6 / mPendingSteps[oldest]);
+
+		mQueryPending--;
+	}
+}
+
+void StepController::adapt(double msPerStep)
+{
+	mMsPerStep = mMsPerStep < 0.0 ? msPerStep : 0.8 * mMsPerStep + 0.2 * msPerStep;
+
+	if (mBudgetMs <= 0.0 || mMsPerStep <= 0.0)
+		return;
+
+	// At most a quarter (and at least one step) up or down per frame
+	int change = std::max(1, mSteps / 4);
+	int target = (int)std::lround(std::min(mBudgetMs / mMsPerStep, double(mMaxSteps)));
+	target = std::min(std::max(target, mSteps - change), mSteps + change);
+	mSteps = std::min(std::max(target, mMinSteps), mMaxSteps);
+}
+
+void StepController::report()
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(now - mLastReport).count();
+	mLastReport = now;
+
+	// One step is one unit of lattice time
+	fmt::println("Steps: {}/frame, {:.3f} ms/step on the GPU, {:.0f} lattice time units per second",
+		mSteps, std::max(mMsPerStep, 0.0), mStepsDone / seconds);
+	mStepsDone = 0;
+}
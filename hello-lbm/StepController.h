@@ -0,0 +1,62 @@
+#ifndef STEP_CONTROLLER_H
+#define STEP_CONTROLLER_H
+
+#include <chrono>
+
+#include <glad/glad.h>
+
+struct GLFWwindow;
+
+// Picks the number of LBM steps per frame so that the solver fills a GPU time
+// budget, instead of a fixed count that is too slow on small devices and leaves
+// big ones idle.
+//
+// begin() / end(steps) bracket the steps of a frame with a pair of timestamp
+// queries that are read back a few frames later, like FrameStats does, so the
+// pipeline never stalls. The GPU time per step is smoothed over frames and the
+// next count is budget / time per step, clamped to [minSteps, maxSteps] and
+// changed by at most a quarter per frame so one slow frame does not make it
+// swing. With a budget <= 0 the count stays where it is.
+//
+// Every `interval` seconds the steps per frame, GPU time per step and the
+// simulated (lattice) time per wall second are printed. All calls need the
+// context that runs the steps; query objects are not shared, so destroy() only
+// deletes them there. On another context (SimThread's) they went with it.
+class StepController
+{
+public:
+	StepController(int steps, int minSteps, int maxSteps, double interval = 1.0);
+
+	void destroy();
+
+	void setBudget(double ms) { mBudgetMs = ms; }
+
+	// Steps to run this frame
+	int steps() const { return mSteps; }
+
+	void begin();
+	void end(int steps);
+
+private:
+	static const int NUM_QUERIES = 8;
+
+	void resolve();
+	void adapt(double msPerStep);
+	void report();
+
+	int mSteps, mMinSteps, mMaxSteps;
+	double mBudgetMs;
+	double mInterval;
+
+	GLuint mQueries[NUM_QUERIES][2];
+	int mPendingSteps[NUM_QUERIES];
+	int mQueryHead, mQueryPending;
+	bool mQueriesCreated;
+	GLFWwindow* mContext;	// the one the queries were made on
+
+	double mMsPerStep;		// smoothed, < 0 until the first frame is measured
+	long long mStepsDone;	// since the last report
+	std::chrono::steady_clock::time_point mLastReport;
+};
+
+#endif // STEP_CONTROLLER_H
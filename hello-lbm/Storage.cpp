@@ -0,0 +1,86 @@
+#include "Storage.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include <fmt/core.h>
+
+static const int NUM_VECTORS = 9;
+static const int HALF_WORDS = 5;	// 9 halves rounded up to whole words, as in lbm.cs
+
+static const float W[NUM_VECTORS] = { 4.0f / 9.0f, 1.0f / 9.0f, 1.0f / 9.0f, 1.0f / 9.0f, 1.0f / 9.0f,
+	1.0f / 36.0f, 1.0f / 36.0f, 1.0f / 36.0f, 1.0f / 36.0f };
+
+//-----------------------------------------------------------------------------
+// IEEE half with round to nearest even, what packHalf2x16 does for normal values
+//-----------------------------------------------------------------------------
+static uint16_t floatToHalf(float f)
+{
+	uint32_t x;
+	std::memcpy(&x, &f, sizeof(x));
+
+	uint32_t sign = (x >> 16) & 0x8000;
+	int exponent = int((x >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = x & 0x7fffff;
+
+	if (exponent <= 0)
+		return uint16_t(sign);			// flush tiny values, the rest state has none
+	if (exponent >= 31)
+		return uint16_t(sign | 0x7c00);
+
+	uint32_t half = sign | (uint32_t(exponent) << 10) | (mantissa >> 13);
+	uint32_t rest = mantissa & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		half++;
+	return uint16_t(half);
+}
+
+const char* storageName(Storage storage)
+{
+	switch (storage)
+	{
+	case STORAGE_FP16: return "FP16";
+	case STORAGE_FP16_SHIFTED: return "FP16 f-w";
+	case STORAGE_FP16C: return "FP16C f-w";
+	default: return "FP32";
+	}
+}
+
+std::string storageDefines(Storage storage)
+{
+	return fmt::format("#define STORAGE {}\n", int(storage));
+}
+
+size_t storageBytesPerCell(Storage storage)
+{
+	return storage == STORAGE_FP32 ? NUM_VECTORS * sizeof(float) : HALF_WORDS * sizeof(uint32_t);
+}
+
+void storageFillRest(void* dst, int cells, Storage storage)
+{
+	if (storage == STORAGE_FP32)
+	{
+		float* f = (float*)dst;
+		for (int i = 0; i < cells; i++)
+			for (int k = 0; k < NUM_VECTORS; k++)
+				f[i * NUM_VECTORS + k] = W[k];
+		return;
+	}
+
+	// Low half is the even direction, high half the odd one
+	uint32_t words[HALF_WORDS];
+	for (int n = 0; n < HALF_WORDS; n++)
+	{
+		uint32_t lo = 0, hi = 0;
+		if (storage == STORAGE_FP16)
+		{
+			lo = floatToHalf(W[2 * n]);
+			hi = 2 * n + 1 < NUM_VECTORS ? floatToHalf(W[2 * n + 1]) : 0;
+		}
+		words[n] = lo | (hi << 16);
+	}
+
+	uint32_t* h = (uint32_t*)dst;
+	for (int i = 0; i < cells; i++)
+		std::memcpy(h + i * HALF_WORDS, words, sizeof(words));
+}
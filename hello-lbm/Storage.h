@@ -0,0 +1,27 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <cstddef>
+#include <string>
+
+// How the LBM distributions are kept in c0_SSB / c1_SSB, same values as STORAGE_* in
+// shaders/lbm.cs. The 16-bit modes halve the traffic of the bandwidth-bound step, all
+// arithmetic stays in FP32 registers.
+enum Storage
+{
+	STORAGE_FP32,			// 9 floats per cell
+	STORAGE_FP16,			// 9 halves per cell (in 5 words)
+	STORAGE_FP16_SHIFTED,	// f - w[k] as halves, far more digits near equilibrium
+	STORAGE_FP16C,			// f - w[k] as 1-4-11 bit floats, one more mantissa bit than a half
+	NUM_STORAGES
+};
+
+const char* storageName(Storage storage);
+// "#define STORAGE n" for ShaderProgram::insertDefines
+std::string storageDefines(Storage storage);
+size_t storageBytesPerCell(Storage storage);
+
+// Writes the fluid at rest (f = w[k]) for `cells` cells in the given storage
+void storageFillRest(void* dst, int cells, Storage storage);
+
+#endif // STORAGE_H
@@ -0,0 +1,229 @@
+#include "StreamingLbm.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+
+#include <fmt/core.h>
+
+// Same as in shaders/lbm.cs
+static const int ex[9] = { 0, 1, 0, -1, 0, 1, -1, -1, 1 };
+static const int ey[9] = { 0, 0, 1, 0, -1, 1, 1, -1, -1 };
+static const float w[9] = { 4.0f / 9.0f, 1.0f / 9.0f, 1.0f / 9.0f, 1.0f / 9.0f, 1.0f / 9.0f,
+	1.0f / 36.0f, 1.0f / 36.0f, 1.0f / 36.0f, 1.0f / 36.0f };
+
+StreamingLbm::StreamingLbm()
+	: mNX(0), mNY(0), mBandRows(0), mFusedSteps(0), mSteps(0), mBytesMoved(0.0), mCurrent(0)
+{
+}
+
+bool StreamingLbm::init(const std::string& directory, int nx, int ny, int bandRows, int fusedSteps)
+{
+	if (nx <= 0 || ny < 3 || bandRows <= 0 || fusedSteps <= 0)
+	{
+		fmt::println("StreamingLbm: bad lattice {} x {} or bands of {} rows and {} steps", nx, ny, bandRows, fusedSteps);
+		return false;
+	}
+
+	destroy();
+
+	std::error_code ec;
+	std::filesystem::create_directories(directory, ec);
+
+	size_t cells = size_t(nx) * ny;
+	if (!mFiles[0].open(directory + "/f0.bin", cells * 9 * sizeof(float)) ||
+		!mFiles[1].open(directory + "/f1.bin", cells * 9 * sizeof(float)) ||
+		!mFlags.open(directory + "/flags.bin", cells * sizeof(int)))
+	{
+		destroy();
+		return false;
+	}
+
+	mNX = nx;
+	mNY = ny;
+	mBandRows = std::min(bandRows, ny);
+	mFusedSteps = fusedSteps;
+	mSteps = 0;
+	mCurrent = 0;
+
+	size_t windowCells = size_t(mBandRows + 2 * fusedSteps + 2) * nx;
+	mWindow[0].resize(windowCells * 9);
+	mWindow[1].resize(windowCells * 9);
+	mWindowFlags.resize(windowCells);
+
+	// At rest, a band at a time
+	for (size_t c = 0; c < size_t(mBandRows) * nx; c++)
+		for (int k = 0; k < 9; k++)
+			mWindow[0][c * 9 + k] = w[k];
+	for (int y0 = 0; y0 < ny; y0 += mBandRows)
+	{
+		int rows = std::min(mBandRows, ny - y0);
+		std::memcpy(mFiles[0].data() + y0 * rowBytes(), mWindow[0].data(), rows * rowBytes());
+		mFiles[0].writeBack(y0 * rowBytes(), rows * rowBytes());
+		mFiles[0].release(y0 * rowBytes(), rows * rowBytes());
+	}
+
+	setObstacle([](int, int) { return 1.0f; });
+	return true;
+}
+
+void StreamingLbm::destroy()
+{
+	mFiles[0].close();
+	mFiles[1].close();
+	mFlags.close();
+	mWindow[0].clear();
+	mWindow[1].clear();
+	mWindowFlags.clear();
+	mNX = mNY = 0;
+}
+
+void StreamingLbm::setObstacle(const std::function<float(int x, int y)>& sdf)
+{
+	int* flags = (int*)mFlags.data();
+	for (int y = 0; y < mNY; y++)
+	{
+		for (int x = 0; x < mNX; x++)
+			flags[size_t(y) * mNX + x] = y == 0 || y == mNY - 1 || sdf(x, y) < 0.0f ? 0 : 1;
+
+		if ((y + 1) % mBandRows == 0 || y == mNY - 1)
+		{
+			int y0 = y - y % mBandRows;
+			size_t rowFlags = size_t(mNX) * sizeof(int);
+			mFlags.writeBack(y0 * rowFlags, (y + 1 - y0) * rowFlags);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Rows b0 - steps .. b1 + steps - 1 in, steps in memory, rows b0 .. b1 - 1 out
+//-----------------------------------------------------------------------------
+void StreamingLbm::sweepBand(int b0, int b1, int steps)
+{
+	size_t row = rowBytes();
+	int lo = std::max(0, b0 - steps), hi = std::min(mNY, b1 + steps);
+	int rows = hi - lo;
+
+	// Window row 0 and rows + 1 are ghosts, solid so the edge rows bounce back there.
+	// Both buffers get the band: the step never writes solid cells, so they keep theirs.
+	const char* in = mFiles[mCurrent].data() + lo * row;
+	std::memcpy(mWindow[0].data() + size_t(mNX) * 9, in, rows * row);
+	std::memcpy(mWindow[1].data() + size_t(mNX) * 9, in, rows * row);
+
+	std::fill(mWindowFlags.begin(), mWindowFlags.begin() + mNX, 0);
+	std::memcpy(mWindowFlags.data() + mNX, mFlags.data() + size_t(lo) * mNX * sizeof(int), size_t(rows) * mNX * sizeof(int));
+	std::fill(mWindowFlags.begin() + size_t(rows + 1) * mNX, mWindowFlags.begin() + size_t(rows + 2) * mNX, 0);
+
+	// The rows next to stale ones go stale too, except at the walls
+	int current = 0;
+	for (int s = 0; s < steps; s++)
+	{
+		int first = lo > 0 ? lo + s : lo;
+		int last = hi < mNY ? hi - s : hi;
+		for (int y = first; y < last; y++)
+			CpuLbm::collideRow(mWindow[current].data(), mWindow[1 - current].data(), mWindowFlags.data(), mNX,
+				y - lo + 1, mParams, NULL, NULL);
+		current = 1 - current;
+	}
+
+	std::memcpy(mFiles[1 - mCurrent].data() + b0 * row, mWindow[current].data() + size_t(b0 - lo + 1) * mNX * 9, (b1 - b0) * row);
+	mBytesMoved += double(rows + b1 - b0) * row;
+}
+
+void StreamingLbm::step(int steps)
+{
+	mBytesMoved = 0.0;
+	size_t row = rowBytes();
+	size_t rowFlags = size_t(mNX) * sizeof(int);
+
+	while (steps > 0)
+	{
+		int fused = std::min(steps, mFusedSteps);
+		for (int b0 = 0; b0 < mNY; b0 += mBandRows)
+		{
+			int b1 = std::min(b0 + mBandRows, mNY);
+
+			// The next band is read while this one is computed
+			if (b1 < mNY)
+			{
+				mFiles[mCurrent].prefetch(size_t(b1 + fused) * row, size_t(mBandRows) * row);
+				mFlags.prefetch(size_t(b1 + fused) * rowFlags, size_t(mBandRows) * rowFlags);
+			}
+
+			sweepBand(b0, b1, fused);
+
+			// Its rows are written while the next band is computed, and what no band
+			// reads again leaves memory
+			mFiles[1 - mCurrent].writeBack(b0 * row, (b1 - b0) * row);
+			mFiles[1 - mCurrent].release(b0 * row, (b1 - b0) * row);
+			int lo = std::max(0, b0 - fused), hi = b1 - fused;
+			if (hi > lo)
+			{
+				mFiles[mCurrent].release(size_t(lo) * row, size_t(hi - lo) * row);
+				mFlags.release(size_t(lo) * rowFlags, size_t(hi - lo) * rowFlags);
+			}
+		}
+
+		mCurrent = 1 - mCurrent;
+		mSteps += fused;
+		steps -= fused;
+	}
+}
+
+void StreamingLbm::readVelocity(int y0, int rows, float* u, float* v) const
+{
+	const float* f = (const float*)(mFiles[mCurrent].data() + y0 * rowBytes());
+	const int* flags = (const int*)mFlags.data() + size_t(y0) * mNX;
+
+	for (size_t c = 0; c < size_t(rows) * mNX; c++)
+	{
+		u[c] = v[c] = 0.0f;
+		if (flags[c] != 1)
+			continue;
+
+		float rho = 0.0f, uc = 0.0f, vc = 0.0f;
+		for (int k = 0; k < 9; k++)
+		{
+			float fk = f[c * 9 + k];
+			rho += fk;
+			uc += fk * ex[k];
+			vc += fk * ey[k];
+		}
+		u[c] = uc / rho;
+		v[c] = vc / rho;
+	}
+}
+
+bool runStreamingLbm(const StreamingLbmRun& cfg)
+{
+	StreamingLbm lbm;
+	if (!lbm.init(cfg.directory, cfg.nx, cfg.ny, cfg.bandRows, cfg.fusedSteps))
+		return false;
+	lbm.setTau(cfg.tau);
+	lbm.setForce(cfg.force, 0.0f);
+
+	float cx = cfg.nx / 4.0f, cy = cfg.ny / 2.0f, r = cfg.ny / 10.0f;
+	lbm.setObstacle([=](int x, int y) { return std::hypot(x - cx, y - cy) - r; });
+
+	double gigabytes = (2.0 * 9 + 1) * cfg.nx * cfg.ny * sizeof(float) / 1e9;
+	fmt::println("Out of core LBM {}x{}, {:.1f} GB in {}, bands of {} rows, {} steps per pass",
+		cfg.nx, cfg.ny, gigabytes, cfg.directory, cfg.bandRows, cfg.fusedSteps);
+
+	auto start = std::chrono::steady_clock::now();
+	double moved = 0.0;
+	for (int done = 0; done < cfg.steps; done += cfg.fusedSteps)
+	{
+		lbm.step(std::min(cfg.fusedSteps, cfg.steps - done));
+		moved += lbm.bytesMoved();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	double updates = double(cfg.nx) * cfg.ny * lbm.steps();
+	fmt::println("{} steps in {:.1f} s: {:.1f} MLUPS, {:.1f} MB/s through the files",
+		lbm.steps(), seconds, updates / seconds * 1e-6, moved / seconds * 1e-6);
+
+	lbm.destroy();
+	return true;
+}
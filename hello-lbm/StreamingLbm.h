@@ -0,0 +1,91 @@
+#ifndef STREAMING_LBM_H
+#define STREAMING_LBM_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "CpuLbm.h"
+#include "MappedFile.h"
+
+// The CPU step of CpuLbm for lattices larger than memory, with the populations
+// in files.
+//
+// The populations live in two memory-mapped files of 9 floats per cell, one the
+// step reads and one it writes, the flags in a third. The lattice is swept in
+// bands of rows: a band is copied in with `fusedSteps` extra rows above and
+// below, stepped that many times in memory (every step leaves one more row at
+// each edge stale) and its own rows are written to the other file. So one pass
+// over the files does fusedSteps steps, at the cost of redoing 2 * fusedSteps
+// rows per band. While a band is computed the next one is prefetched, its output
+// is queued for writeback as soon as it is written and the rows no band needs
+// any more are released, so the disk works while the CPU does and the resident
+// set stays at a few bands.
+//
+// Periodic in x with walls in the first and last row like the other solvers, so
+// bands at the walls need no rows from the other end.
+class StreamingLbm
+{
+public:
+	StreamingLbm();
+
+	// Creates f0.bin, f1.bin and flags.bin in directory. Starts at rest without obstacle.
+	bool init(const std::string& directory, int nx, int ny, int bandRows = 128, int fusedSteps = 8);
+	void destroy();
+
+	void setForce(float fx, float fy) { mParams.fx = fx; mParams.fy = fy; }
+	void setTau(float tau) { mParams.tau = tau; }
+	void setSmagorinsky(float c) { mParams.smagorinsky = c; }
+	// Signed distance at a cell, negative in the solid; evaluated a band at a time,
+	// so the obstacle never has to be in memory as a whole
+	void setObstacle(const std::function<float(int x, int y)>& sdf);
+
+	void step(int steps);
+
+	// Velocity of rows y0 .. y0 + rows - 1 of the newest populations, 0 in the solid
+	void readVelocity(int y0, int rows, float* u, float* v) const;
+
+	int nx() const { return mNX; }
+	int ny() const { return mNY; }
+	long long steps() const { return mSteps; }
+	// Bytes copied from and to the files by the last step()
+	double bytesMoved() const { return mBytesMoved; }
+
+private:
+	void sweepBand(int b0, int b1, int steps);
+
+	size_t rowBytes() const { return size_t(mNX) * 9 * sizeof(float); }
+
+	int mNX, mNY;
+	int mBandRows, mFusedSteps;
+	CpuLbm::Params mParams;
+	long long mSteps;
+	double mBytesMoved;
+
+	MappedFile mFiles[2];			// mFiles[mCurrent] is the newest
+	MappedFile mFlags;
+	int mCurrent;
+
+	// A band, its halo rows and a ghost row at each end, ping-pong
+	std::vector<float> mWindow[2];
+	std::vector<int> mWindowFlags;
+};
+
+struct StreamingLbmRun
+{
+	std::string directory = "out-of-core";
+	int nx = 10000;				// 1.8 GB per population file
+	int ny = 5000;
+	int bandRows = 128;
+	int fusedSteps = 8;
+
+	int steps = 64;
+	float tau = 0.6f;
+	float force = 1e-5f;
+};
+
+// Steps a channel around a cylinder of the size given through the files and prints
+// the lattice updates and the file traffic per second. Needs no GL context.
+bool runStreamingLbm(const StreamingLbmRun& cfg);
+
+#endif // STREAMING_LBM_H
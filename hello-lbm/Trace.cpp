@@ -0,0 +1,184 @@
+#include "Trace.h"
+
+#ifdef LBM_TRACE
+
+#include <cstdio>
+
+#include <fmt/core.h>
+
+static const int GPU_TID = 1000;
+
+Trace& Trace::instance()
+{
+	static Trace trace;
+	return trace;
+}
+
+Trace::Trace()
+	: mStart(std::chrono::steady_clock::now()), mGpuOffsetUs(0.0), mCalibrated(false)
+{
+	mEvents.reserve(4096);
+}
+
+double Trace::nowUs() const
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - mStart).count();
+}
+
+//-----------------------------------------------------------------------------
+// Small stable id per thread, the first thread to record is "main"
+//-----------------------------------------------------------------------------
+int Trace::threadId()
+{
+	thread_local int tid = -1;
+	if (tid < 0)
+	{
+		tid = (int)mThreadNames.size();
+		mThreadNames.push_back(tid == 0 ? "main" : fmt::format("thread {}", tid));
+	}
+	return tid;
+}
+
+void Trace::cpuZone(const char* name, double beginUs, double endUs)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	if (mEvents.size() >= MAX_EVENTS)
+		return;
+
+	Event e = { name, threadId(), beginUs, endUs };
+	mEvents.push_back(e);
+}
+
+GLuint Trace::allocQuery()
+{
+	if (mFreeQueries.empty())
+	{
+		GLuint q[32];
+		glGenQueries(32, q);
+		mFreeQueries.insert(mFreeQueries.end(), q, q + 32);
+	}
+
+	GLuint q = mFreeQueries.back();
+	mFreeQueries.pop_back();
+	return q;
+}
+
+//-----------------------------------------------------------------------------
+// The first thread to ask owns the GPU zones, call with mMutex held
+//-----------------------------------------------------------------------------
+bool Trace::isGpuThread()
+{
+	if (mGpuThread == std::thread::id())
+		mGpuThread = std::this_thread::get_id();
+	return mGpuThread == std::this_thread::get_id();
+}
+
+GLuint Trace::gpuBegin()
+{
+	// 0 is never a query name, gpuEnd() skips it
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (!isGpuThread())
+		return 0;
+
+	if (!mCalibrated)
+	{
+		// Map GPU timestamps onto the CPU timeline
+		GLint64 gpuNow = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+		mGpuOffsetUs = nowUs() - double(gpuNow) * 1e-3;
+		mCalibrated = true;
+	}
+
+	GLuint q = allocQuery();
+	glQueryCounter(q, GL_TIMESTAMP);
+	return q;
+}
+
+void Trace::gpuEnd(const char* name, GLuint beginQuery)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (beginQuery == 0)
+		return;
+
+	GpuZone zone;
+	zone.name = name;
+	zone.query[0] = beginQuery;
+	zone.query[1] = allocQuery();
+	glQueryCounter(zone.query[1], GL_TIMESTAMP);
+	mPending.push_back(zone);
+}
+
+//-----------------------------------------------------------------------------
+// Turns finished GPU zones into events; zones complete in submission order
+//-----------------------------------------------------------------------------
+void Trace::resolve(bool wait)
+{
+	size_t done = 0;
+
+	for (; done < mPending.size(); done++)
+	{
+		GpuZone& zone = mPending[done];
+
+		GLint available = 0;
+		glGetQueryObjectiv(zone.query[1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available && !wait)
+			break;
+
+		GLuint64 t0 = 0, t1 = 0;
+		glGetQueryObjectui64v(zone.query[0], GL_QUERY_RESULT, &t0);
+		glGetQueryObjectui64v(zone.query[1], GL_QUERY_RESULT, &t1);
+
+		if (mEvents.size() < MAX_EVENTS)
+		{
+			Event e = { zone.name, GPU_TID, mGpuOffsetUs + double(t0) * 1e-3, mGpuOffsetUs + double(t1) * 1e-3 };
+			mEvents.push_back(e);
+		}
+
+		mFreeQueries.push_back(zone.query[0]);
+		mFreeQueries.push_back(zone.query[1]);
+	}
+
+	mPending.erase(mPending.begin(), mPending.begin() + done);
+}
+
+void Trace::frame()
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (mGpuThread == std::this_thread::get_id())
+		resolve(false);
+}
+
+bool Trace::write(const char* path)
+{
+	// Zones of a GPU thread that is not this one are only written if it collected them
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (mGpuThread == std::this_thread::get_id())
+		resolve(true);
+
+	FILE* fp = std::fopen(path, "w");
+	if (fp == NULL)
+	{
+		fmt::println("Unable to write trace {}", path);
+		return false;
+	}
+
+	std::fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	std::fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"GPU\"}}", GPU_TID);
+	for (size_t i = 0; i < mThreadNames.size(); i++)
+		std::fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"%s\"}}", i, mThreadNames[i].c_str());
+
+	for (const Event& e : mEvents)
+	{
+		std::fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+			e.name, e.tid == GPU_TID ? "gpu" : "cpu", e.tid, e.beginUs, e.endUs - e.beginUs);
+	}
+
+	std::fprintf(fp, "\n]}\n");
+	std::fclose(fp);
+
+	fmt::println("Trace: wrote {} events to {}", mEvents.size(), path);
+	return true;
+}
+
+#endif // LBM_TRACE
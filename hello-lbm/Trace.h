@@ -0,0 +1,117 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Scoped CPU and GPU zones written as a Chrome / Perfetto trace-event JSON file
+// (open it in chrome://tracing or ui.perfetto.dev).
+//
+//   TRACE_ZONE("name")      CPU zone until the end of the scope
+//   TRACE_GPU_ZONE("name")  CPU zone plus a GPU zone from a pair of timestamp queries
+//   TRACE_FRAME()           once per frame, collects finished GPU zones without waiting
+//   TRACE_WRITE("file")     writes everything recorded so far (needs the GL context)
+//
+// Queries belong to one context, so GPU zones are only recorded on the first
+// thread that opens one. Other threads get their CPU zones only, and TRACE_FRAME
+// collects GPU zones only on that thread.
+//
+// Everything is compiled out unless LBM_TRACE is defined (cmake -DLBM_TRACE=ON),
+// names must be string literals.
+
+#ifdef LBM_TRACE
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+
+class Trace
+{
+public:
+	static Trace& instance();
+
+	double nowUs() const;
+	void cpuZone(const char* name, double beginUs, double endUs);
+
+	GLuint gpuBegin();
+	void gpuEnd(const char* name, GLuint beginQuery);
+
+	void frame();
+	bool write(const char* path);
+
+private:
+	Trace();
+
+	struct Event
+	{
+		const char* name;
+		int tid;
+		double beginUs, endUs;
+	};
+
+	struct GpuZone
+	{
+		const char* name;
+		GLuint query[2];
+	};
+
+	GLuint allocQuery();
+	void resolve(bool wait);
+	int threadId();
+	bool isGpuThread();
+
+	static const size_t MAX_EVENTS = 1 << 20;
+
+	std::chrono::steady_clock::time_point mStart;
+	std::mutex mMutex;
+	std::vector<Event> mEvents;
+	std::vector<std::string> mThreadNames;
+
+	std::vector<GpuZone> mPending;
+	std::vector<GLuint> mFreeQueries;
+	double mGpuOffsetUs;	// CPU time of GPU timestamp 0
+	bool mCalibrated;
+	std::thread::id mGpuThread;	// the thread whose context owns the queries
+};
+
+class TraceScope
+{
+public:
+	TraceScope(const char* name) : mName(name), mBegin(Trace::instance().nowUs()) {}
+	~TraceScope() { Trace::instance().cpuZone(mName, mBegin, Trace::instance().nowUs()); }
+
+private:
+	const char* mName;
+	double mBegin;
+};
+
+class TraceGpuScope
+{
+public:
+	TraceGpuScope(const char* name) : mCpu(name), mName(name), mQuery(Trace::instance().gpuBegin()) {}
+	~TraceGpuScope() { Trace::instance().gpuEnd(mName, mQuery); }
+
+private:
+	TraceScope mCpu;
+	const char* mName;
+	GLuint mQuery;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_ZONE(name) TraceScope TRACE_CONCAT(traceZone, __LINE__)(name)
+#define TRACE_GPU_ZONE(name) TraceGpuScope TRACE_CONCAT(traceGpuZone, __LINE__)(name)
+#define TRACE_FRAME() Trace::instance().frame()
+#define TRACE_WRITE(path) Trace::instance().write(path)
+
+#else
+
+#define TRACE_ZONE(name)
+#define TRACE_GPU_ZONE(name)
+#define TRACE_FRAME()
+#define TRACE_WRITE(path)
+
+#endif // LBM_TRACE
+
+#endif // TRACE_H
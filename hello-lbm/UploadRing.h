@@ -0,0 +1,70 @@
+#ifndef UPLOAD_RING_H
+#define UPLOAD_RING_H
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "GpuMemory.h"
+
+// Staging memory for host to GPU uploads that never makes the driver wait for
+// the GPU.
+//
+// Mapping a buffer the GPU may still read (even with INVALIDATE_BUFFER) lets
+// the driver either stall until it is idle or orphan the storage behind our
+// back. Here one buffer is created with glBufferStorage and stays persistently
+// and coherently mapped. map() hands out the next piece of it to write into and
+// copy() queues a glCopyBufferSubData from that piece into the destination,
+// followed by a fence. The pieces go round the buffer; a piece is only reused
+// once the fence of the copy that read it has signaled, and the CPU only waits
+// when the ring has come all the way round to a copy still in flight. Uploads
+// bigger than the ring grow it.
+//
+// Without glBufferStorage (GL 4.3) map() returns host memory and copy() falls
+// back to glBufferSubData.
+//
+// Not thread safe; the copies and fences are shared objects, so the ring may be
+// used on another shared context as long as one thread at a time does.
+class UploadRing
+{
+public:
+	UploadRing();
+
+	// Needs a current context
+	bool init(size_t bytes);
+	void destroy();
+
+	// Memory for the next `bytes` of upload, valid until copy()
+	void* map(size_t bytes);
+	// Queues the copy of the mapped bytes into dst at dstOffset
+	void copy(GLuint dst, size_t dstOffset);
+
+	// map() and copy() in one
+	void upload(GLuint dst, size_t dstOffset, const void* data, size_t bytes);
+
+	// Times map() had to wait for a copy to finish
+	int waits() const { return mWaits; }
+
+private:
+	struct Piece
+	{
+		size_t begin, end;
+		GLsync fence;
+	};
+
+	void retire(bool all);
+
+	GpuBuffer mBuffer;
+	char* mMapped;				// NULL without glBufferStorage
+	std::vector<char> mHost;	// the staging memory without it
+	size_t mSize;
+
+	size_t mHead;				// where the next piece starts
+	size_t mOffset, mBytes;		// the piece map() handed out
+	std::deque<Piece> mPending;	// copies in flight, oldest first
+	int mWaits;
+};
+
+#endif // UPLOAD_RING_H
@@ -19,6 +19,10 @@
 
 
 #include <fmt/core.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
 #include <vector>
 
 #include <iostream>
@@ -29,7 +33,29 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include "Batch.h"
+#include "CpuLbm.h"
+#include "CurvedBoundary.h"
+#include "Diagnostics.h"
+#include "FieldView.h"
+#include "Forces.h"
+#include "FrameCapture.h"
+#include "FrameStats.h"
+#include "Geometry.h"
+#include "GpuMemory.h"
+#include "Lbm3D.h"
+#include "LbmEngine.h"
+#include "PassScheduler.h"
+#include "PrecisionCheck.h"
+#include "Refinement.h"
 #include "ShaderProgram.h"
+#include "SimThread.h"
+#include "SparseTiles.h"
+#include "StepController.h"
+#include "Storage.h"
+#include "StreamingLbm.h"
+#include "Trace.h"
+#include "UploadRing.h"
 
 // Set to true to enable fullscreen
 bool FULLSCREEN = false;
@@ -52,12 +78,13 @@ const int gWindowHeightFull = 1200;
 bool gWireframe = false;
 
 GLuint VAO, VBO;
+GLuint particleVAO;             // empty, the particle shaders read the SSBs
 ShaderProgram obstacleShader;
 ShaderProgram particleShader;
 
 std::vector<float> vertices;
+std::mutex verticesMutex;       // vertices are rebuilt by the simulation, drawn by the renderer
 
-void showFPS(GLFWwindow* window);
 void glfw_onKey(GLFWwindow* window, int key, int scancode, int action, int mode);
 void glfw_onMouse(GLFWwindow* window, int button, int action, int mods);
 void glfw_onFramebufferSize(GLFWwindow* window, int width, int height);
@@ -68,34 +95,137 @@ void init_buffers(void);
 
 /*--------------------- Mouse ---------------------------------------------------------------------------*/
 int mousedown = 0;
-float xMouse, yMouse;
+// Set by the render thread, read by simulate() on the simulation thread (so are the atomics below)
+std::atomic<float> xMouse(0.0f), yMouse(0.0f);
 
 /*--------------------- LBM -----------------------------------------------------------------------------*/
-#define NUMR 20
+#define NUMR 20           // steps per frame to start from
 #define NUM_VECTORS 9    // lbm basis vectors (d2q9 model)
 
-float fx = 1, fx2 = 1;
-float fy = 0, fy2 = 0;
+float fx = 1, fy = 0;
+std::atomic<float> fx2(1.0f), fy2(0.0f);
 
 float angle = 0;                // for rotations of the body force vec
-float force = -0.000007;        // body force magnitude
+std::atomic<float> force(-0.000007f);   // body force magnitude
 int c = 0;
+PassScheduler passes;           // the steps of a frame, see PassScheduler.h
+
+// Collision operator, same values as COLL_* in shaders/lbm.cs. M cycles them at runtime, L toggles LES.
+enum Collision { COLL_BGK, COLL_MRT, COLL_CUMULANT, NUM_COLLISIONS };
+const char* COLLISION_NAMES[NUM_COLLISIONS] = { "BGK", "MRT", "cumulant" };
+std::atomic<int> COLLISION(COLL_BGK);
+// What the sampled (last) step of a frame writes, same values as OUT_* in shaders/lbm.cs.
+// OUTPUT_FIELDS adds the packed rho, pressure, speed and vorticity of cFields_SSB.
+enum Output { OUT_VELOCITY = 1, OUT_FIELDS = 2 };
+bool OUTPUT_FIELDS = false;
+
+// With STEP_BUDGET_MS > 0 the steps per frame adapt so the solver takes about that much GPU
+// time per frame, between STEPS_MIN and STEPS_MAX (per batch with SIM_THREAD). Steps per frame,
+// GPU time per step and lattice time per second are printed every STEPS_INTERVAL seconds.
+double STEP_BUDGET_MS = 10.0;
+int STEPS_MIN = 1;
+int STEPS_MAX = 1000;
+double STEPS_INTERVAL = 1.0;
+StepController stepControl(NUMR, STEPS_MIN, STEPS_MAX, STEPS_INTERVAL);
+
+std::atomic<float> TAU(0.631f);         // nu = (TAU - 1/2) / 3, MRT and cumulant stay stable much closer to 1/2
+std::atomic<float> SMAGORINSKY_C(0.0f); // 0 is no LES, 0.1-0.2 is usual
+float SMAGORINSKY_ON = 0.1;     // value L switches to
+
+// FP16 storage halves the memory traffic of the step. Set PRECISION_CHECK to run a channel flow
+// headless in every storage mode and print their errors against FP32 instead of the demo.
+Storage STORAGE = STORAGE_FP32;
+bool PRECISION_CHECK = false;
+
+// Runs every scenario of BATCH_FILE (or of the file named on the command line) headless
+// instead of the demo and writes their metrics and fields into BATCH_DIR, see Batch.h
+const char* BATCH_FILE = NULL;
+const char* BATCH_DIR = "batch";
+// Step the scenarios of the batch that share a grid side by side in one dispatch, see LbmEnsemble.h
+bool ENSEMBLE = false;
+
+// Only dispatch the 10x10 tiles that contain fluid, the list is rebuilt whenever the obstacle moves
+bool SPARSE_TILES = true;
+SparseTiles sparseTiles;
+
+// Run a patch at twice the resolution around the obstacle, two fine steps per coarse step.
+// Needs STORAGE_FP32, REFINE_SIZE is the side of the patch in coarse cells.
+bool REFINE = false;
+int REFINE_SIZE = 3 * (NX / 14);
+Refinement refinement;
+
+/*--------------------- Simulation thread ---------------------------------------------------------------*/
+// SIM_THREAD steps the 2D demo on its own thread and context and draws the newest finished
+// snapshot of particles and fields, so vsync no longer holds back the solver (see SimThread.h).
+// SIM_RATE caps it at that many batches of steps per second, 0 runs as fast as it can.
+bool SIM_THREAD = false;
+double SIM_RATE = 0.0;
+SimThread simThread;
+GpuBuffer snapParticles_SSB[SimThread::NUM_SLOTS];
+GpuBuffer snapFields_SSB[SimThread::NUM_SLOTS];
+GpuBuffer snapFlags_SSB[SimThread::NUM_SLOTS];
+// What a snapshot holds, written with it by simulate() and drawn as such: the view may change
+// between the batch and the frame, and the fields are only copied for the field views
+struct Snapshot
+{
+    int view;
+    int particles;
+};
+Snapshot snapshots[SimThread::NUM_SLOTS];
+Snapshot liveSnapshot;          // the same for the live buffers without the simulation thread
+
+// Requests from the render thread, picked up by the next simulate()
+std::atomic<bool> obstacleMoved(false);
+std::atomic<bool> particlesReset(false);
+
+/*--------------------- 3D ------------------------------------------------------------------------------*/
+// LBM_3D replaces the 2D demo with a D3Q19 duct around a sphere, drawn as the speed on one
+// z slice (Up/Down move it). BENCHMARK_3D steps it headless instead and prints MLUPS.
+bool LBM_3D = false;
+bool BENCHMARK_3D = false;
+
+// Steps the 2D channel on the CPU split into slabs of rows, one worker thread each, and prints
+// strong and weak scaling over the slab counts instead of the demo; runs without a GPU.
+bool BENCHMARK_CPU = false;
+
+// Steps a channel larger than memory with the populations in files, a band of rows at a time,
+// and prints MLUPS and the file traffic instead of the demo; runs without a GPU.
+bool OUT_OF_CORE = false;
+const int NX3D = 192;
+const int NY3D = 96;
+const int NZ3D = 64;
+float SPEED_3D = 0.05;          // speed at the top of the colour ramp
+int slice3D = NZ3D / 2;
+Lbm3D lbm3D;
+
+/*--------------------- Obstacle ------------------------------------------------------------------------*/
+// The obstacle is a circle unless OBSTACLE_FILE names a PGM mask (dark is solid) or a polygon
+// file, see Geometry.h. BOUZIDI cuts its links at the real outline instead of half-way (FP32 only).
+const char* OBSTACLE_FILE = NULL;
+bool BOUZIDI = true;
+Geometry geometry;
+CurvedBoundary curvedBoundary;
+std::vector<float> obstacleSdf;
 
 /*--------------------- LBM State vector ----------------------------------------------------------------*/
-GLuint c0_SSB;
-GLuint c1_SSB;
+GpuBuffer c0_SSB;
+GpuBuffer c1_SSB;
+
+// Every upload after creation goes through it, see UploadRing.h
+UploadRing uploads;
 
-GLuint cF_SSB;
-GLuint cU_SSB;
-GLuint cV_SSB;
+GpuBuffer cF_SSB;
+GpuBuffer cU_SSB;
+GpuBuffer cV_SSB;
+GpuBuffer cFields_SSB;
 
 int F_cpu[NX * NY];
 
 /*--------------------- Particles -----------------------------------------------------------------------*/
-float dt = 0.1;
+std::atomic<float> dt(0.1f);
 
-GLuint col_SSB;
-GLuint particles_SSB;
+GpuBuffer col_SSB;
+GpuBuffer particles_SSB;
 
 struct p
 {
@@ -107,6 +237,54 @@ struct col
     float r, g, b, a;
 };
 
+/*--------------------- View ----------------------------------------------------------------------------*/
+// F cycles between the particles and the speed or vorticity fields. Fields are drawn as one
+// texture with FIELD_PARTICLES particles on top (0 for none), particles use all NUM_PARTICLE.
+enum View { VIEW_PARTICLES, VIEW_SPEED, VIEW_VORTICITY, NUM_VIEWS };
+const char* VIEW_NAMES[NUM_VIEWS] = { "particles", "speed", "vorticity" };
+std::atomic<int> VIEW(VIEW_PARTICLES);
+int FIELD_PARTICLES = 100000;
+float SPEED_RANGE = 0.1;        // speed at the top of the palette
+float VORTICITY_RANGE = 0.01;   // vorticity at either end of the palette
+FieldView fieldView;
+
+/*--------------------- Frame statistics ----------------------------------------------------------------*/
+// Frame time percentiles and steps/s are printed every STATS_INTERVAL seconds,
+// or written as CSV to STATS_FILE when it is set
+const char* STATS_FILE = NULL;
+double STATS_INTERVAL = 1.0;
+
+/*--------------------- Diagnostics ---------------------------------------------------------------------*/
+// Total mass, momentum, kinetic energy, max |u| and NaN cells are reduced on the GPU
+// and printed every DIAG_INTERVAL steps, 0 turns them off
+int DIAG_INTERVAL = 1000;
+Diagnostics diagnostics(NX, NY, DIAG_INTERVAL);
+
+/*--------------------- Forces --------------------------------------------------------------------------*/
+// Drag/lift on the obstacle from momentum exchange, sampled every FORCE_INTERVAL steps
+// (0 turns it off) and printed, or written as a CSV time series to FORCE_FILE
+int FORCE_INTERVAL = 1000;
+const char* FORCE_FILE = NULL;
+Forces forces(FORCE_INTERVAL, 2 * (NX / 14));
+
+/*--------------------- GPU memory ----------------------------------------------------------------------*/
+// Live GPU memory per subsystem is printed after start up, on G and on exit. With GPU_BUDGET_MB > 0
+// an allocation that would take the total over it is warned about before it is made.
+double GPU_BUDGET_MB = 0.0;
+
+/*--------------------- Trace ---------------------------------------------------------------------------*/
+// Built with -DLBM_TRACE=ON the CPU and GPU zones of every frame are written to
+// TRACE_FILE on exit, open it in chrome://tracing or ui.perfetto.dev
+const char* TRACE_FILE = "trace.json";
+
+/*--------------------- Capture -------------------------------------------------------------------------*/
+// Press V to start/stop recording. Frames go to a raw .y4m file, or through a local
+// ffmpeg into an .mp4 when CAPTURE_FFMPEG is set. CAPTURE_POLICY decides whether a
+// slow writer drops frames or holds back the render loop.
+bool CAPTURE_FFMPEG = false;
+FrameCapture::Policy CAPTURE_POLICY = FrameCapture::DROP;
+FrameCapture capture;
+
 /*--------------------- Shader Programs ------------------------------------------------------------------*/
 GLuint lbmCS_Program;
 GLuint moveparticlesCS_Program;
@@ -137,62 +315,80 @@ std::string fileToString(const std::string& filename)
 }
 
 /*--------------------- Generate buffers------------------------------------------------------------------*/
-void GenerateSSB(GLuint& bufid, int width, int height, float a)
+void GenerateSSB(GpuBuffer& bufid, const char* subsystem, int width, int height, float a)
 {
-    glGenBuffers(1, &bufid);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, bufid);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, width * height * sizeof(float), NULL, GL_DYNAMIC_DRAW);
-    float* temp = (float*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, width * height * sizeof(float), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    bufid.create(subsystem, width * height * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+    float* temp = (float*)uploads.map(width * height * sizeof(float));
     for (int y = 0; y < height; y++)
         for (int x = 0; x < width; x++)
             temp[x + y * width] = a;
-    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    uploads.copy(bufid, 0);
 }
 
 /*--------------------- Reset positions in particle buffers -----------------------------------------------*/
 void resetparticles(void)
 {
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, particles_SSB);
-    p* parGPU = (p*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, NUM_PARTICLE * sizeof(p), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    p* parGPU = (p*)uploads.map(NUM_PARTICLE * sizeof(p));
     int i = 0;
     for (i = 0; i < NUM_PARTICLE; i++)
     {
         parGPU[i].x = (float)rand() / (float)RAND_MAX;
         parGPU[i].y = (float)rand() / (float)RAND_MAX;
     }
-    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    uploads.copy(particles_SSB, 0);
+}
+
+/*--------------------- Snapshot buffers and the simulation thread ----------------------------------------*/
+int simulate(int slot);
+
+void initSimThread(void)
+{
+    for (int i = 0; i < SimThread::NUM_SLOTS; i++)
+    {
+        snapParticles_SSB[i].create("snapshots", NUM_PARTICLE * sizeof(p), NULL, GL_DYNAMIC_COPY);
+        snapFields_SSB[i].create("snapshots", NX * NY * 4 * sizeof(float), NULL, GL_DYNAMIC_COPY);
+        snapFlags_SSB[i].create("snapshots", NX * NY * sizeof(int), NULL, GL_DYNAMIC_COPY);
+    }
+
+    simThread.start(gWindow, simulate, SIM_RATE);
+}
+
+/*--------------------- Move the refined patch onto the obstacle -------------------------------------------*/
+void placeRefinement(void)
+{
+    // Same centre and radius as updateObstacle(), onto the newest populations
+    refinement.place(geometry, NX / 2 + xMouse * NX / 2.0f, NY / 2 + yMouse * NY / 2.0f, NX / 14,
+        c == 0 ? c0_SSB : c1_SSB, TAU);
+}
+
+/*--------------------- Move the 3D sphere ----------------------------------------------------------------*/
+void updateObstacle3D(void)
+{
+    // Same place and size relative to the domain as the 2D obstacle, half way in z
+    lbm3D.setObstacle(NX3D / 2 + xMouse * NX3D / 2.0f, NY3D / 2 + yMouse * NY3D / 2.0f, NZ3D / 2, NX3D / 14);
 }
 
 /*--------------------- Update obstacle flags -------------------------------------------------------------*/
 void updateObstacle(void)
 {
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cF_SSB);
-    int* F_temp = (int*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, NX * NY * sizeof(int), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    int* F_temp = (int*)uploads.map(NX * NY * sizeof(int));
 
-    for (int x = 0; x < NX; x++)
-        for (int y = 0; y < NY; y++)
-        {
-            int xx = x - (xMouse) * NX / 2.0;
-            int yy = y - (yMouse) * NY / 2.0;
-            int idx = x + y * NX;
-            if (idx > NX * NY)    break;
-            if (sqrt(float((xx - NX / 2) * (xx - NX / 2) + (yy - NY / 2) * (yy - NY / 2))) < NX / 14)
-            {
-                F_cpu[idx] = 0;
-                F_temp[idx] = 0;
-            }
-            else
-            {
-                F_cpu[idx] = 1;
-                F_temp[idx] = 1;
-            }
-        }
+    geometry.rasterize(NX / 2 + xMouse * NX / 2.0f, NY / 2 + yMouse * NY / 2.0f, NX / 14, NX, NY, obstacleSdf);
+    for (int idx = 0; idx < NX * NY; idx++)
+    {
+        F_cpu[idx] = obstacleSdf[idx] < 0.0f ? 0 : 1;
+        F_temp[idx] = F_cpu[idx];
+    }
 
     for (int x = 0; x < NX; x++)
         F_temp[x + 0 * NX] = F_temp[x + (NY - 1) * NX] = 0;
 
-    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    uploads.copy(cF_SSB, 0);
 
+    curvedBoundary.update(obstacleSdf);
+
+    // draw() uploads them on the render thread
+    std::lock_guard<std::mutex> lock(verticesMutex);
     vertices.clear();
     for (int x = 0; x < NX; x++) {
         for (int y = 0; y < NY; y++) {
@@ -225,8 +421,31 @@ void init(void)
     fx2 = fx; fy2 = fy;        // init force
 
     /*-------------------- Compute shaders programs etc. ----------------------------------------------------*/
+    if (OBSTACLE_FILE != NULL)
+        geometry.load(OBSTACLE_FILE);
+
+    if (BOUZIDI && STORAGE != STORAGE_FP32)
+        fmt::println("Bouzidi bounce-back needs FP32 storage, running half-way");
+    else if (BOUZIDI)
+        curvedBoundary.init(NX, NY);
+
     init_shaders();
     init_buffers();
+    fieldView.init(NX, NY);
+
+    if (DIAG_INTERVAL > 0)
+        diagnostics.init(storageDefines(STORAGE));
+
+    if (FORCE_INTERVAL > 0)
+    {
+        forces.init();
+        forces.setOutput(FORCE_FILE);
+    }
+
+    if (REFINE && STORAGE != STORAGE_FP32)
+        fmt::println("Refinement needs FP32 storage, running without it");
+    else if (REFINE && refinement.init(NX, NY, REFINE_SIZE, REFINE_SIZE, cF_SSB, cU_SSB, cV_SSB))
+        placeRefinement();
 }
 
 void init_shaders(void)
@@ -236,7 +455,7 @@ void init_shaders(void)
 
     // Create the compute shader for LBM
     GLuint lbmCS_Shader;
-    std::string csString = fileToString("shaders/lbm.cs");
+    std::string csString = ShaderProgram::insertDefines(fileToString("shaders/lbm.cs"), storageDefines(STORAGE));
     const GLchar* lbmCS_Source = csString.c_str();
     lbmCS_Shader = glCreateShader(GL_COMPUTE_SHADER);
     glShaderSource(lbmCS_Shader, 1, &lbmCS_Source, NULL);
@@ -279,6 +498,7 @@ void init_shaders(void)
     // Create VAO and VBOs
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
+    glGenVertexArrays(1, &particleVAO);
 
     // Load the vertex and fragment shaders for rendering the results
     obstacleShader.loadShaders("shaders/vert.glsl", "shaders/frag.glsl");
@@ -288,49 +508,37 @@ void init_shaders(void)
 void init_buffers(void)
 {
     /*---------------------- Initialise LBM vector state as SSB on GPU --------------------------------------*/
-    float w[] = { (4.0 / 9.0),(1.0 / 9.0),(1.0 / 9.0),(1.0 / 9.0),(1.0 / 9.0),(1.0 / 36.0),(1.0 / 36.0),(1.0 / 36.0),(1.0 / 36.0) };
-
-    glGenBuffers(1, &c0_SSB);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, c0_SSB);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, NX * NY * sizeof(float) * NUM_VECTORS, NULL, GL_STATIC_DRAW);
-    float* temp = (float*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, NX * NY * sizeof(float) * NUM_VECTORS, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-    for (int k = 0; k < NUM_VECTORS; k++)
-        for (int y = 0; y < NY; y++)
-            for (int x = 0; x < NX; x++)
-                temp[k + x * NUM_VECTORS + y * NX * NUM_VECTORS] = w[k];
-    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
-
-    glGenBuffers(1, &c1_SSB);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, c1_SSB);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, NX * NY * sizeof(float) * NUM_VECTORS, NULL, GL_STATIC_DRAW);
-    temp = (float*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, NX * NY * sizeof(float) * NUM_VECTORS, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
-    for (int k = 0; k < NUM_VECTORS; k++)
-        for (int y = 0; y < NY; y++)
-            for (int x = 0; x < NX; x++)
-                temp[k + x * NUM_VECTORS + y * NX * NUM_VECTORS] = w[k];
-    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
-
-    glGenBuffers(1, &cF_SSB);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cF_SSB);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, NX * NY * sizeof(int), NULL, GL_STATIC_DRAW);
+    size_t latticeBytes = NX * NY * storageBytesPerCell(STORAGE);
+
+    // The populations are the biggest upload, later ones (obstacle, particles) are far smaller
+    uploads.init(latticeBytes);
+
+    c0_SSB.create("lattice", latticeBytes, NULL, GL_STATIC_DRAW);
+    void* temp = uploads.map(latticeBytes);
+    storageFillRest(temp, NX * NY, STORAGE);
+    uploads.copy(c0_SSB, 0);
+
+    c1_SSB.create("lattice", latticeBytes, NULL, GL_STATIC_DRAW);
+    temp = uploads.map(latticeBytes);
+    storageFillRest(temp, NX * NY, STORAGE);
+    uploads.copy(c1_SSB, 0);
+
+    cF_SSB.create("lattice", NX * NY * sizeof(int), NULL, GL_STATIC_DRAW);
     updateObstacle();
-    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
 
-    GenerateSSB(cU_SSB, NX, NY, 0.0);
-    GenerateSSB(cV_SSB, NX, NY, 0.0);
+    GenerateSSB(cU_SSB, "fields", NX, NY, 0.0);
+    GenerateSSB(cV_SSB, "fields", NX, NY, 0.0);
+    GenerateSSB(cFields_SSB, "fields", 4 * NX, NY, 0.0);
 
     // Generate particles
-    glGenBuffers(1, &particles_SSB);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, particles_SSB);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, NUM_PARTICLE * sizeof(p), NULL, GL_STATIC_DRAW);
-    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    particles_SSB.create("particles", NUM_PARTICLE * sizeof(p), NULL, GL_STATIC_DRAW);
 
     resetparticles();
 
-    glGenBuffers(1, &col_SSB);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, col_SSB);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, NUM_PARTICLE * sizeof(struct col), NULL, GL_STATIC_DRAW);
-    struct col* colors = (struct col*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, NUM_PARTICLE * sizeof(struct col), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    col_SSB.create("particles", NUM_PARTICLE * sizeof(struct col), NULL, GL_STATIC_DRAW);
+    struct col* colors = (struct col*)uploads.map(NUM_PARTICLE * sizeof(struct col));
+    // The loop only colours every other particle, the rest stay transparent
+    memset(colors, 0, NUM_PARTICLE * sizeof(struct col));
 
     for (int i = 0; i < NUM_PARTICLE; i++)
     {
@@ -344,13 +552,16 @@ void init_buffers(void)
         i++;
     }
 
-    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    uploads.copy(col_SSB, 0);
 
     /*---------------------- Some bindings ------------------------------------------------------------------*/
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cF_SSB);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cU_SSB);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, cV_SSB);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, particles_SSB);
+
+    if (SPARSE_TILES)
+        sparseTiles.init(NX, NY);
 }
 
 bool initOpenGL()
@@ -373,6 +584,10 @@ bool initOpenGL()
     glfwWindowHint(GLFW_BLUE_BITS, 8);        // Blue channel bits
     glfwWindowHint(GLFW_ALPHA_BITS, 8);        // Alpha channel bits
 
+    // The precision check and the benchmark only need a context, keep their window hidden
+    if (PRECISION_CHECK || BENCHMARK_3D || BATCH_FILE != NULL)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
     // Create a window
     if (FULLSCREEN)
         gWindow = glfwCreateWindow(gWindowWidthFull, gWindowHeightFull, APP_TITLE, glfwGetPrimaryMonitor(), NULL);
@@ -402,55 +617,163 @@ bool initOpenGL()
     else
         glViewport(0, 0, gWindowWidth, gWindowHeight);
 
-    init();
+    if (PRECISION_CHECK || BENCHMARK_3D || BATCH_FILE != NULL)
+        return true;
+
+    if (!LBM_3D)
+        init();
+    else if (lbm3D.init(NX3D, NY3D, NZ3D))
+        updateObstacle3D();
 
     return true;
 }
 
-void render(void)
+/*--------------------- Mouse position in [-1, 1] ---------------------------------------------------------*/
+void pollMouse(void)
 {
-    if (mousedown) {
-        //glfwSetInputMode(gWindow, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    double lastMouseX, lastMouseY;
+    // Get the current mouse cursor position delta
+    glfwGetCursorPos(gWindow, &lastMouseX, &lastMouseY);
 
-        double lastMouseX, lastMouseY;
-        // Get the current mouse cursor position delta
-        glfwGetCursorPos(gWindow, &lastMouseX, &lastMouseY);
+    if (FULLSCREEN) {
+        xMouse = 2.0 * ((float)lastMouseX / (float)gWindowWidthFull - 0.5);
+        yMouse = -2.0 * ((float)lastMouseY / (float)gWindowHeightFull - 0.5);
+    }
+    else
+    {
+        xMouse = 2.0 * ((float)lastMouseX / (float)gWindowWidth - 0.5);
+        yMouse = -2.0 * ((float)lastMouseY / (float)gWindowHeight - 0.5);
+    }
+}
 
-        if (FULLSCREEN) {
-            xMouse = 2.0 * ((float)lastMouseX / (float)gWindowWidthFull - 0.5);
-            yMouse = -2.0 * ((float)lastMouseY / (float)gWindowHeightFull - 0.5);
-        }
-        else
-        {
-            xMouse = 2.0 * ((float)lastMouseX / (float)gWindowWidth - 0.5);
-            yMouse = -2.0 * ((float)lastMouseY / (float)gWindowHeight - 0.5);
-        }
+/*--------------------- Particles that are moved and drawn ------------------------------------------------*/
+int drawnParticles(int view)
+{
+    // Work groups of 1000, only the ones that are drawn move
+    return view == VIEW_PARTICLES ? NUM_PARTICLE : std::min(FIELD_PARTICLES, NUM_PARTICLE) / 1000 * 1000;
+}
+
+/*--------------------- One batch of steps, on the simulation thread when there is one --------------------*/
+// Copies what draw() reads into snapshot `slot` unless it is -1, returns the steps done
+int simulate(int slot)
+{
+    if (obstacleMoved.exchange(false)) {
+        TRACE_GPU_ZONE("updateObstacle");
         updateObstacle();
+        sparseTiles.rebuild();
+        placeRefinement();
     }
 
+    if (particlesReset.exchange(false))
+        resetparticles();
+
+    // Bindings are per context, the simulation context starts with none
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cF_SSB);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cU_SSB);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, cV_SSB);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, particles_SSB);
+
+    // The controls once for the whole batch, the render thread may change them meanwhile
+    int view = VIEW;
+    int collision = COLLISION;
+    float tau = TAU, smagorinsky = SMAGORINSKY_C;
+    float bodyX = fx2 * force, bodyY = fy2 * force;
+
+    bool fields = OUTPUT_FIELDS || view != VIEW_PARTICLES;
+
+    int steps = stepControl.steps();
+
     // computation (!)
-    for (int i = 0; i < NUMR; i++)
-    {
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, c, c0_SSB);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1 - c, c1_SSB);
-        c = 1 - c;
-        glUseProgram(lbmCS_Program);
-        glUniform1f(2, fx2 * force);                // set body force in the shader
-        glUniform1f(3, fy2 * force);
-        glDispatchCompute(NX / 10, NY / 10, 1);
+    {
+        TRACE_GPU_ZONE("lbm");
+        stepControl.begin();
+        // The same steps as LbmEngine, plus the refined patch after each one
+        LbmEngine::StepSetup setup;
+        setup.program = lbmCS_Program;
+        setup.f[0] = c0_SSB;
+        setup.f[1] = c1_SSB;
+        setup.flags = cF_SSB;
+        setup.u = cU_SSB;
+        setup.v = cV_SSB;
+        setup.fields = cFields_SSB;     // Diagnostics binds its own at 6 outside the passes
+        setup.nx = NX;
+        setup.ny = NY;
+        setup.fx = bodyX;
+        setup.fy = bodyY;
+        setup.tau = tau;
+        setup.smagorinsky = smagorinsky;
+        setup.collision = collision;
+        setup.forceSlot = forces.begin(steps);                  // momentum exchange on the last step only
+        setup.outputs = OUT_VELOCITY | (fields ? OUT_FIELDS : 0);   // particles only see the last step
+        setup.sparse = SPARSE_TILES ? &sparseTiles : NULL;
+        setup.curved = &curvedBoundary;                         // no links without BOUZIDI
+        LbmEngine::schedule(passes, setup, steps, c, [&](GLuint src, GLuint dst) {
+            refinement.schedule(passes, lbmCS_Program, src, dst, bodyX, bodyY, tau);
+        });
+        passes.run();
+        forces.end();
+        stepControl.end(steps);
+    }
+
+    // The last step wrote to the buffer that was bound at 1
+    diagnostics.update(c == 0 ? c0_SSB : c1_SSB, steps);
+
+    int particles = drawnParticles(view);
+    Snapshot& snapshot = slot >= 0 ? snapshots[slot] : liveSnapshot;
+    snapshot.view = view;
+    snapshot.particles = particles;
+
+    {
+        TRACE_GPU_ZONE("particles");
+        glUseProgram(moveparticlesCS_Program);
+        glDispatchCompute(particles / 1000, 1, 1);
         glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        glUniform1f(2, dt);
         glUseProgram(0);
     }
 
-    glUseProgram(moveparticlesCS_Program);
-    glDispatchCompute(NUM_PARTICLE / 1000, 1, 1);
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-    glUniform1f(2, dt);
-    glUseProgram(0);
+    if (slot >= 0)
+    {
+        TRACE_GPU_ZONE("snapshot");
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        glBindBuffer(GL_COPY_READ_BUFFER, particles_SSB);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, snapParticles_SSB[slot]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, particles * sizeof(p));
+        if (fields)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, cFields_SSB);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, snapFields_SSB[slot]);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, NX * NY * 4 * sizeof(float));
+            glBindBuffer(GL_COPY_READ_BUFFER, cF_SSB);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, snapFlags_SSB[slot]);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, NX * NY * sizeof(int));
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    return steps;
+}
+
+/*--------------------- Draw particles, obstacles and fields from the given buffers -----------------------*/
+void draw(const Snapshot& snapshot, GLuint particlesBuffer, GLuint fieldsBuffer, GLuint flagsBuffer)
+{
+    int view = snapshot.view;
+    int particles = snapshot.particles;
 
     // Render
     glClear(GL_COLOR_BUFFER_BIT);
 
+    // Opaque, before the blending of obstacles and particles is enabled
+    if (view != VIEW_PARTICLES)
+    {
+        TRACE_GPU_ZONE("field");
+        if (view == VIEW_SPEED)
+            fieldView.draw(fieldsBuffer, flagsBuffer, FieldView::SPEED, SPEED_RANGE);
+        else
+            fieldView.draw(fieldsBuffer, flagsBuffer, FieldView::VORTICITY, VORTICITY_RANGE);
+    }
+
     glEnable(GL_POINT_SMOOTH);
     glEnable(GL_MULTISAMPLE);
 
@@ -458,36 +781,123 @@ void render(void)
 	glBlendFunc(GL_SRC_COLOR, GL_ONE_MINUS_SRC_COLOR);
 	//glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    // Bind VAO VBO
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_DYNAMIC_DRAW);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
-    glEnableVertexAttribArray(0);
-
-    // Render obstacles
-    obstacleShader.use();
-    glBindVertexArray(VAO);
-    glDrawArrays(GL_TRIANGLES, 0, vertices.size() / 2);
-    glBindVertexArray(0);
+    // Bind VAO VBO, the field views have the obstacle in their texture
+    if (view == VIEW_PARTICLES)
+    {
+        TRACE_GPU_ZONE("obstacles");
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        GLsizei count;
+        {
+            std::lock_guard<std::mutex> lock(verticesMutex);
+            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_DYNAMIC_DRAW);
+            count = (GLsizei)(vertices.size() / 2);
+        }
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+        glEnableVertexAttribArray(0);
+
+        // Render obstacles
+        obstacleShader.use();
+        glBindVertexArray(VAO);
+        glDrawArrays(GL_TRIANGLES, 0, count);
+        glBindVertexArray(0);
+    }
 
     // Render particles
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particles_SSB);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particlesBuffer);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, col_SSB);
 
-    GLuint defaultVAO;
-    glGenVertexArrays(1, &defaultVAO);
-    glBindVertexArray(defaultVAO);
+    glBindVertexArray(particleVAO);
 
-    particleShader.use();
-    glDrawArrays(GL_POINTS, 0, NUM_PARTICLE); // Render particles
-    glBindVertexArray(0);
+    {
+        TRACE_GPU_ZONE("drawParticles");
+        particleShader.use();
+        glDrawArrays(GL_POINTS, 0, particles); // Render particles
+        glBindVertexArray(0);
+    }
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Returns the steps done since the last frame
+int render(void)
+{
+    if (mousedown) {
+        //glfwSetInputMode(gWindow, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        pollMouse();
+        obstacleMoved = true;
+    }
+
+    int steps;
+    if (simThread.isRunning())
+    {
+        // Newest finished snapshot, the simulation keeps going meanwhile
+        int slot = simThread.acquire();
+        draw(snapshots[slot], snapParticles_SSB[slot], snapFields_SSB[slot], snapFlags_SSB[slot]);
+        simThread.release();
+        steps = simThread.takeSteps();
+    }
+    else
+    {
+        steps = simulate(-1);
+        draw(liveSnapshot, particles_SSB, cFields_SSB, cF_SSB);
+    }
+
+    {
+        TRACE_ZONE("capture");
+        capture.capture();
+    }
 
     // Swap the front and back buffers
-    glfwSwapBuffers(gWindow);
+    {
+        TRACE_ZONE("swap");
+        glfwSwapBuffers(gWindow);
+    }
     glfwPollEvents();
+
+    TRACE_FRAME();
+    return steps;
+}
+
+int render3D(void)
+{
+    if (mousedown) {
+        double lastMouseX, lastMouseY;
+        glfwGetCursorPos(gWindow, &lastMouseX, &lastMouseY);
+        xMouse = 2.0 * ((float)lastMouseX / (float)gWindowWidth - 0.5);
+        yMouse = -2.0 * ((float)lastMouseY / (float)gWindowHeight - 0.5);
+
+        TRACE_GPU_ZONE("updateObstacle");
+        updateObstacle3D();
+    }
+
+    int steps = stepControl.steps();
+    {
+        TRACE_GPU_ZONE("lbm3d");
+        stepControl.begin();
+        lbm3D.step(steps, fx2 * force, fy2 * force, 0.0f, TAU);
+        stepControl.end(steps);
+    }
+
+    glClear(GL_COLOR_BUFFER_BIT);
+    {
+        TRACE_GPU_ZONE("slice");
+        lbm3D.drawSlice(slice3D, SPEED_3D);
+    }
+
+    {
+        TRACE_ZONE("capture");
+        capture.capture();
+    }
+
+    {
+        TRACE_ZONE("swap");
+        glfwSwapBuffers(gWindow);
+    }
+    glfwPollEvents();
+
+    TRACE_FRAME();
+    return steps;
 }
 
 void glfw_onFramebufferSize(GLFWwindow* window, int width, int height)
@@ -512,9 +922,39 @@ void glfw_onKey(GLFWwindow* window, int key, int scancode, int action, int mode)
     }
 
     if (key == GLFW_KEY_D && action == GLFW_PRESS) { dt = -dt; }
-    if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) { resetparticles(); }
-    if (key == GLFW_KEY_KP_ADD && action == GLFW_PRESS) { force *= (-1); }
-    if (key == GLFW_KEY_KP_SUBTRACT && action == GLFW_PRESS) { force *= 0.98; }
+    if (key == GLFW_KEY_V && action == GLFW_PRESS)
+    {
+        // The framebuffer, not the window: they differ in fullscreen and on HiDPI displays
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        if (capture.isRecording())
+            capture.stop();
+        else if (CAPTURE_FFMPEG)
+            capture.start("capture.mp4", width, height, 60, FrameCapture::FFMPEG, CAPTURE_POLICY);
+        else
+            capture.start("capture.y4m", width, height, 60, FrameCapture::Y4M, CAPTURE_POLICY);
+    }
+    if (key == GLFW_KEY_M && action == GLFW_PRESS)
+    {
+        COLLISION = (COLLISION + 1) % NUM_COLLISIONS;
+        fmt::println("Collision: {}", COLLISION_NAMES[COLLISION]);
+    }
+    if (key == GLFW_KEY_L && action == GLFW_PRESS)
+    {
+        SMAGORINSKY_C = SMAGORINSKY_C > 0.0f ? 0.0f : SMAGORINSKY_ON;
+        fmt::println("Smagorinsky LES: C = {}", SMAGORINSKY_C.load());
+    }
+    if (key == GLFW_KEY_G && action == GLFW_PRESS) { GpuMemory::report(); }
+    if (key == GLFW_KEY_F && action == GLFW_PRESS)
+    {
+        VIEW = (VIEW + 1) % NUM_VIEWS;
+        fmt::println("View: {}", VIEW_NAMES[VIEW]);
+    }
+    if (key == GLFW_KEY_UP && action != GLFW_RELEASE) { slice3D = std::min(slice3D + 1, NZ3D - 1); }
+    if (key == GLFW_KEY_DOWN && action != GLFW_RELEASE) { slice3D = std::max(slice3D - 1, 0); }
+    if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) { particlesReset = true; }
+    if (key == GLFW_KEY_KP_ADD && action == GLFW_PRESS) { force = -force; }
+    if (key == GLFW_KEY_KP_SUBTRACT && action == GLFW_PRESS) { force = force * 0.98f; }
 
     if (key == GLFW_KEY_R && action == GLFW_PRESS)
     {
@@ -535,45 +975,101 @@ void glfw_onMouse(GLFWwindow* window, int button, int action, int mods)
     }
 }
 
-void showFPS(GLFWwindow* window) {
-    static double previousSeconds = 0.0;
-    static int frameCount = 0;
-    double elapsedSeconds;
-    double currentSeconds = glfwGetTime();
+/*--------------------- Main loop ---------------------------------------------------------------------------*/
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+        BATCH_FILE = argv[1];
+    GpuMemory::setBudget(size_t(GPU_BUDGET_MB * 1024 * 1024));
 
-    elapsedSeconds = currentSeconds - previousSeconds;
+    if (BENCHMARK_CPU)
+        return runCpuBenchmark(CpuBenchmark()) ? 0 : -1;
+    if (OUT_OF_CORE)
+        return runStreamingLbm(StreamingLbmRun()) ? 0 : -1;
 
-    if (elapsedSeconds > 0.25) {
-        previousSeconds = currentSeconds;
-        double fps = (double)frameCount / elapsedSeconds;
-        double msPerFrame = 1000.0 / fps;
+    if (!initOpenGL())
+    {
+        fmt::println("GLFW initialization failed");
+        return -1;
+    }
 
-        char title[80];
-        std::snprintf(title, sizeof(title), "Hello LBM @ fps: %.2f, ms/frame: %.2f", fps, msPerFrame);
-        glfwSetWindowTitle(window, title);
+    if (PRECISION_CHECK)
+    {
+        bool ok = runPrecisionCheck(PrecisionConfig());
 
-        frameCount = 0;
+        glfwTerminate();
+        return ok ? 0 : -1;
     }
 
-    frameCount++;
-}
+    if (BENCHMARK_3D)
+    {
+        bool ok = runLbm3DBenchmark(Lbm3DBenchmark());
 
-/*--------------------- Main loop ---------------------------------------------------------------------------*/
-int main(int argc, char** argv)
-{
+        glfwTerminate();
+        return ok ? 0 : -1;
+    }
 
-    if (!initOpenGL())
+    if (BATCH_FILE != NULL)
     {
-        fmt::println("GLFW initialization failed");
-        return -1;
+        std::vector<Scenario> scenarios;
+        bool ok = loadScenarios(BATCH_FILE, scenarios) &&
+            (ENSEMBLE ? runEnsemble(scenarios, BATCH_DIR) : runBatch(scenarios, BATCH_DIR));
+        GpuMemory::report();
+
+        glfwTerminate();
+        return ok ? 0 : -1;
     }
 
+    FrameStats stats("Hello LBM", STATS_INTERVAL);
+    stats.setWindow(gWindow);
+    stats.setOutput(STATS_FILE);
+
+    stepControl.setBudget(STEP_BUDGET_MS);
+    if (SIM_THREAD && !LBM_3D)
+        initSimThread();
+    GpuMemory::report();
+
     while (!glfwWindowShouldClose(gWindow))
     {
-        showFPS(gWindow);
-        render();
+        stats.beginFrame();
+        int steps = LBM_3D ? render3D() : render();
+        stats.endFrame(steps);
     }
 
+    // Before anything it uses goes away
+    simThread.stop();
+    GpuMemory::report("GPU memory on exit");
+    for (int i = 0; i < SimThread::NUM_SLOTS; i++)
+    {
+        snapParticles_SSB[i].destroy();
+        snapFields_SSB[i].destroy();
+        snapFlags_SSB[i].destroy();
+    }
+
+    TRACE_WRITE(TRACE_FILE);
+    capture.stop();
+    stepControl.destroy();
+    diagnostics.destroy();
+    forces.destroy();
+    sparseTiles.destroy();
+    refinement.destroy();
+    curvedBoundary.destroy();
+    lbm3D.destroy();
+    fieldView.destroy();
+    uploads.destroy();
+
+    c0_SSB.destroy();
+    c1_SSB.destroy();
+    cF_SSB.destroy();
+    cU_SSB.destroy();
+    cV_SSB.destroy();
+    cFields_SSB.destroy();
+    particles_SSB.destroy();
+    col_SSB.destroy();
+    glDeleteBuffers(1, &VBO);
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteVertexArrays(1, &particleVAO);
+
     glfwTerminate();
     return 0;
 }
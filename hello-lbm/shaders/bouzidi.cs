@@ -0,0 +1,65 @@
+// Interpolated bounce-back on the cut links of the obstacle, see CurvedBoundary.h
+#version 430 core
+
+#define NUM_VECTORS 9
+const int ex[9] = {0,  1,0,-1, 0,  1,-1,-1, 1};
+const int ey[9] = {0,  0,1, 0,-1,  1, 1,-1,-1};
+const int inv[9] = {0,  3,4,1,2,  7,8,5,6};
+#define C_FLD 1
+
+struct Link
+{
+	int cell;			// fluid cell
+	int k;				// direction towards the solid
+	float q;			// fraction of the link in the fluid, (0, 1]
+	float pad;
+};
+
+layout( binding = 1 ) buffer dcB { float f1[  ]; };		// populations lbm.cs just streamed
+layout( binding = 2 ) buffer dcF { int   F[  ]; };
+layout( binding = 11 ) buffer dcLinks { Link links[  ]; };
+
+layout(location = 0) uniform int NX;
+layout(location = 1) uniform int NY;
+layout(location = 2) uniform int numLinks;
+
+layout( local_size_x = 64 ) in;
+
+int per(int x, int max)
+{
+	if( x < 0 ) return max;
+	if( x > max ) return 0;
+	return x;
+}
+
+// lbm.cs has already bounced every cut link half-way, f1[x][inv k] holds the post-collision
+// f_k(x). The other two post-collision values Bouzidi et al. (2001) interpolate with sit in
+// f1 after streaming too, in slots no other link of this pass writes:
+//
+//   q < 1/2:  f_inv(x) = 2q f_k(x) + (1 - 2q) f_k(x - e_k),           f_k(x - e_k) is f1[x][k]
+//   q >= 1/2: f_inv(x) = f_k(x) / 2q + (1 - 1/2q) f_inv(x),           f_inv(x) is f1[x - e_k][inv k]
+//
+// Links whose upstream cell x - e_k is solid as well keep the half-way value.
+void main()
+{
+	int l = int(gl_GlobalInvocationID.x);
+	if( l >= numLinks )
+		return;
+
+	Link link = links[l];
+	int x = link.cell % NX, y = link.cell / NX;
+	int k = link.k, kb = inv[k];
+
+	int xs = per(x - ex[k], NX-1);
+	int ys = per(y - ey[k], NY-1);
+	int idxs = xs + ys * NX;
+	if( F[ idxs ] != C_FLD )
+		return;
+
+	float fk = f1[link.cell*NUM_VECTORS + kb];
+	float q = link.q;
+	if( q < 0.5 )
+		f1[link.cell*NUM_VECTORS + kb] = 2.0 * q * fk + (1.0 - 2.0 * q) * f1[link.cell*NUM_VECTORS + k];
+	else
+		f1[link.cell*NUM_VECTORS + kb] = fk / (2.0 * q) + (1.0 - 1.0 / (2.0 * q)) * f1[idxs*NUM_VECTORS + kb];
+}
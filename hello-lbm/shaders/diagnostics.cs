@@ -0,0 +1,168 @@
+// Conservation / stability diagnostics of the LBM state, see Diagnostics.h
+#version 430 core
+#extension GL_KHR_shader_subgroup_arithmetic : enable
+
+/*-------------------- Reduced quantities --------------------------------------------------------------------*/
+#define NUM_VECTORS 9
+#define C_FLD 1
+
+#define Q_MASS      0   // sum of rho over fluid cells
+#define Q_MOM_X     1   // sum of rho*u
+#define Q_MOM_Y     2   // sum of rho*v
+#define Q_ENERGY    3   // sum of rho*(u*u + v*v)/2
+#define Q_MAX_SPEED 4   // max |u|
+#define Q_NAN       5   // cells with a NaN/Inf density or momentum
+#define Q_CELLS     6   // fluid cells
+#define NUM_Q       8   // padded to two vec4
+
+#define GROUP_SIZE 256
+
+const int ex[9] = {0,  1,0,-1, 0,  1,-1,-1, 1};
+const int ey[9] = {0,  0,1, 0,-1,  1, 1,-1,-1};
+const float w[9] = {4.0/9.0, 1.0/9.0,1.0/9.0,1.0/9.0,1.0/9.0, 1.0/36.0,1.0/36.0,1.0/36.0,1.0/36.0};
+
+// Same storage modes as lbm.cs. The 16-bit ones hold post-collision populations, which
+// have the same mass and differ in momentum only by the forcing term.
+#define STORAGE_FP32 0
+#define STORAGE_FP16 1
+#define STORAGE_FP16_SHIFTED 2
+#define STORAGE_FP16C 3
+#ifndef STORAGE
+#define STORAGE STORAGE_FP32
+#endif
+#define HALF_WORDS 5
+
+#if STORAGE == STORAGE_FP32
+layout( binding = 0 ) buffer df0 { float f0[  ]; };
+#else
+layout( binding = 0 ) buffer dh0 { uint h0[  ]; };
+#endif
+layout( binding = 2 ) buffer dcF { int   F[  ]; };
+layout( binding = 6 ) buffer dPartial { float partial[  ]; };  // NUM_Q per work group of pass 0
+layout( binding = 7 ) buffer dResult { float result[ NUM_Q ]; };
+
+uniform int N;              // cells
+uniform int pass;           // 0: lattice -> partial, 1: partial -> result
+uniform int numPartials;
+
+layout( local_size_x = GROUP_SIZE ) in;
+
+shared float sdata[ NUM_Q ][ GROUP_SIZE ];
+
+float decodeC(uint h)
+{
+	uint mag = h & 0x7fffu;
+	float f = mag < 0x800u ? float(mag) * (1.0 / 33554432.0) : uintBitsToFloat((mag << 12) + (112u << 23));
+	return (h & 0x8000u) != 0u ? -f : f;
+}
+
+float loadF(uint cell, int k)
+{
+#if STORAGE == STORAGE_FP32
+	return f0[cell*NUM_VECTORS+k];
+#elif STORAGE == STORAGE_FP16C
+	uint word = h0[ cell*HALF_WORDS + k/2 ];
+	return decodeC((k & 1) == 0 ? word & 0xffffu : word >> 16) + w[k];
+#else
+	vec2 p = unpackHalf2x16(h0[ cell*HALF_WORDS + k/2 ]);
+	float f = (k & 1) == 0 ? p.x : p.y;
+#if STORAGE == STORAGE_FP16_SHIFTED
+	f += w[k];
+#endif
+	return f;
+#endif
+}
+
+float combine(int q, float a, float b)
+{
+	return q == Q_MAX_SPEED ? max(a, b) : a + b;
+}
+
+void main()
+{
+	uint lid = gl_LocalInvocationID.x;
+	float acc[NUM_Q];
+	for(int q=0; q<NUM_Q; q++)
+		acc[q] = 0.0;
+
+	if( pass == 0 )
+	{
+		// Grid stride loop, a bounded number of groups leaves one small second pass
+		for(uint idx = gl_GlobalInvocationID.x; idx < uint(N); idx += gl_NumWorkGroups.x * GROUP_SIZE)
+		{
+			if( F[ idx ] != C_FLD )
+				continue;
+
+			float rho = 0, jx = 0, jy = 0;
+			for(int k=0; k<9; k++)
+			{
+				float fk = loadF(idx, k);
+				rho += fk;
+				jx += fk*ex[k];
+				jy += fk*ey[k];
+			}
+
+			acc[Q_CELLS] += 1.0;
+
+			// Keep the sums finite so a single bad cell is counted rather than poisoning everything
+			if( isnan(rho) || isinf(rho) || isnan(jx) || isinf(jx) || isnan(jy) || isinf(jy) )
+			{
+				acc[Q_NAN] += 1.0;
+				continue;
+			}
+
+			float u = jx / rho;
+			float v = jy / rho;
+			acc[Q_MASS] += rho;
+			acc[Q_MOM_X] += jx;
+			acc[Q_MOM_Y] += jy;
+			acc[Q_ENERGY] += 0.5 * (jx*u + jy*v);
+			acc[Q_MAX_SPEED] = max(acc[Q_MAX_SPEED], sqrt(u*u + v*v));
+		}
+	}
+	else
+	{
+		for(uint i = lid; i < uint(numPartials); i += GROUP_SIZE)
+			for(int q=0; q<NUM_Q; q++)
+				acc[q] = combine(q, acc[q], partial[i*NUM_Q+q]);
+	}
+
+#ifdef GL_KHR_shader_subgroup_arithmetic
+	// Reduce within each subgroup first, then only one value per subgroup goes through shared memory
+	for(int q=0; q<NUM_Q; q++)
+		acc[q] = (q == Q_MAX_SPEED) ? subgroupMax(acc[q]) : subgroupAdd(acc[q]);
+
+	if( subgroupElect() )
+		for(int q=0; q<NUM_Q; q++)
+			sdata[q][gl_SubgroupID] = acc[q];
+	barrier();
+
+	uint count = gl_NumSubgroups;
+#else
+	for(int q=0; q<NUM_Q; q++)
+		sdata[q][lid] = acc[q];
+	barrier();
+
+	uint count = GROUP_SIZE;
+#endif
+
+	// Shared memory tree, count is a power of two
+	for(uint stride = count / 2; stride > 0; stride /= 2)
+	{
+		if( lid < stride )
+			for(int q=0; q<NUM_Q; q++)
+				sdata[q][lid] = combine(q, sdata[q][lid], sdata[q][lid + stride]);
+		barrier();
+	}
+
+	if( lid == 0 )
+	{
+		for(int q=0; q<NUM_Q; q++)
+		{
+			if( pass == 0 )
+				partial[gl_WorkGroupID.x*NUM_Q+q] = sdata[q][0];
+			else
+				result[q] = sdata[q][0];
+		}
+	}
+}
@@ -0,0 +1,51 @@
+// Speed or vorticity from the packed fields of lbm.cs into an image, see FieldView.h
+#version 430 core
+
+#define C_FLD 1
+
+#define VIEW_SPEED 0
+#define VIEW_VORTICITY 1
+
+layout( binding = 2 ) buffer dcF { int F[  ]; };
+layout( binding = 6 ) buffer dFld { vec4 fields[  ]; };		// rho, pressure, speed, vorticity
+layout( binding = 0, rgba8 ) writeonly uniform image2D img;
+
+uniform int NX, NY;
+uniform int view;
+uniform float range;			// speed at the top of the palette, or |vorticity| at both ends
+
+layout( local_size_x = 16, local_size_y = 16, local_size_z = 1 ) in;
+
+// Same cosine palette as gray-scott.cs
+vec4 color(float t)
+{
+	float coltab[] = { 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 1.0, 0.7, 0.4, 0.00, 0.15, 0.20 };
+
+	vec4 col;
+	col.r = coltab[0] + coltab[3] * cos(2 * 3.1416 * (coltab[6] * t + coltab[9]));
+	col.g = coltab[1] + coltab[4] * cos(2 * 3.1416 * (coltab[7] * t + coltab[10]));
+	col.b = coltab[2] + coltab[5] * cos(2 * 3.1416 * (coltab[8] * t + coltab[11]));
+	col.a = 1.0;
+
+	return col;
+}
+
+void main()
+{
+	ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+	if( p.x >= NX || p.y >= NY )
+		return;
+
+	int idx = p.x + p.y * NX;
+
+	// Solids in the grey of the obstacle quads
+	if( F[ idx ] != C_FLD )
+	{
+		imageStore(img, p, vec4(0.6, 0.6, 0.6, 1.0));
+		return;
+	}
+
+	vec4 fld = fields[ idx ];
+	float t = view == VIEW_SPEED ? clamp(fld.z / range, 0.0, 1.0) : clamp(0.5 + 0.5 * fld.w / range, 0.0, 1.0);
+	imageStore(img, p, color(t));
+}
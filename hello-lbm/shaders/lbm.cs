@@ -2,15 +2,23 @@
 #version 430 core
 //#extension GL_ARB_compute_shader : enable
 //#extension GL_ARB_shader_storage_buffer_object : enable
+#extension GL_KHR_shader_subgroup_arithmetic : enable
 
 /*-------------------- LBM model data -------------------------------------------------------------------------*/
 #define NUM_VECTORS 9
-#define tau 0.631//0.6
 #define omega (1.0/tau)		// viscosity, etc.
 //#define nu ((1.0/3.0)* (tau-1.0/2.0)) //112.6666
 #define nu ((2.0*tau-1.0)/6.0)//((1.0/3.0)* (tau-1.0/2.0)) //112.6666
 
-#define C 0.06
+/*-------------------- Collision operators --------------------------------------------------------------------*/
+#define COLL_BGK 0				// single relaxation time
+#define COLL_MRT 1				// Lallemand & Luo moments, ghost modes relaxed separately
+#define COLL_CUMULANT 2			// central moments / cumulants, higher orders straight to equilibrium
+
+// MRT rates of the energy, energy-square and heat-flux modes (Lallemand & Luo 2000)
+#define S_E 1.64
+#define S_EPS 1.54
+#define S_Q 1.9
 const int ex[9] = {0,  1,0,-1, 0,  1,-1,-1, 1};
 const int ey[9] = {0,  0,1, 0,-1,  1, 1,-1,-1};
 const int inv[9] = {0, 3,4, 1, 2,  7, 8, 5, 6};
@@ -18,19 +26,88 @@ const float w[9] = {4.0/9.0, 1.0/9.0,1.0/9.0,1.0/9.0,1.0/9.0, 1.0/36.0,1.0/36.0,
 #define C_FLD 1
 #define C_BND 0
 
+/*-------------------- Momentum exchange, see Forces.h ---------------------------------------------------------*/
+#define NUM_BODIES 2			// 0: obstacle, 1: channel walls (rows 0 and NY-1)
+#define FORCE_SCALE 1048576.0	// 2^20, fixed point of the integer atomics
+#define VEL_SCALE 16384.0		// 2^14, the velocity sums are much larger
+#define F_SLOT_SIZE 9			// Fx,Fy per body, sum u, sum v (low words), fluid cells, sum u, sum v (high words)
+#define F_HIGH 3				// from a low word of the velocity sums to its high word
+
+/*-------------------- Macroscopic output ----------------------------------------------------------------------*/
+// Only the steps somebody samples write fields, the other NUMR - 1 of a frame skip the stores
+#define OUT_VELOCITY 1			// U, V for particles.cs
+#define OUT_FIELDS 2			// fields[]: rho, pressure, speed, vorticity
+
+/*-------------------- Distribution storage ---------------------------------------------------------------------*/
+// The host puts "#define STORAGE n" in front of the source, see Storage.h
+#define STORAGE_FP32 0			// 9 floats per cell, push streaming of pre-collision populations
+#define STORAGE_FP16 1			// 9 halves in 5 uints per cell
+#define STORAGE_FP16_SHIFTED 2	// f - w[k] as halves, the digits go where the populations differ
+#define STORAGE_FP16C 3			// f - w[k] as 1 sign, 4 exponent, 11 mantissa bits (|f - w| < 2)
+#ifndef STORAGE
+#define STORAGE STORAGE_FP32
+#endif
+#define HALF_WORDS 5
+
+// Two directions share a word, so the 16-bit modes stream by pull: every cell gathers its
+// populations from the neighbours and only writes its own words. What is stored there are
+// post-collision populations.
+#if STORAGE == STORAGE_FP32
 layout( binding = 0 ) buffer df0 { float f0[  ]; };
 layout( binding = 1 ) buffer df1 { float f1[  ]; };
+#else
+layout( binding = 0 ) buffer dh0 { uint h0[  ]; };
+layout( binding = 1 ) buffer dh1 { uint h1[  ]; };
+#endif
 layout( binding = 2 ) buffer dcF { int   F[  ]; };
 layout( binding = 3 ) buffer dcU { float U[  ]; };
 layout( binding = 4 ) buffer dcV { float V[  ]; };
+layout( binding = 6 ) buffer dFld { vec4 fields[  ]; };		// OUT_FIELDS, shares 6 with Diagnostics
+layout( binding = 8 ) buffer dFrc { int forces[  ]; };	// F_SLOT_SIZE per readback slot
+#ifndef ENSEMBLE
+layout( binding = 9 ) buffer dTiles { uint tiles[  ]; };	// active tiles of the sparse mode
+#endif
 
 layout(location = 0) uniform int NX;
 layout(location = 1) uniform int NY;
+#ifndef ENSEMBLE
 layout(location = 2) uniform float devFx;
 layout(location = 3) uniform float devFy;
+#endif
+layout(location = 4) uniform int forceSlot;		// < 0 on steps that do not sample forces
+layout(location = 5) uniform int collision;		// COLL_*
+#ifndef ENSEMBLE
+layout(location = 6) uniform float tau;			// molecular relaxation time, nu = (tau - 1/2) / 3
+#endif
+layout(location = 7) uniform float C;			// Smagorinsky constant, 0 is no LES
+#ifndef ENSEMBLE
+layout(location = 8) uniform int sparse;			// 1: work group n runs tile tiles[n], see SparseTiles.h
+#endif
+layout(location = 9) uniform int outputs;		// OUT_* written by this step
+
+/*-------------------- Ensemble, see LbmEnsemble.h -------------------------------------------------------------*/
+// With "#define ENSEMBLE" every z of the dispatch is a domain of its own: NX*NY cells from
+// NX*NY*z on in every buffer, with its body force and tau in members[z]. There are no sparse
+// tiles then, members[] takes their binding.
+#ifdef ENSEMBLE
+struct Member
+{
+	vec2 force;
+	float tau;
+	float pad;
+};
+layout( binding = 9 ) buffer dMem { Member members[  ]; };
+
+int cellBase;					// first cell of this invocation's domain
+float devFx, devFy, tau;		// of this domain, set at the top of main()
+#else
+#define cellBase 0
+#endif
 
 layout( local_size_x = 10, local_size_y = 10, local_size_z = 1 ) in;
 
+shared int sForce[ F_SLOT_SIZE ];
+
 int per(int x, int nx)		// periodic bnd's
 {
 	if(x<0) x = nx;
@@ -38,29 +115,257 @@ int per(int x, int nx)		// periodic bnd's
 	return x;
 }
 
+#if STORAGE != STORAGE_FP32
+// The custom format trades the exponent range a half wastes on f - w for one more mantissa bit
+uint encodeC(float x)
+{
+	uint b = floatBitsToUint(x);
+	uint sign = (b >> 16) & 0x8000u;
+	uint mag = b & 0x7fffffffu;
+	if( mag < (113u << 23) )				// below 2^-14, evenly spaced by 2^-25
+		return sign | uint(round(abs(x) * 33554432.0));
+	return sign | min((mag - (112u << 23) + 0x800u) >> 12, 0x7fffu);
+}
+
+float decodeC(uint h)
+{
+	uint mag = h & 0x7fffu;
+	float f = mag < 0x800u ? float(mag) * (1.0 / 33554432.0) : uintBitsToFloat((mag << 12) + (112u << 23));
+	return (h & 0x8000u) != 0u ? -f : f;
+}
+
+float loadF(int cell, int k)
+{
+	uint word = h0[ cell*HALF_WORDS + k/2 ];
+#if STORAGE == STORAGE_FP16C
+	return decodeC((k & 1) == 0 ? word & 0xffffu : word >> 16) + w[k];
+#else
+	vec2 p = unpackHalf2x16(word);
+	float f = (k & 1) == 0 ? p.x : p.y;
+#if STORAGE == STORAGE_FP16_SHIFTED
+	f += w[k];
+#endif
+	return f;
+#endif
+}
+
+void storeCell(int cell, float f[9])
+{
+	for(int n=0; n<HALF_WORDS; n++)
+	{
+		vec2 p = vec2(f[2*n], 2*n+1 < 9 ? f[2*n+1] : 0.0);
+#if STORAGE == STORAGE_FP16_SHIFTED || STORAGE == STORAGE_FP16C
+		p -= vec2(w[2*n], 2*n+1 < 9 ? w[2*n+1] : 0.0);
+#endif
+#if STORAGE == STORAGE_FP16C
+		h1[ cell*HALF_WORDS + n ] = encodeC(p.x) | (encodeC(p.y) << 16);
+#else
+		h1[ cell*HALF_WORDS + n ] = packHalf2x16(p);
+#endif
+	}
+}
+#endif
+
+// Velocity of any cell at the start of the step, for the derivatives in OUT_FIELDS. The 16-bit
+// modes hold post-collision populations, their momentum only differs by the forcing.
+vec2 velocityAt(int cell)
+{
+	if( F[ cell ] != C_FLD )
+		return vec2(0);
+
+	float rho = 0;
+	vec2 m = vec2(0);
+	for(int k=0; k<9; k++)
+	{
+#if STORAGE == STORAGE_FP32
+		float fk = f0[cell*NUM_VECTORS+k];
+#else
+		float fk = loadF(cell, k);
+#endif
+		rho += fk;
+		m += fk * vec2(ex[k], ey[k]);
+	}
+	return m / rho;
+}
+
+/*-------------------- MRT --------------------------------------------------------------------------------------*/
+// Rows are rho, e, eps, jx, qx, jy, qy, pxx, pxy. They are orthogonal, so M^-1 = M^T / |row|^2.
+const float M[9][9] = {
+	{ 1, 1, 1, 1, 1, 1, 1, 1, 1},
+	{-4,-1,-1,-1,-1, 2, 2, 2, 2},
+	{ 4,-2,-2,-2,-2, 1, 1, 1, 1},
+	{ 0, 1, 0,-1, 0, 1,-1,-1, 1},
+	{ 0,-2, 0, 2, 0, 1,-1,-1, 1},
+	{ 0, 0, 1, 0,-1, 1, 1,-1,-1},
+	{ 0, 0,-2, 0, 2, 1, 1,-1,-1},
+	{ 0, 1,-1, 1,-1, 0, 0, 0, 0},
+	{ 0, 0, 0, 0, 0, 1,-1, 1,-1}
+};
+const float Mnorm[9] = {9, 36, 36, 6, 12, 6, 12, 4, 4};
+
+// f - M^-1 S M (f - feq). The conserved rows use omega like BGK so the forcing shift in feq acts
+// the same way; with every rate equal to omega this is BGK.
+void collideMRT(float f[9], float feq[9], float omegaNu, out float fpost[9])
+{
+	float s[9] = {omegaNu, S_E, S_EPS, omegaNu, S_Q, omegaNu, S_Q, omegaNu, omegaNu};
+
+	float dm[9];
+	for(int r=0; r<9; r++)
+	{
+		float m = 0;
+		for(int k=0; k<9; k++)
+			m += M[r][k] * (f[k] - feq[k]);
+		dm[r] = s[r] * m / Mnorm[r];
+	}
+
+	for(int k=0; k<9; k++)
+	{
+		float df = 0;
+		for(int r=0; r<9; r++)
+			df += M[r][k] * dm[r];
+		fpost[k] = f[k] - df;
+	}
+}
+
+/*-------------------- Cumulant ---------------------------------------------------------------------------------*/
+// Central moments by chimera transforms, one direction at a time, on g[ex+1][ey+1]
+void centralForward(inout float a, inout float b, inout float c, float uu)	// (f-, f0, f+) -> (k0, k1, k2)
+{
+	float k0 = a + b + c;
+	float d = c - a;
+	float k1 = d - uu * k0;
+	float k2 = (c + a) - 2.0 * uu * d + uu * uu * k0;
+	a = k0; b = k1; c = k2;
+}
+
+void centralBackward(inout float a, inout float b, inout float c, float uu)	// (k0, k1, k2) -> (f-, f0, f+)
+{
+	float k0 = a, k1 = b, k2 = c;
+	a = 0.5 * ((uu * uu - uu) * k0 + (2.0 * uu - 1.0) * k1 + k2);
+	b = k0 * (1.0 - uu * uu) - 2.0 * uu * k1 - k2;
+	c = 0.5 * ((uu * uu + uu) * k0 + (2.0 * uu + 1.0) * k1 + k2);
+}
+
+// In 2D the cumulants up to third order are the central moments, the only fourth order
+// one is C22 = k22 - (k20 k02 + 2 k11^2) / rho. Shear relaxes with omegaNu, bulk, third
+// and fourth orders go to equilibrium (rate 1), which is where the stability comes from.
+void collideCumulant(float f[9], float rho, float uu, float vv, float omegaNu, out float fpost[9])
+{
+	float g[3][3];
+	for(int k=0; k<9; k++)
+		g[ex[k]+1][ey[k]+1] = f[k];
+
+	for(int b=0; b<3; b++)
+		centralForward(g[0][b], g[1][b], g[2][b], uu);
+	for(int a=0; a<3; a++)
+		centralForward(g[a][0], g[a][1], g[a][2], vv);
+
+	// g[a][b] is now k_ab
+	float kxx = g[2][0], kyy = g[0][2], kxy = g[1][1];
+
+	float dxx = (1.0 - omegaNu) * (kxx - kyy);
+	float trace = 2.0 * rho / 3.0;				// bulk to equilibrium
+	kxx = 0.5 * (trace + dxx);
+	kyy = 0.5 * (trace - dxx);
+	kxy = (1.0 - omegaNu) * kxy;
+
+	g[1][0] *= (1.0 - omegaNu);					// momentum carries the forcing shift, as in BGK
+	g[0][1] *= (1.0 - omegaNu);
+	g[2][0] = kxx;
+	g[0][2] = kyy;
+	g[1][1] = kxy;
+	g[2][1] = 0.0;
+	g[1][2] = 0.0;
+	g[2][2] = (kxx * kyy + 2.0 * kxy * kxy) / rho;	// C22 = 0
+
+	for(int a=0; a<3; a++)
+		centralBackward(g[a][0], g[a][1], g[a][2], vv);
+	for(int b=0; b<3; b++)
+		centralBackward(g[0][b], g[1][b], g[2][b], uu);
+
+	for(int k=0; k<9; k++)
+		fpost[k] = g[ex[k]+1][ey[k]+1];
+}
+
 void main()					
 {
 	int i = int(gl_GlobalInvocationID.x);
 	int j = int(gl_GlobalInvocationID.y);
-	int idx = i+j*NX;
+#ifdef ENSEMBLE
+	int member = int(gl_GlobalInvocationID.z);
+	cellBase = member * NX * NY;
+	devFx = members[ member ].force.x;
+	devFy = members[ member ].force.y;
+	tau = members[ member ].tau;
+#else
+	if( sparse != 0 )
+	{
+		int tilesX = NX / int(gl_WorkGroupSize.x);
+		int tile = int(tiles[ gl_WorkGroupID.x ]);
+		i = (tile % tilesX) * int(gl_WorkGroupSize.x) + int(gl_LocalInvocationID.x);
+		j = (tile / tilesX) * int(gl_WorkGroupSize.y) + int(gl_LocalInvocationID.y);
+	}
+#endif
+	int idx = cellBase + i+j*NX;
 	float feq[9], fneq[9];	
 	float rho = 0;
 	float u = 0;
 	float v = 0;
     float Pi_x_x, Pi_x_y, Pi_y_y,Q,S,TauS, OMEGAS;
+	vec2 linkForce[NUM_BODIES] = vec2[NUM_BODIES]( vec2(0), vec2(0) );
+	vec2 cellVel = vec2(0);
+	float cellFluid = 0;
     
 	if( F[ idx ] == C_FLD )
 	{	
+        float fc[9], fpost[9];
+#if STORAGE == STORAGE_FP32
+        for(int k=0; k<9; k++)
+            fc[k] = f0[idx*NUM_VECTORS+k];
+#else
+        for(int k=0; k<9; k++)		// pull streaming
+        {
+            int is = per(i-ex[k], NX-1);
+            int js = per(j-ey[k], NY-1);
+            int idxs = cellBase + is+js*NX;
+
+            if( F[ idxs ] == C_BND )
+            {
+                // What left towards the solid last step comes back reversed
+                fc[k] = loadF(idx, inv[k]);
+
+                int body = (js == 0 || js == NY-1) ? 1 : 0;
+                linkForce[body] -= 2.0 * fc[k] * vec2(ex[k], ey[k]);
+            }
+            else
+                fc[k] = loadF(idxs, k);
+        }
+#endif
+
 		for(int k=0; k<9; k++)			// calculate density and velocity
 		{
-			rho = rho + f0[idx*NUM_VECTORS+k];
-			u = u + f0[idx*NUM_VECTORS+k]*ex[k];
-			v = v + f0[idx*NUM_VECTORS+k]*ey[k];
+			rho = rho + fc[k];
+			u = u + fc[k]*ex[k];
+			v = v + fc[k]*ey[k];
 		}
 		u /= rho;
 		v /= rho;
-		U[ idx ] = u;
-		V[ idx ] = v;
+		if( (outputs & OUT_VELOCITY) != 0 )
+		{
+			U[ idx ] = u;
+			V[ idx ] = v;
+		}
+		if( (outputs & OUT_FIELDS) != 0 )
+		{
+			// Vorticity by central differences, solid neighbours are at rest
+			int ip = per(i+1, NX-1), im = per(i-1, NX-1);
+			int jp = per(j+1, NY-1), jm = per(j-1, NY-1);
+			float vort = 0.5 * (velocityAt(cellBase+ip+j*NX).y - velocityAt(cellBase+im+j*NX).y)
+			           - 0.5 * (velocityAt(cellBase+i+jp*NX).x - velocityAt(cellBase+i+jm*NX).x);
+			fields[ idx ] = vec4(rho, rho / 3.0, length(vec2(u, v)), vort);
+		}
+		cellVel = vec2(u, v);
+		cellFluid = 1;
 		u = u + 0.5 * devFx;
 		v = v + 0.5 * devFy;
 
@@ -71,7 +376,7 @@ void main()
 			int jp = j+ey[k];
 			ip=per(ip,NX-1);
 			jp=per(jp,NY-1);
-			int idxp =  ip+jp*NX;
+			int idxp = cellBase + ip+jp*NX;
 
             //Compute the non equilibrium part of the distribution functions
             //fi_neq = fi - fi_eq
@@ -80,21 +385,111 @@ void main()
             //fneq[k] = f0[idx*NUM_VECTORS+k]*ex[k] - feq[k];
         }
 
-        OMEGAS = 1.0/tau;
+        // Smagorinsky: the eddy viscosity from the non-equilibrium stress raises tau locally
+        TauS = tau;
+        if( C > 0.0 )
+        {
+            Pi_x_x = Pi_x_y = Pi_y_y = 0;
+            for(int k=0; k<9; k++)
+            {
+                fneq[k] = fc[k] - feq[k];
+                Pi_x_x += ex[k]*ex[k]*fneq[k];
+                Pi_x_y += ex[k]*ey[k]*fneq[k];
+                Pi_y_y += ey[k]*ey[k]*fneq[k];
+            }
+            Q = Pi_x_x*Pi_x_x + 2.0*Pi_x_y*Pi_x_y + Pi_y_y*Pi_y_y;
+            S = sqrt(2.0*Q);
+            TauS = 0.5 * (tau + sqrt(tau*tau + 18.0*C*C*S/rho));
+        }
+        OMEGAS = 1.0/TauS;
+
+        if( collision == COLL_MRT )
+            collideMRT(fc, feq, OMEGAS, fpost);
+        else if( collision == COLL_CUMULANT )
+            collideCumulant(fc, rho, u, v, OMEGAS, fpost);
+        else
+            for(int k=0; k<9; k++)
+                fpost[k] = (1-OMEGAS) * fc[k] + OMEGAS * feq[k];
 
-		for(int k=0; k<9; k++)		// collision + streaming (the main solver is here, really)
+#if STORAGE == STORAGE_FP32
+		for(int k=0; k<9; k++)		// streaming
 		{
 			int ip = i+ex[k];
 			int jp = j+ey[k];
 			ip=per(ip,NX-1);
 			jp=per(jp,NY-1);
-			int idxp =  ip+jp*NX;
+			int idxp = cellBase + ip+jp*NX;
 
-            // compute feq
 			if( F[ idxp ] == C_BND )
-				f1[ idx*NUM_VECTORS + inv[k] ] = (1-OMEGAS) * f0[idx*NUM_VECTORS+k] + OMEGAS * feq[k];//omega * feq[k];
+			{
+				f1[ idx*NUM_VECTORS + inv[k] ] = fpost[k];
+
+				// The link reverses, handing 2*f*e_k of momentum to the (resting) solid
+				int body = (jp == 0 || jp == NY-1) ? 1 : 0;
+				linkForce[body] += 2.0 * fpost[k] * vec2(ex[k], ey[k]);
+			}
+			else
+				f1[ idxp*NUM_VECTORS + k] = fpost[k];
+		}
+#else
+		storeCell(idx, fpost);
+#endif
+	}
+	else if( (outputs & OUT_FIELDS) != 0 )
+		fields[ idx ] = vec4(0);
+
+	// Forces are summed in the same pass: subgroup sums, one shared atomic per subgroup
+	// and one global atomic per work group. forceSlot is uniform, so are the barriers.
+	if( forceSlot >= 0 )
+	{
+		uint lid = gl_LocalInvocationIndex;
+		if( lid < F_SLOT_SIZE )
+			sForce[ lid ] = 0;
+		barrier();
+
+		int q[F_SLOT_SIZE];
+		for(int b=0; b<NUM_BODIES; b++)
+		{
+			q[2*b] = int(round(linkForce[b].x * FORCE_SCALE));
+			q[2*b+1] = int(round(linkForce[b].y * FORCE_SCALE));
+		}
+		q[2*NUM_BODIES] = int(round(cellVel.x * VEL_SCALE));
+		q[2*NUM_BODIES+1] = int(round(cellVel.y * VEL_SCALE));
+		q[2*NUM_BODIES+2] = int(cellFluid);
+		for(int n=2*NUM_BODIES+3; n<F_SLOT_SIZE; n++)
+			q[n] = 0;
+
+#ifdef GL_KHR_shader_subgroup_arithmetic
+		for(int n=0; n<F_SLOT_SIZE; n++)
+			q[n] = subgroupAdd(q[n]);
+		if( subgroupElect() )
+			for(int n=0; n<F_SLOT_SIZE; n++)
+				atomicAdd(sForce[n], q[n]);
+#else
+		for(int n=0; n<F_SLOT_SIZE; n++)
+			if( q[n] != 0 )
+				atomicAdd(sForce[n], q[n]);
+#endif
+		barrier();
+
+		// Integer sums wrap, so only the final totals have to fit in 32 bits. An ensemble
+		// has one slot per domain, the single domain of a flat dispatch is z = 0 of 1.
+		int base = (forceSlot * int(gl_NumWorkGroups.z) + int(gl_GlobalInvocationID.z)) * F_SLOT_SIZE;
+		if( lid < F_SLOT_SIZE && sForce[ lid ] != 0 )
+		{
+			int add = sForce[ lid ];
+			if( lid == 2*NUM_BODIES || lid == 2*NUM_BODIES+1 )
+			{
+				// The velocity sums of all fluid cells do not fit in 32 bits on big grids.
+				// They are 64-bit: the carry out of the low word and the sign of the group
+				// sum go into the high word. The totals are exact in any order of adds.
+				uint old = uint(atomicAdd(forces[ base + lid ], add));
+				int high = (add < 0 ? -1 : 0) + (old + uint(add) < old ? 1 : 0);
+				if( high != 0 )
+					atomicAdd(forces[ base + lid + F_HIGH ], high);
+			}
 			else
-				f1[ idxp*NUM_VECTORS + k] = (1-OMEGAS) * f0[idx*NUM_VECTORS+k] + OMEGAS * feq[k];//omega * feq[k];
+				atomicAdd(forces[ base + lid ], add);
 		}
 	}
 }
@@ -0,0 +1,69 @@
+// D3Q19 BGK step, the 3D counterpart of lbm.cs, see Lbm3D.h
+#version 430 core
+
+/*-------------------- D3Q19 model data ----------------------------------------------------------------------*/
+#define NUM_VECTORS 19
+// Rest, the 6 faces, then the 12 edges; every odd k >= 1 is followed by its opposite
+const int ex[19] = {0,  1,-1, 0, 0, 0, 0,  1,-1, 1,-1,  1,-1, 1,-1,  0, 0, 0, 0};
+const int ey[19] = {0,  0, 0, 1,-1, 0, 0,  1,-1,-1, 1,  0, 0, 0, 0,  1,-1, 1,-1};
+const int ez[19] = {0,  0, 0, 0, 0, 1,-1,  0, 0, 0, 0,  1,-1,-1, 1,  1,-1,-1, 1};
+const int inv[19] = {0,  2, 1, 4, 3, 6, 5,  8, 7,10, 9, 12,11,14,13, 16,15,18,17};
+const float w[19] = {1.0/3.0,  1.0/18.0,1.0/18.0,1.0/18.0,1.0/18.0,1.0/18.0,1.0/18.0,
+                     1.0/36.0,1.0/36.0,1.0/36.0,1.0/36.0,1.0/36.0,1.0/36.0,
+                     1.0/36.0,1.0/36.0,1.0/36.0,1.0/36.0,1.0/36.0,1.0/36.0};
+#define C_FLD 1
+#define C_BND 0
+
+// Structure of arrays, population k of cell idx at f[k*cells + idx]: neighbouring
+// invocations touch neighbouring words for every k. Stored post-collision, the
+// step pulls from the upstream neighbours.
+layout( binding = 0 ) buffer dcA { float f0[  ]; };
+layout( binding = 1 ) buffer dcB { float f1[  ]; };
+layout( binding = 2 ) buffer dcF { int   F[  ]; };
+
+layout(location = 0) uniform ivec3 N;
+layout(location = 1) uniform vec3 force;			// body force, added as a velocity shift like lbm.cs
+layout(location = 2) uniform float tau;
+
+layout( local_size_x = 8, local_size_y = 8, local_size_z = 4 ) in;
+
+void main()
+{
+	ivec3 p = ivec3(gl_GlobalInvocationID);
+	if( any(greaterThanEqual(p, N)) )
+		return;
+
+	int cells = N.x * N.y * N.z;
+	int idx = p.x + N.x * (p.y + N.y * p.z);
+	if( F[ idx ] != C_FLD )
+		return;
+
+	float fc[NUM_VECTORS];
+	float rho = 0.0;
+	vec3 u = vec3(0.0);
+	for(int k=0; k<NUM_VECTORS; k++)		// pull streaming, periodic
+	{
+		ivec3 e = ivec3(ex[k], ey[k], ez[k]);
+		ivec3 q = (p - e + N) % N;
+		int idxs = q.x + N.x * (q.y + N.y * q.z);
+
+		// Half-way bounce-back: what left towards the solid last step comes back reversed
+		if( F[ idxs ] == C_BND )
+			fc[k] = f0[inv[k]*cells + idx];
+		else
+			fc[k] = f0[k*cells + idxs];
+
+		rho += fc[k];
+		u += fc[k] * vec3(e);
+	}
+	u = u / rho + 0.5 * force;
+
+	float omega = 1.0 / tau;
+	float uu = 1.5 * dot(u, u);
+	for(int k=0; k<NUM_VECTORS; k++)
+	{
+		float eu = dot(vec3(ex[k], ey[k], ez[k]), u);
+		float feq = w[k] * rho * (1.0 - uu + 3.0 * eu + 4.5 * eu * eu);
+		f1[k*cells + idx] = (1.0 - omega) * fc[k] + omega * feq;
+	}
+}
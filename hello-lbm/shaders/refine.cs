@@ -0,0 +1,185 @@
+// Coarse / fine coupling of the refined patch, see Refinement.h
+#version 430 core
+
+/*-------------------- LBM model data (same as lbm.cs) --------------------------------------------------------*/
+#define NUM_VECTORS 9
+const int ex[9] = {0,  1,0,-1, 0,  1,-1,-1, 1};
+const int ey[9] = {0,  0,1, 0,-1,  1, 1,-1,-1};
+const float w[9] = {4.0/9.0, 1.0/9.0,1.0/9.0,1.0/9.0,1.0/9.0, 1.0/36.0,1.0/36.0,1.0/36.0,1.0/36.0};
+#define C_FLD 1
+#define C_BND 0
+#define C_GHOST 2				// fine cells on the rim of the patch, filled from the coarse grid
+
+#define MODE_GHOST 0			// ghost cells push coarse populations into the patch
+#define MODE_INIT 1				// every fine cell from the coarse grid, when the patch is (re)placed
+#define MODE_RESTRICT 2			// coarse cells under the patch from their four fine cells
+
+layout( binding = 2 ) buffer dcF { int F[  ]; };					// coarse flags
+layout( binding = 11 ) buffer dcOld { float cOld[  ]; };			// coarse at t
+layout( binding = 12 ) buffer dcNew { float cNew[  ]; };			// coarse at t + 1
+layout( binding = 13 ) buffer dfDst { float fDst[  ]; };			// fine populations written
+layout( binding = 14 ) buffer dfSrc { float fSrc[  ]; };			// fine populations read (restriction)
+layout( binding = 15 ) buffer dfF { int FF[  ]; };				// fine flags
+
+uniform int NX, NY;				// coarse lattice
+uniform int FNX, FNY;			// fine lattice including the ghost rim
+uniform ivec2 origin;			// first coarse cell covered by the patch
+uniform float tauC, tauF;
+uniform float alpha;			// time of the ghost fill between cOld and cNew
+uniform int mode;
+
+layout( local_size_x = 10, local_size_y = 10, local_size_z = 1 ) in;
+
+float equilibrium(int k, float rho, vec2 u)
+{
+	float eu = ex[k] * u.x + ey[k] * u.y;
+	return w[k] * rho * (1.0 - 1.5 * dot(u, u) + 3.0 * eu + 4.5 * eu * eu);
+}
+
+// Coarse populations at time alpha and coarse position p (cell centres on integers),
+// bilinear over the fluid cells only
+void sampleCoarse(vec2 p, out float f[9])
+{
+	ivec2 c0 = ivec2(floor(p));
+	vec2 t = p - vec2(c0);
+
+	for(int k=0; k<9; k++)
+		f[k] = 0.0;
+
+	float wsum = 0.0;
+	for(int n=0; n<4; n++)
+	{
+		ivec2 c = c0 + ivec2(n & 1, n >> 1);
+		c.x = (c.x + NX) % NX;
+		c.y = clamp(c.y, 0, NY - 1);
+		int idx = c.x + c.y * NX;
+		if( F[ idx ] != C_FLD )
+			continue;
+
+		float wt = ((n & 1) != 0 ? t.x : 1.0 - t.x) * ((n >> 1) != 0 ? t.y : 1.0 - t.y);
+		for(int k=0; k<9; k++)
+			f[k] += wt * mix(cOld[idx*NUM_VECTORS+k], cNew[idx*NUM_VECTORS+k], alpha);
+		wsum += wt;
+	}
+
+	if( wsum > 0.0 )
+		for(int k=0; k<9; k++)
+			f[k] /= wsum;
+	else
+		for(int k=0; k<9; k++)
+			f[k] = w[k];
+}
+
+void moments(float f[9], out float rho, out vec2 u)
+{
+	rho = 0.0;
+	u = vec2(0.0);
+	for(int k=0; k<9; k++)
+	{
+		rho += f[k];
+		u += f[k] * vec2(ex[k], ey[k]);
+	}
+	u /= rho;
+}
+
+// Fine cell centre in coarse cell coordinates
+vec2 fineToCoarse(ivec2 fc)
+{
+	return vec2(origin) + (vec2(fc - ivec2(1)) + 0.5) * 0.5 - 0.5;
+}
+
+void main()
+{
+	ivec2 gid = ivec2(gl_GlobalInvocationID.xy);
+
+	if( mode == MODE_RESTRICT )
+	{
+		// One coarse cell per invocation, away from the rim where the ghosts are coupled
+		int cw = (FNX - 2) / 2, ch = (FNY - 2) / 2;
+		if( gid.x < 1 || gid.y < 1 || gid.x >= cw - 1 || gid.y >= ch - 1 )
+			return;
+
+		ivec2 c = origin + gid;
+		int cidx = c.x + c.y * NX;
+		if( F[ cidx ] != C_FLD )
+			return;
+
+		float fm[9], neq[9];
+		for(int k=0; k<9; k++)
+			fm[k] = neq[k] = 0.0;
+
+		int fluid = 0;
+		for(int n=0; n<4; n++)
+		{
+			ivec2 fc = ivec2(1) + 2 * gid + ivec2(n & 1, n >> 1);
+			int fidx = fc.x + fc.y * FNX;
+			if( FF[ fidx ] != C_FLD )
+				continue;
+
+			float f[9], rho;
+			vec2 u;
+			for(int k=0; k<9; k++)
+				f[k] = fSrc[fidx*NUM_VECTORS+k];
+			moments(f, rho, u);
+			for(int k=0; k<9; k++)
+			{
+				fm[k] += f[k];
+				neq[k] += f[k] - equilibrium(k, rho, u);
+			}
+			fluid++;
+		}
+		if( fluid == 0 )
+			return;
+
+		float rho;
+		vec2 u;
+		for(int k=0; k<9; k++)
+			fm[k] /= float(fluid);
+		moments(fm, rho, u);
+
+		// f_neq scales with tau / dt, the fine step is half as long
+		float scale = 2.0 * tauC / tauF / float(fluid);
+		for(int k=0; k<9; k++)
+			cNew[cidx*NUM_VECTORS+k] = equilibrium(k, rho, u) + scale * neq[k];
+		return;
+	}
+
+	if( gid.x >= FNX || gid.y >= FNY )
+		return;
+
+	int fidx = gid.x + gid.y * FNX;
+	int flag = FF[ fidx ];
+	if( mode == MODE_GHOST && flag != C_GHOST )
+		return;
+
+	float f[9], rho;
+	vec2 u;
+	sampleCoarse(fineToCoarse(gid), f);
+	moments(f, rho, u);
+
+	float scale = 0.5 * tauF / tauC;
+	if( mode == MODE_INIT )
+	{
+		for(int k=0; k<9; k++)
+		{
+			float feq = equilibrium(k, rho, u);
+			fDst[fidx*NUM_VECTORS+k] = feq + scale * (f[k] - feq);
+		}
+		return;
+	}
+
+	// Ghost: post-collision populations streamed into the fluid neighbours, the
+	// interior cells stream into everything else of the same destination buffer
+	for(int k=0; k<9; k++)
+	{
+		ivec2 p = gid + ivec2(ex[k], ey[k]);
+		if( p.x < 0 || p.y < 0 || p.x >= FNX || p.y >= FNY )
+			continue;
+		int pidx = p.x + p.y * FNX;
+		if( FF[ pidx ] != C_FLD )
+			continue;
+
+		float feq = equilibrium(k, rho, u);
+		fDst[pidx*NUM_VECTORS+k] = feq + (1.0 - 1.0 / tauF) * scale * (f[k] - feq);
+	}
+}
@@ -0,0 +1,50 @@
+// Speed on one z plane of the D3Q19 lattice into an image, see Lbm3D.h
+#version 430 core
+
+#define NUM_VECTORS 19
+const int ex[19] = {0,  1,-1, 0, 0, 0, 0,  1,-1, 1,-1,  1,-1, 1,-1,  0, 0, 0, 0};
+const int ey[19] = {0,  0, 0, 1,-1, 0, 0,  1,-1,-1, 1,  0, 0, 0, 0,  1,-1, 1,-1};
+const int ez[19] = {0,  0, 0, 0, 0, 1,-1,  0, 0, 0, 0,  1,-1,-1, 1,  1,-1,-1, 1};
+#define C_FLD 1
+
+layout( binding = 0 ) buffer dcA { float f[  ]; };			// newest populations
+layout( binding = 2 ) buffer dcF { int   F[  ]; };
+layout( binding = 0, rgba8 ) writeonly uniform image2D slice;
+
+layout(location = 0) uniform ivec3 N;
+layout(location = 1) uniform int z;
+layout(location = 2) uniform float maxSpeed;		// top of the colour ramp
+
+layout( local_size_x = 16, local_size_y = 16, local_size_z = 1 ) in;
+
+void main()
+{
+	ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+	if( p.x >= N.x || p.y >= N.y )
+		return;
+
+	int cells = N.x * N.y * N.z;
+	int idx = p.x + N.x * (p.y + N.y * z);
+
+	// Solids in the same grey as the 2D obstacles
+	if( F[ idx ] != C_FLD )
+	{
+		imageStore(slice, p, vec4(0.6, 0.6, 0.6, 1.0));
+		return;
+	}
+
+	// Only the plane is reduced to moments, the step itself never writes velocities
+	float rho = 0.0;
+	vec3 m = vec3(0.0);
+	for(int k=0; k<NUM_VECTORS; k++)
+	{
+		float fk = f[k*cells + idx];
+		rho += fk;
+		m += fk * vec3(ex[k], ey[k], ez[k]);
+	}
+
+	// Black - blue - white ramp
+	float s = clamp(length(m) / rho / maxSpeed, 0.0, 1.0);
+	vec3 color = s < 0.5 ? mix(vec3(0.0), vec3(0.1, 0.3, 1.0), 2.0 * s) : mix(vec3(0.1, 0.3, 1.0), vec3(1.0), 2.0 * s - 1.0);
+	imageStore(slice, p, vec4(color, 1.0));
+}
@@ -0,0 +1,34 @@
+// Active tile list of the sparse LBM mode, see SparseTiles.h
+#version 430 core
+
+#define C_FLD 1
+#define TILE 10					// same as the 10x10 work groups of lbm.cs
+
+layout( binding = 2 ) buffer dcF { int F[  ]; };
+layout( binding = 9 ) buffer dTiles { uint tiles[  ]; };
+layout( binding = 10 ) buffer dIndirect { uint numGroupsX; uint numGroupsY; uint numGroupsZ; };
+
+layout( location = 0 ) uniform int NX;
+
+layout( local_size_x = TILE, local_size_y = TILE, local_size_z = 1 ) in;
+
+shared uint tileHasFluid;
+
+void main()
+{
+	if( gl_LocalInvocationIndex == 0 )
+		tileHasFluid = 0;
+	barrier();
+
+	uint idx = gl_GlobalInvocationID.x + gl_GlobalInvocationID.y * uint(NX);
+	if( F[ idx ] == C_FLD )
+		tileHasFluid = 1;
+	barrier();
+
+	// One work group of the lbm dispatch per tile with any fluid in it
+	if( gl_LocalInvocationIndex == 0 && tileHasFluid != 0 )
+	{
+		uint slot = atomicAdd(numGroupsX, 1u);
+		tiles[ slot ] = gl_WorkGroupID.x + gl_WorkGroupID.y * gl_NumWorkGroups.x;
+	}
+}
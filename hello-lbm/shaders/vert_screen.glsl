@@ -0,0 +1,11 @@
+#version 430 core
+
+out vec2 uv;
+
+// One triangle over the whole viewport, no vertex buffer
+void main()
+{
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    uv = p;
+    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}